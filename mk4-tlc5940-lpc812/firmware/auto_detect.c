@@ -0,0 +1,324 @@
+/******************************************************************************
+
+    Detects the input protocol at boot (MASTER_WITH_AUTO_DETECT).
+
+    This allows running the same configuration with servo, CPPM and serial
+    receivers as well as with the pre-processor. The detected master mode is
+    stored in operating_mode, which all modules use instead of config.mode.
+    In all other modes operating_mode is simply config.mode.
+
+    Detection runs in two stages:
+
+    1. The ST and TH pins are polled as GPIOs for SIGNATURE_WINDOW, timed
+       with the SysTick counter. Every time between two edges is a segment,
+       recorded per level. The signal of each pin is classified as follows:
+
+        Serial:  The shortest segment is below SERIAL_SEGMENT_MAX, i.e. a
+                 few UART bits. The level of the longest segment is the idle
+                 level of the line.
+        CPPM:    Both levels have several segments below PULSE_MAX, and
+                 there is a longer segment (the sync gap).
+        Servo:   All high segments are valid servo pulses between
+                 PULSE_MIN and PULSE_MAX.
+
+       A CPPM signal is only expected on ST; servo pulses on either ST or TH
+       select the servo reader.
+
+    2. A serial signal that idles low is an (inverted) SBUS receiver. For a
+       signal that idles high the UART is started with the settings of the
+       candidate modes in turn, looking for their magic bytes during
+       MAGIC_BYTE_WINDOW:
+
+        iBUS:          0x20 0x40 frame header at 115200 baud
+        Pre-processor: 0x87 (v1) or 0x86 (v2) at config.baudrate
+
+    Both stages are repeated until a mode is found, at most for
+    DETECTION_TIMEOUT. If the receiver does not output a signal by then the
+    servo reader is used.
+
+    Detection finishes before any of the readers is initialized, so the
+    readers, the UART and the pin assignment are set up exactly like with the
+    mode configured explicitly.
+
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <LPC8xx.h>
+
+#include <globals.h>
+#include <uart0.h>
+
+
+#define TICKS_PER_US (__SYSTEM_CLOCK / 1000000)
+#define US(x) ((x) * TICKS_PER_US)
+#define MS(x) ((x) * 1000 * TICKS_PER_US)
+
+#define SIGNATURE_WINDOW MS(100)
+#define MAGIC_BYTE_WINDOW MS(100)
+#define DETECTION_TIMEOUT MS(2000)
+
+#define SERIAL_SEGMENT_MAX US(100)
+#define PULSE_MIN US(700)
+#define PULSE_MAX US(2500)
+
+#define MIN_EDGES 6
+#define MIN_CPPM_SEGMENTS 4
+#define MIN_MAGIC_BYTES 2
+
+#define IBUS_HEADER_LENGTH 0x20
+#define IBUS_HEADER_COMMAND 0x40
+#define SLAVE_MAGIC_BYTE 0x87
+#define PREPROCESSOR_MAGIC_BYTE_V2 0x86
+
+
+typedef enum {
+    SIGNAL_NONE,
+    SIGNAL_SERVO,
+    SIGNAL_CPPM,
+    SIGNAL_SERIAL_IDLE_LOW,
+    SIGNAL_SERIAL_IDLE_HIGH
+} SIGNAL_T;
+
+typedef struct {
+    uint32_t mask;
+    uint32_t last_edge;
+    uint16_t edges;
+    uint16_t short_segments[2];     // Index is the level of the segment
+    uint32_t shortest[2];
+    uint32_t longest[2];
+    bool level;
+} PIN_STATISTICS_T;
+
+
+static uint32_t now;
+static uint32_t last_systick;
+
+
+// ****************************************************************************
+// Advances the free running tick counter now. Must be called more often than
+// the SysTick period.
+// ****************************************************************************
+static void update_time(void)
+{
+    uint32_t systick = SysTick->VAL;
+
+    // SysTick counts down from LOAD to 0
+    if (systick <= last_systick) {
+        now += last_systick - systick;
+    }
+    else {
+        now += last_systick + (SysTick->LOAD + 1) - systick;
+    }
+    last_systick = systick;
+}
+
+
+// ****************************************************************************
+static void init_pin(PIN_STATISTICS_T *p, uint32_t mask, uint32_t pins)
+{
+    p->mask = mask;
+    p->level = (pins & mask) ? true : false;
+    p->edges = 0;
+    p->short_segments[0] = 0;
+    p->short_segments[1] = 0;
+    p->shortest[0] = UINT32_MAX;
+    p->shortest[1] = UINT32_MAX;
+    p->longest[0] = 0;
+    p->longest[1] = 0;
+}
+
+
+// ****************************************************************************
+static void sample_pin(PIN_STATISTICS_T *p, uint32_t pins)
+{
+    bool level = (pins & p->mask) ? true : false;
+    uint32_t segment;
+
+    if (level == p->level) {
+        return;
+    }
+
+    // The segment that just ended has the previous level. The time before
+    // the first edge is not a complete segment.
+    if (p->edges) {
+        segment = now - p->last_edge;
+
+        p->shortest[p->level] = MIN(p->shortest[p->level], segment);
+        p->longest[p->level] = MAX(p->longest[p->level], segment);
+        if (segment < PULSE_MAX) {
+            ++p->short_segments[p->level];
+        }
+    }
+
+    p->level = level;
+    p->last_edge = now;
+    ++p->edges;
+}
+
+
+// ****************************************************************************
+static SIGNAL_T classify_signal(const PIN_STATISTICS_T *p)
+{
+    if (p->edges < MIN_EDGES) {
+        return SIGNAL_NONE;
+    }
+
+    if (MIN(p->shortest[0], p->shortest[1]) < SERIAL_SEGMENT_MAX) {
+        if (p->longest[1] > p->longest[0]) {
+            return SIGNAL_SERIAL_IDLE_HIGH;
+        }
+        return SIGNAL_SERIAL_IDLE_LOW;
+    }
+
+    if (p->short_segments[0] >= MIN_CPPM_SEGMENTS  &&
+            p->short_segments[1] >= MIN_CPPM_SEGMENTS  &&
+            MAX(p->longest[0], p->longest[1]) >= PULSE_MAX) {
+        return SIGNAL_CPPM;
+    }
+
+    if (p->shortest[1] >= PULSE_MIN  &&  p->longest[1] < PULSE_MAX) {
+        return SIGNAL_SERVO;
+    }
+
+    return SIGNAL_NONE;
+}
+
+
+// ****************************************************************************
+// Stage 1: poll the ST and TH pins and determine what kind of signal they
+// carry.
+// ****************************************************************************
+static MASTER_MODE_T detect_signal(SIGNAL_T *st_signal)
+{
+    PIN_STATISTICS_T st;
+    PIN_STATISTICS_T th;
+    uint32_t pins;
+    uint32_t start;
+    SIGNAL_T th_signal;
+
+    pins = LPC_GPIO_PORT->PIN0;
+    init_pin(&st, (1 << GPIO_BIT_ST), pins);
+    init_pin(&th, (1 << GPIO_BIT_TH), pins);
+
+    update_time();
+    start = now;
+    while ((now - start) < SIGNATURE_WINDOW) {
+        pins = LPC_GPIO_PORT->PIN0;
+        update_time();
+        sample_pin(&st, pins);
+        sample_pin(&th, pins);
+    }
+
+    *st_signal = classify_signal(&st);
+    th_signal = classify_signal(&th);
+
+    switch (*st_signal) {
+        case SIGNAL_CPPM:
+            return MASTER_WITH_CPPM_READER;
+
+        case SIGNAL_SERIAL_IDLE_LOW:
+            return MASTER_WITH_SBUS_READER;
+
+        case SIGNAL_SERVO:
+            return MASTER_WITH_SERVO_READER;
+
+        case SIGNAL_SERIAL_IDLE_HIGH:
+        case SIGNAL_NONE:
+        default:
+            break;
+    }
+
+    if (th_signal == SIGNAL_SERVO) {
+        return MASTER_WITH_SERVO_READER;
+    }
+
+    return MASTER_WITH_AUTO_DETECT;
+}
+
+
+// ****************************************************************************
+// Stage 2: start the UART as the given mode would and look for its magic
+// bytes.
+// ****************************************************************************
+static bool find_magic_bytes(MASTER_MODE_T mode)
+{
+    uint32_t start;
+    uint8_t previous = 0;
+    uint8_t data;
+    int found = 0;
+
+    // init_uart0() derives the baudrate and format from operating_mode
+    operating_mode = mode;
+    init_uart0();
+
+    // U0_RXD_I=PIO0_0 (ST)
+    LPC_SWM->PINASSIGN0 = (0xff << 24) |
+                          (0xff << 16) |
+                          (GPIO_BIT_ST << 8) |
+                          (0xff << 0);
+
+    update_time();
+    start = now;
+    while ((now - start) < MAGIC_BYTE_WINDOW) {
+        update_time();
+
+        // Always drain the receive buffer so that no stale bytes reach the
+        // reader of the detected mode
+        while (uart0_read_is_byte_pending()) {
+            data = uart0_read_byte();
+
+            if (mode == MASTER_WITH_IBUS_READER) {
+                if (previous == IBUS_HEADER_LENGTH  &&
+                        data == IBUS_HEADER_COMMAND) {
+                    ++found;
+                }
+            }
+            else {
+                if (data == SLAVE_MAGIC_BYTE  ||
+                        data == PREPROCESSOR_MAGIC_BYTE_V2) {
+                    ++found;
+                }
+            }
+            previous = data;
+        }
+    }
+
+    return found >= MIN_MAGIC_BYTES;
+}
+
+
+// ****************************************************************************
+void detect_input_mode(void)
+{
+    MASTER_MODE_T mode;
+    SIGNAL_T signal;
+    uint32_t start;
+
+    operating_mode = config.mode;
+    if (config.mode != MASTER_WITH_AUTO_DETECT) {
+        return;
+    }
+
+    now = 0;
+    last_systick = SysTick->VAL;
+    start = now;
+
+    do {
+        mode = detect_signal(&signal);
+        if (mode != MASTER_WITH_AUTO_DETECT) {
+            operating_mode = mode;
+            return;
+        }
+
+        if (signal == SIGNAL_SERIAL_IDLE_HIGH) {
+            if (find_magic_bytes(MASTER_WITH_IBUS_READER)) {
+                return;
+            }
+            if (find_magic_bytes(MASTER_WITH_UART_READER)) {
+                return;
+            }
+        }
+    } while ((now - start) < DETECTION_TIMEOUT);
+
+    operating_mode = MASTER_WITH_SERVO_READER;
+}
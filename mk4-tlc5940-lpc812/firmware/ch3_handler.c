@@ -7,18 +7,57 @@
     It also supports direct push-button reading instead of getting the
     CH3 information from a servo or a preprocessor.
 
+    The push-button (ch3_is_local_switch) is read independently of the
+    servo frames: pin interrupt 0 fires on both edges of the CH3 pin and
+    timestamps the edge with MRT channel 1, which runs as a free running
+    12 MHz down-counter. Once no further edge arrived for
+    LOCAL_SWITCH_DEBOUNCE the switch is considered settled and its new state
+    is processed right away. The IOCON glitch filter of the pin removes
+    spikes shorter than about 60 us before they cause interrupts.
+    Click timeouts are processed every systick.
+
+    Gestures:
+    The actions are configured in the ch3_gestures table (see config.c),
+    which maps gestures to actions or light program events. A gesture is
+    a number of clicks, optionally with the last press being a long press
+    (released after long_press_time) or a hold (still pressed at
+    hold_time). Long presses and holds require a momentary switch; with a
+    two-position switch every change of the switch is a click.
+
+    A gesture is dispatched as soon as it is unambiguous, i.e. when no
+    gesture in the table starts with the clicks received so far: with
+    gestures defined for up to 8 clicks, the 8th click is processed right
+    away. Otherwise the gesture is dispatched after ch3_multi_click_timeout,
+    counted from the last click (from the release of a momentary switch).
+    A long press is dispatched when the button is released, or right when
+    it reaches long_press_time if no hold is defined for the same number
+    of clicks.
+
+    The servo output setup, reversing setup and winch modes process plain
+    click counts after the timeout as before. In winch mode the gesture
+    assigned to the winch action disables the winch again.
+
 ;******************************************************************************/
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <LPC8xx.h>
 
 #include <globals.h>
-#include <uart0.h>
+#include <event_log.h>
 
 // This value must be a number higher than any number of clicks we want to
 // process.
 #define IGNORE_CLICK_COUNT 99
 
+#define MRT_TIMER_MASK 0x00ffffff
+#define LOCAL_SWITCH_DEBOUNCE (10 * (__SYSTEM_CLOCK / 1000))   // 10 ms
+
+#define IOCON_S_MODE_MASK (0x3 << 11)
+#define IOCON_S_MODE_3_CLOCKS (0x3 << 11)
+#define IOCON_CLK_DIV_MASK (0x7 << 13)
+#define IOCON_CLK_DIV_0 (0x0 << 13)
+
 
 static struct {
     unsigned int last_state : 1;
@@ -29,102 +68,269 @@ static struct {
 static uint8_t ch3_clicks;
 static uint16_t ch3_click_counter;
 
+// Momentary switches only: state of the current press
+static bool ch3_pressed;
+static bool ch3_press_dispatched;
+static uint16_t ch3_press_time;
+
+static volatile bool switch_edge_pending;
+static volatile uint32_t switch_edge_timestamp;
+
 
 // ****************************************************************************
-static void process_ch3_click_timeout(void)
+static void set_local_switch_channel(void)
 {
-    if (ch3_clicks == 0) {          // Any clicks pending?
-        return;                     // No: nothing to do
+    channel[CH3].normalized = GPIO_CH3 ? -100 : 100;
+    channel[CH3].normalized_fine = channel[CH3].normalized * 5;
+}
+
+
+// ****************************************************************************
+void init_ch3_local_switch(void)
+{
+    if (!config.flags.ch3_is_local_switch) {
+        return;
     }
 
-    if (ch3_click_counter != 0) {   // Double-click timer expired?
-        return;                     // No: wait for more buttons
+    // Reject pulses shorter than 3 clocks of glitch filter 0 (main clock
+    // divided by 255), i.e. about 60 us
+    GPIO_IOCON_CH3 = (GPIO_IOCON_CH3 &
+                      ~(IOCON_S_MODE_MASK | IOCON_CLK_DIV_MASK)) |
+                     IOCON_S_MODE_3_CLOCKS | IOCON_CLK_DIV_0;
+
+    // MRT channel 1 is a free running down-counter for the edge timestamps
+    LPC_SYSCON->SYSAHBCLKCTRL |= (1 << 10);
+    LPC_MRT->Channel[1].CTRL = (0 << 0) |   // Interrupt disabled
+                               (0 << 1);    // Repeat interrupt mode
+    LPC_MRT->Channel[1].INTVAL = MRT_TIMER_MASK |
+                                 (1u << 31);  // Load immediately
+
+    // Pin interrupt 0 on both edges of the CH3 pin
+    LPC_SYSCON->PINTSEL[0] = GPIO_BIT_CH3;
+    LPC_PIN_INT->ISEL &= ~(1 << 0);         // Edge sensitive
+    LPC_PIN_INT->SIENR = (1 << 0);          // Rising edge
+    LPC_PIN_INT->SIENF = (1 << 0);          // Falling edge
+    LPC_PIN_INT->IST = (1 << 0);            // Clear pending edges
+    NVIC_EnableIRQ(PININT0_IRQn);
+
+    set_local_switch_channel();
+}
+
+
+// ****************************************************************************
+void PININT0_irq_handler(void)
+{
+    LPC_PIN_INT->IST = (1 << 0);
+    switch_edge_timestamp = LPC_MRT->Channel[1].TIMER;
+    switch_edge_pending = true;
+}
+
+
+// ****************************************************************************
+// Returns true if the local switch has settled in a new state since the last
+// call.
+// ****************************************************************************
+static bool read_local_switch(void)
+{
+    uint32_t timestamp;
+    int16_t old_value;
+
+    if (!switch_edge_pending) {
+        return false;
     }
 
-    if (diagnostics_enabled()) {
-        uart0_send_cstring("click_timeout\n");
+    timestamp = switch_edge_timestamp;
+    if (((timestamp - LPC_MRT->Channel[1].TIMER) & MRT_TIMER_MASK) <
+            LOCAL_SWITCH_DEBOUNCE) {
+        return false;
     }
 
-    // ####################################
-    // At this point we have detected one of more clicks and need to
-    // perform the appropriate action.
+    // Only clear the pending flag if no edge arrived in the meantime
+    __disable_irq();
+    if (timestamp == switch_edge_timestamp) {
+        switch_edge_pending = false;
+    }
+    __enable_irq();
+
+    old_value = channel[CH3].normalized;
+    set_local_switch_channel();
+
+    return channel[CH3].normalized != old_value;
+}
+
+
+// ****************************************************************************
+static bool in_setup_mode(void)
+{
+    return global_flags.servo_output_setup != SERVO_OUTPUT_SETUP_OFF  ||
+        global_flags.reversing_setup != REVERSING_SETUP_OFF;
+}
+
+
+// ****************************************************************************
+static int number_of_gestures(void)
+{
+    return MIN(ch3_gestures.number_of_gestures, MAX_CH3_GESTURES);
+}
+
+
+// ****************************************************************************
+// Returns the table entry for the given gesture, or NULL if it is not
+// defined. The setup modes only use clicks, so long presses and holds are
+// treated like short clicks there.
+// ****************************************************************************
+static const CH3_GESTURE_T *find_gesture(CH3_GESTURE_TYPE_T type,
+    uint8_t clicks)
+{
+    int i;
+
+    if (type != CH3_GESTURE_CLICKS  &&
+            (!config.flags.ch3_is_momentary  ||  in_setup_mode())) {
+        return NULL;
+    }
+
+    for (i = 0; i < number_of_gestures(); i++) {
+        if (ch3_gestures.gesture[i].type == type  &&
+                ch3_gestures.gesture[i].clicks == clicks) {
+            return &ch3_gestures.gesture[i];
+        }
+    }
+    return NULL;
+}
+
+
+// ****************************************************************************
+// Returns true if more clicks, or holding the current press, can still
+// result in a different gesture than ch3_clicks short clicks.
+// ****************************************************************************
+static bool is_gesture_ambiguous(void)
+{
+    const CH3_GESTURE_T *g;
+    int i;
+
+    // The setup and winch modes use their own click counts, and aborting
+    // the winch swallows the whole series of clicks
+    if (in_setup_mode()  ||  global_flags.winch_mode != WINCH_DISABLED  ||
+            ch3_clicks >= IGNORE_CLICK_COUNT) {
+        return true;
+    }
+
+    for (i = 0; i < number_of_gestures(); i++) {
+        g = &ch3_gestures.gesture[i];
+
+        if (g->action == CH3_ACTION_NONE) {
+            continue;
+        }
+
+        // Two-position switches can not do long presses
+        if (g->type != CH3_GESTURE_CLICKS  &&
+                !config.flags.ch3_is_momentary) {
+            continue;
+        }
+
+        if (g->clicks > ch3_clicks) {
+            return true;
+        }
+
+        if (ch3_pressed  &&  g->clicks == ch3_clicks  &&
+                g->type != CH3_GESTURE_CLICKS) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// ****************************************************************************
+static void execute_action(const CH3_GESTURE_T *g)
+{
+    switch (g->action) {
+        case CH3_ACTION_LIGHT_SWITCH_UP:
+            if (config.flags.gearbox_servo_output) {
+                gearbox_action(1);
+            }
+            else {
+                light_switch_up();
+            }
+            break;
+
+        case CH3_ACTION_LIGHT_SWITCH_DOWN:
+            if (config.flags.gearbox_servo_output) {
+                gearbox_action(2);
+            }
+            else {
+                light_switch_down();
+            }
+            break;
+
+        case CH3_ACTION_TOGGLE_LIGHT_SWITCH:
+            toggle_light_switch();
+            break;
+
+        case CH3_ACTION_HAZARD:
+            toggle_hazard_lights();
+            break;
+
+        case CH3_ACTION_WINCH:
+            toggle_winch();
+            break;
+
+        case CH3_ACTION_NEXT_LIGHT_SEQUENCE:
+            next_light_sequence();
+            break;
+
+        case CH3_ACTION_REVERSING_SETUP:
+            reversing_setup_action(ch3_clicks);
+            break;
+
+        case CH3_ACTION_SERVO_OUTPUT_SETUP:
+            servo_output_setup_action(ch3_clicks);
+            break;
+
+        case CH3_ACTION_LIGHT_PROGRAM_EVENT:
+            if (g->parameter >= 1  &&  g->parameter <= CH3_GESTURE_EVENTS) {
+                global_flags.ch3_gesture_event = g->parameter;
+            }
+            break;
+
+        case CH3_ACTION_NONE:
+        default:
+            break;
+    }
+}
+
+
+// ****************************************************************************
+// At this point we have detected a complete gesture and need to perform the
+// appropriate action.
+// ****************************************************************************
+static void dispatch_gesture(CH3_GESTURE_TYPE_T type)
+{
+    const CH3_GESTURE_T *g;
+
+    log_event(EVENT_CH3_GESTURE, (type << 8) | ch3_clicks);
+
+    g = find_gesture(type, ch3_clicks);
 
     if (global_flags.servo_output_setup != SERVO_OUTPUT_SETUP_OFF) {
         servo_output_setup_action(ch3_clicks);
     }
     else if (global_flags.winch_mode != WINCH_DISABLED) {
-        winch_action(ch3_clicks);
+        // The gesture that enabled the winch also disables it
+        if (g  &&  g->action == CH3_ACTION_WINCH) {
+            toggle_winch();
+        }
+        else if (type == CH3_GESTURE_CLICKS) {
+            winch_action(ch3_clicks);
+        }
     }
     else if (global_flags.reversing_setup != REVERSING_SETUP_OFF) {
         reversing_setup_action(ch3_clicks);
     }
-    else {
-        // ====================================
+    else if (g) {
         // Normal operation:
         // Neither winch nor setup nor reversing setup is active
-        switch (ch3_clicks) {
-            case 1:
-                // --------------------------
-                // Single click
-                if (config.flags.gearbox_servo_output) {
-                    gearbox_action(ch3_clicks);
-                }
-                else {
-                    light_switch_up();
-                }
-                break;
-
-            case 2:
-                // --------------------------
-                // Double click
-                if (config.flags.gearbox_servo_output) {
-                    gearbox_action(ch3_clicks);
-                }
-                else {
-                    light_switch_down();
-                }
-                break;
-
-            case 3:
-                // --------------------------
-                // 3 clicks: all lights on/off
-                toggle_light_switch();
-
-                break;
-
-            case 4:
-                // --------------------------
-                // 4 clicks: Hazard lights on/off
-                toggle_hazard_lights();
-                break;
-
-            case 5:
-                // --------------------------
-                // 5 clicks: Arm/disarm the winch
-                winch_action(ch3_clicks);
-                break;
-
-            case 6:
-                // --------------------------
-                // 6 clicks: Increment sequencer pattern selection
-                next_light_sequence();
-                break;
-
-            case 7:
-                // --------------------------
-                // 7 clicks: Enter channel reversing setup mode
-                reversing_setup_action(ch3_clicks);
-                break;
-
-            case 8:
-                // --------------------------
-                // 8 clicks: Enter steering wheel servo setup mode
-                servo_output_setup_action(ch3_clicks);
-                break;
-
-            default:
-                break;
-        }
+        execute_action(g);
     }
 
     ch3_clicks = 0;
@@ -132,12 +338,45 @@ static void process_ch3_click_timeout(void)
 
 
 // ****************************************************************************
-static void add_click(void)
+static void process_ch3_click_timeout(void)
 {
-    if (diagnostics_enabled()) {
-        uart0_send_cstring("add_click\n");
+    if (ch3_clicks == 0) {          // Any clicks pending?
+        return;                     // No: nothing to do
+    }
+
+    if (ch3_pressed) {
+        if (ch3_press_time >= ch3_gestures.hold_time  &&
+                find_gesture(CH3_GESTURE_HOLD, ch3_clicks)) {
+            ch3_press_dispatched = true;
+            dispatch_gesture(CH3_GESTURE_HOLD);
+            return;
+        }
+
+        // Without a hold gesture the long press is unambiguous as soon as
+        // it reaches long_press_time
+        if (ch3_press_time >= ch3_gestures.long_press_time  &&
+                !find_gesture(CH3_GESTURE_HOLD, ch3_clicks)  &&
+                find_gesture(CH3_GESTURE_LONG_PRESS, ch3_clicks)) {
+            ch3_press_dispatched = true;
+            dispatch_gesture(CH3_GESTURE_LONG_PRESS);
+        }
+        return;
+    }
+
+    if (ch3_click_counter != 0) {   // Double-click timer expired?
+        return;                     // No: wait for more buttons
     }
 
+    log_event(EVENT_CH3_CLICK_TIMEOUT, ch3_clicks);
+    dispatch_gesture(CH3_GESTURE_CLICKS);
+}
+
+
+// ****************************************************************************
+static void add_click(void)
+{
+    log_event(EVENT_CH3_ADD_CLICK, 0);
+
     // If the winch is running any movement of CH3 immediately turns off
     // the winch (without waiting for click timeout!)
     if (abort_winching()) {
@@ -148,36 +387,81 @@ static void add_click(void)
 
     ++ch3_clicks;
     ch3_click_counter = config.ch3_multi_click_timeout;
+
+    // Don't wait for the click timeout if no gesture starts with this one
+    if (!is_gesture_ambiguous()) {
+        dispatch_gesture(CH3_GESTURE_CLICKS);
+    }
+}
+
+
+// ****************************************************************************
+static void press(void)
+{
+    ch3_pressed = true;
+    ch3_press_time = 0;
+    ch3_press_dispatched = false;
+    add_click();
+}
+
+
+// ****************************************************************************
+static void release(void)
+{
+    ch3_pressed = false;
+
+    if (ch3_press_dispatched  ||  ch3_clicks == 0) {
+        return;
+    }
+
+    if (ch3_press_time >= ch3_gestures.long_press_time  &&
+            find_gesture(CH3_GESTURE_LONG_PRESS, ch3_clicks)) {
+        dispatch_gesture(CH3_GESTURE_LONG_PRESS);
+        return;
+    }
+
+    // It was a short click after all; wait for more from here
+    ch3_click_counter = config.ch3_multi_click_timeout;
+    if (!is_gesture_ambiguous()) {
+        dispatch_gesture(CH3_GESTURE_CLICKS);
+    }
 }
 
 
 // ****************************************************************************
 void process_ch3_clicks(void)
 {
+    bool new_ch3_data;
+
     global_flags.gear_changed = 0;
+    global_flags.ch3_gesture_event = 0;
 
     if (global_flags.systick) {
         if (ch3_click_counter) {
             --ch3_click_counter;
         }
+        if (ch3_pressed  &&  ch3_press_time < UINT16_MAX) {
+            ++ch3_press_time;
+        }
     }
 
     // Support for CH3 being a button or switch directly connected to the
     // light controller. Steering and Throttle are still being read from either
     // the servo reader or the uart reader.
-
-    // FIXME: it would be great if this would trigger new_channel_data
-    // independently of the other signals, i.e. set it if no other
-    // new_channel_data was seen in a certain amount of systicks
+    // The switch is processed as soon as it has settled, and every systick
+    // for the click timeout, independent of the servo frames.
     if (config.flags.ch3_is_local_switch) {
-        channel[CH3].normalized = GPIO_CH3 ? -100 : 100;
+        new_ch3_data = read_local_switch()  ||  global_flags.systick;
+    }
+    else {
+        new_ch3_data = global_flags.new_channel_data;
     }
 
     if (global_flags.initializing) {
         ch3_flags.initialized = false;
     }
 
-    if (!global_flags.new_channel_data) {
+    if (!new_ch3_data) {
         return;
     }
 
@@ -199,11 +483,14 @@ void process_ch3_clicks(void)
             if (!ch3_flags.transitioned) {
                 // No: Register transition and add click
                 ch3_flags.transitioned = true;
-                add_click();
+                press();
             }
         }
         else {
-            ch3_flags.transitioned = false;
+            if (ch3_flags.transitioned) {
+                ch3_flags.transitioned = false;
+                release();
+            }
         }
     }
     else {
@@ -8,7 +8,7 @@ const LIGHT_CONTROLLER_CONFIG_T config = {
     .magic = {
         .magic_value = ROM_MAGIC,
         .type = CONFIG_SECTION,
-        .version = CONFIG_VERSION
+        .version = CONFIG_SECTION_VERSION
     },
 
     .firmware_version = 5,
@@ -33,6 +33,10 @@ const LIGHT_CONTROLLER_CONFIG_T config = {
 
         .auto_brake_lights_forward_enabled = true,
         .auto_brake_lights_reverse_enabled = true,
+
+        .slave_protocol_v2 = false,
+        .preprocessor_protocol_v2 = false,
+        .servo_reader_low_latency = false,
     },
 
     .auto_brake_counter_value_forward_min = (500 / __SYSTICK_IN_MS),
@@ -71,6 +75,18 @@ const LIGHT_CONTROLLER_CONFIG_T config = {
     .servo_pulse_max = 2500,
 
     .startup_time = (2000 / __SYSTICK_IN_MS),
+
+    .render_rate = 100,
+
+    .slave_baudrate = 0,
+
+    .servo_filter = 0,
+    .brake_prediction = {
+        [ESC_FORWARD_BRAKE_REVERSE_TIMEOUT] = 2,
+        [ESC_FORWARD_BRAKE_REVERSE] = 2,
+        [ESC_FORWARD_REVERSE] = 0,
+        [ESC_FORWARD_BRAKE] = 2
+    },
 };
 
 
@@ -103,3 +119,29 @@ const GAMMA_TABLE_T gamma_table = {
         248, 250, 251, 253, 255
     }
 };
+
+
+// ****************************************************************************
+// Actions invoked by CH3, see ch3_handler.c
+const CH3_GESTURES_T ch3_gestures = {
+    .magic = {
+        .magic_value = ROM_MAGIC,
+        .type = CH3_GESTURES,
+        .version = CONFIG_VERSION
+    },
+
+    .number_of_gestures = 8,
+    .long_press_time = (600 / __SYSTICK_IN_MS),
+    .hold_time = (1500 / __SYSTICK_IN_MS),
+
+    .gesture = {
+        {CH3_GESTURE_CLICKS, 1, CH3_ACTION_LIGHT_SWITCH_UP, 0},
+        {CH3_GESTURE_CLICKS, 2, CH3_ACTION_LIGHT_SWITCH_DOWN, 0},
+        {CH3_GESTURE_CLICKS, 3, CH3_ACTION_TOGGLE_LIGHT_SWITCH, 0},
+        {CH3_GESTURE_CLICKS, 4, CH3_ACTION_HAZARD, 0},
+        {CH3_GESTURE_CLICKS, 5, CH3_ACTION_WINCH, 0},
+        {CH3_GESTURE_CLICKS, 6, CH3_ACTION_NEXT_LIGHT_SEQUENCE, 0},
+        {CH3_GESTURE_CLICKS, 7, CH3_ACTION_REVERSING_SETUP, 0},
+        {CH3_GESTURE_CLICKS, 8, CH3_ACTION_SERVO_OUTPUT_SETUP, 0},
+    }
+};
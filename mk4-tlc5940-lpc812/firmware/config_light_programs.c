@@ -8,7 +8,7 @@ const LIGHT_PROGRAMS_T light_programs = {
     .magic = {
         .magic_value = ROM_MAGIC,
         .type = LIGHT_PROGRAMS,
-        .version = CONFIG_VERSION
+        .version = 1
     },
 
     .number_of_programs = 4,
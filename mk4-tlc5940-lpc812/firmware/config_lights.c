@@ -6,7 +6,7 @@ const CAR_LIGHT_ARRAY_T local_leds = {
     .magic = {
         .magic_value = ROM_MAGIC,
         .type = LOCAL_LEDS,
-        .version = CONFIG_VERSION
+        .version = CAR_LIGHT_VERSION
     },
 
     .led_count = 16,
@@ -79,14 +79,56 @@ const CAR_LIGHT_ARRAY_T local_leds = {
 
 
 // ****************************************************************************
-const CAR_LIGHT_ARRAY_T slave_leds = {
-    .magic = {
-        .magic_value = ROM_MAGIC,
-        .type = SLAVE_LEDS,
-        .version = CONFIG_VERSION
+// One section per slave light controller in the daisy-chain
+const CAR_LIGHT_ARRAY_T slave_leds[MAX_SLAVES] = {
+    {
+        .magic = {
+            .magic_value = ROM_MAGIC,
+            .type = SLAVE_LEDS,
+            .version = CAR_LIGHT_VERSION
+        },
+
+        .led_count = 16,
+
+        .car_lights = (const CAR_LIGHT_T [16]) {{.always_on = 0}}
     },
+#if MAX_SLAVES >= 2
+    {
+        .magic = {
+            .magic_value = ROM_MAGIC,
+            .type = SLAVE_LEDS_2,
+            .version = CAR_LIGHT_VERSION
+        },
 
-    .led_count = 16,
+        .led_count = 16,
+
+        .car_lights = (const CAR_LIGHT_T [16]) {{.always_on = 0}}
+    },
+#endif
+#if MAX_SLAVES >= 3
+    {
+        .magic = {
+            .magic_value = ROM_MAGIC,
+            .type = SLAVE_LEDS_3,
+            .version = CAR_LIGHT_VERSION
+        },
+
+        .led_count = 16,
+
+        .car_lights = (const CAR_LIGHT_T [16]) {{.always_on = 0}}
+    },
+#endif
+#if MAX_SLAVES >= 4
+    {
+        .magic = {
+            .magic_value = ROM_MAGIC,
+            .type = SLAVE_LEDS_4,
+            .version = CAR_LIGHT_VERSION
+        },
 
-    .car_lights = (const CAR_LIGHT_T [16]) {{.always_on = 0}}
+        .led_count = 16,
+
+        .car_lights = (const CAR_LIGHT_T [16]) {{.always_on = 0}}
+    },
+#endif
 };
@@ -12,6 +12,34 @@
     Brake -> Neutral: brake = 0, brake_armed = 0
     Reverse -> Neutral: brake = 1 for 2 seconds
 
+    Predictive braking:
+    The throttle rate (change of throttle per frame) is estimated with an
+    exponential filter in fixed point (THROTTLE_RATE_FRACTION_BITS). While
+    driving forward the throttle is extrapolated by
+    config.brake_prediction[esc_mode] frames (0 = off). If the throttle
+    falls at least BRAKE_PREDICTION_MIN_RATE per frame and the extrapolated
+    throttle reaches the brake zone (or neutral if the brake lights turn on
+    automatically when going from forward to neutral) the brake lights are
+    turned on right away instead of when the throttle gets there.
+
+    While the throttle is still forward a predicted brake ends as soon as
+    the throttle stops falling, i.e. the rate rises above
+    -BRAKE_PREDICTION_REST_RATE (e.g. a partial release from 80% to 20%), or
+    if the throttle has not left the forward range within the predicted
+    frames plus BRAKE_PREDICTION_MARGIN throttle samples. In neutral it ends
+    once the throttle falls slower than BRAKE_PREDICTION_MIN_RATE; in the
+    brake or reverse range the ESC simulation takes over. The brake_armed
+    logic of the ESC simulation is not affected.
+    A new prediction needs a rate of BRAKE_PREDICTION_MIN_RATE again, so
+    jitter that moves the filtered rate by less than the gap between the two
+    rates can end a prediction early, but not turn it on and off repeatedly.
+    Jitter in the order of BRAKE_PREDICTION_MIN_RATE per frame can make the
+    brake lights flicker; config.servo_filter removes it if enabled.
+
+    The rate is only updated when a new throttle sample arrived
+    (global_flags.new_throttle_data), as in low-latency mode
+    new_channel_data is also set for steering and CH3 pulses.
+
 ******************************************************************************/
 #include <stdint.h>
 #include <stdbool.h>
@@ -20,23 +48,118 @@
 #include <utils.h>
 
 
+#define THROTTLE_RATE_FRACTION_BITS 4
+
+// 2 % per frame in normalized_fine units (0.2 %)
+#define BRAKE_PREDICTION_MIN_RATE (10 << THROTTLE_RATE_FRACTION_BITS)
+
+// Below 0.4 % per frame the throttle is considered to be at rest
+#define BRAKE_PREDICTION_REST_RATE (2 << THROTTLE_RATE_FRACTION_BITS)
+
+// Frames a predicted brake may last longer than predicted
+#define BRAKE_PREDICTION_MARGIN 5
+
+
 static uint16_t throttle_threshold = 0xffff;    // Signify uninitialized value
 static uint16_t brake_disarm_counter;
 static uint16_t auto_brake_counter;
 static uint16_t auto_reverse_counter;
+static int16_t last_throttle;
+static int16_t throttle_rate;           // normalized_fine per frame, fixed point
+static uint16_t brake_prediction_timer; // Throttle frames until a prediction ends
 
 static struct {
     unsigned int brake_disarm : 1;
     unsigned int auto_brake : 1;
     unsigned int auto_reverse : 1;
     unsigned int brake_armed : 1;
+    unsigned int brake_predicted : 1;
 } drive_mode;
 
 
+// ****************************************************************************
+static void update_throttle_rate(void)
+{
+    int16_t delta;
+
+    delta = (channel[TH].normalized_fine - last_throttle) *
+        (1 << THROTTLE_RATE_FRACTION_BITS);
+    last_throttle = channel[TH].normalized_fine;
+
+    // Exponential filter with weight 3/4, so the rate can follow the
+    // throttle closely. Jitter is left to config.servo_filter.
+    throttle_rate += ((delta - throttle_rate) * 3) / 4;
+}
+
+
+// ****************************************************************************
+// Returns true if the brake lights should be on while the throttle is still
+// in the forward range
+// ****************************************************************************
+static bool predict_braking(void)
+{
+    uint8_t frames = config.brake_prediction[config.esc_mode];
+    int32_t predicted;
+    int16_t target;
+
+    if (frames == 0) {
+        drive_mode.brake_predicted = false;
+        return false;
+    }
+
+    if (drive_mode.brake_predicted) {
+        if (global_flags.new_throttle_data  &&  brake_prediction_timer) {
+            --brake_prediction_timer;
+        }
+
+        if (throttle_rate > -BRAKE_PREDICTION_REST_RATE  ||
+                brake_prediction_timer == 0) {
+            drive_mode.brake_predicted = false;
+        }
+        return drive_mode.brake_predicted;
+    }
+
+    if (throttle_rate > -BRAKE_PREDICTION_MIN_RATE) {
+        return false;
+    }
+
+    if (config.flags.auto_brake_lights_forward_enabled) {
+        // Neutral, see throttle_not_neutral()
+        target = config.centre_threshold_low * 5;
+    }
+    else if (config.esc_mode != ESC_FORWARD_REVERSE) {
+        // Brake, see throttle_neutral()
+        target = -(int16_t)config.centre_threshold_high * 5;
+    }
+    else {
+        return false;
+    }
+
+    predicted = channel[TH].normalized_fine +
+        ((throttle_rate * frames) / (1 << THROTTLE_RATE_FRACTION_BITS));
+    if (predicted < target) {
+        drive_mode.brake_predicted = true;
+        brake_prediction_timer = frames + BRAKE_PREDICTION_MARGIN;
+    }
+
+    return drive_mode.brake_predicted;
+}
+
+
 // ****************************************************************************
 static void throttle_neutral(void)
 {
     throttle_threshold = config.centre_threshold_high;
+
+    // A predicted brake ends when the throttle comes to rest in neutral
+    if (drive_mode.brake_predicted  &&
+            throttle_rate > -BRAKE_PREDICTION_MIN_RATE) {
+        drive_mode.brake_predicted = false;
+        if (!drive_mode.auto_brake) {
+            global_flags.braking = false;
+        }
+    }
+
     if (global_flags.forward) {
         global_flags.forward = false;
 
@@ -74,7 +197,7 @@ static void throttle_neutral(void)
         }
     }
     else if (global_flags.braking) {
-        if (!drive_mode.auto_brake) {
+        if (!drive_mode.auto_brake  &&  !drive_mode.brake_predicted) {
             drive_mode.brake_armed = false;
             global_flags.braking = false;
         }
@@ -85,6 +208,8 @@ static void throttle_neutral(void)
 // ****************************************************************************
 static void throttle_brake_or_reverse(void)
 {
+    drive_mode.brake_predicted = false;
+
     if (config.esc_mode == ESC_FORWARD_BRAKE  ||  drive_mode.brake_armed) {
         global_flags.braking = true;
         global_flags.forward = false;
@@ -112,7 +237,7 @@ static void throttle_not_neutral(void)
     else {
         global_flags.forward = true;
         global_flags.reversing = false;
-        global_flags.braking = false;
+        global_flags.braking = predict_braking();
         if (config.esc_mode != ESC_FORWARD_REVERSE) {
            drive_mode.brake_armed = true;
         }
@@ -155,6 +280,10 @@ void process_drive_mode(void)
         throttle_threshold = config.centre_threshold_high;
     }
 
+    if (global_flags.new_throttle_data) {
+        update_throttle_rate();
+    }
+
     if (channel[TH].absolute < throttle_threshold) {
         // We are in neutral
         throttle_neutral();
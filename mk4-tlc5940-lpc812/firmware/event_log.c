@@ -0,0 +1,171 @@
+/******************************************************************************
+
+    Binary event log
+
+    Diagnostic events are recorded as compact binary entries (event id,
+    argument and a timestamp in systicks) in a RAM ring instead of being
+    printed as text where they happen. This way diagnostics never add latency
+    to the control loop.
+
+    The ring is drained one entry per main loop, and only while the UART link
+    is idle. Each entry is sent as a 9 byte frame:
+
+        EVENT_LOG_MAGIC_BYTE
+        event id
+        timestamp (uint16_t, little endian, systicks)
+        argument (uint32_t, little endian)
+        checksum (sum of the 7 bytes following the magic byte, modulo 256)
+
+    Since the magic byte is >= 0x80 the frames can be separated from any
+    ASCII text on the same link. tools/decode_event_log.py decodes the frames.
+
+    If the ring overflows new events are discarded and an EVENT_LOG_LOST
+    entry with the number of discarded events is logged once space is
+    available again.
+
+    Once per second the statistics of the UART transmit ring are logged as
+    EVENT_UART_TRANSMIT_STATISTICS:
+
+        bits 31..16: characters dropped in the last second
+        bits 15..0:  highest fill level of the transmit ring since startup
+
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <globals.h>
+#include <uart0.h>
+#include <event_log.h>
+
+
+#define EVENT_LOG_MAGIC_BYTE ((uint8_t)0xe5)
+
+#define EVENT_LOG_SIZE (16)             // Must be modulo 2 for speed
+#define EVENT_LOG_INDEX_MASK (EVENT_LOG_SIZE - 1)
+
+#define STATISTICS_INTERVAL (1000 / __SYSTICK_IN_MS)
+
+
+typedef struct {
+    uint32_t arg;
+    uint16_t timestamp;
+    uint8_t id;
+} EVENT_T;
+
+
+static EVENT_T event_log[EVENT_LOG_SIZE];
+static uint8_t read_index = 0;
+static uint8_t write_index = 0;
+static uint16_t events_lost = 0;
+static uint16_t timestamp = 0;
+
+
+// ****************************************************************************
+static bool add_event(EVENT_ID_T id, uint32_t arg)
+{
+    uint8_t next;
+
+    next = (write_index + 1) & EVENT_LOG_INDEX_MASK;
+    if (next == read_index) {
+        return false;
+    }
+
+    event_log[write_index].id = id;
+    event_log[write_index].arg = arg;
+    event_log[write_index].timestamp = timestamp;
+    write_index = next;
+
+    return true;
+}
+
+
+// ****************************************************************************
+void log_event(EVENT_ID_T id, uint32_t arg)
+{
+    if (!diagnostics_enabled()) {
+        return;
+    }
+
+    if (!add_event(id, arg)) {
+        ++events_lost;
+    }
+}
+
+
+// ****************************************************************************
+static void send_event(const EVENT_T *e)
+{
+    uint8_t payload[7];
+    uint8_t checksum = 0;
+    int i;
+
+    payload[0] = e->id;
+    payload[1] = e->timestamp & 0xff;
+    payload[2] = e->timestamp >> 8;
+    payload[3] = e->arg & 0xff;
+    payload[4] = (e->arg >> 8) & 0xff;
+    payload[5] = (e->arg >> 16) & 0xff;
+    payload[6] = e->arg >> 24;
+
+    uart0_send_char(EVENT_LOG_MAGIC_BYTE);
+    for (i = 0; i < 7; i++) {
+        checksum += payload[i];
+        uart0_send_char(payload[i]);
+    }
+    uart0_send_char(checksum);
+}
+
+
+// ****************************************************************************
+static void report_uart_statistics(void)
+{
+    static uint8_t systicks = 0;
+    static uint16_t dropped = 0;
+    uint16_t total_dropped;
+
+    if (++systicks < STATISTICS_INTERVAL) {
+        return;
+    }
+    systicks = 0;
+
+    total_dropped = uart0_send_dropped();
+
+    log_event(EVENT_UART_TRANSMIT_STATISTICS,
+        ((uint32_t)(uint16_t)(total_dropped - dropped) << 16) |
+        uart0_send_high_watermark());
+
+    dropped = total_dropped;
+}
+
+
+// ****************************************************************************
+void process_event_log(void)
+{
+    if (global_flags.systick) {
+        ++timestamp;
+        report_uart_statistics();
+    }
+
+    if (!diagnostics_enabled()) {
+        return;
+    }
+
+    if (events_lost) {
+        if (add_event(EVENT_LOG_LOST, events_lost)) {
+            events_lost = 0;
+        }
+    }
+
+    if (read_index == write_index) {
+        return;
+    }
+
+    // Only send when nothing else is being transmitted so that the event log
+    // never delays other output
+    if (!uart0_send_is_ready()) {
+        return;
+    }
+
+    send_event(&event_log[read_index]);
+    read_index = (read_index + 1) & EVENT_LOG_INDEX_MASK;
+}
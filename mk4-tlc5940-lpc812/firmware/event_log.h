@@ -0,0 +1,38 @@
+#ifndef __EVENT_LOG_H
+#define __EVENT_LOG_H
+
+#include <stdint.h>
+
+// Event identifiers. Keep in sync with tools/decode_event_log.py
+typedef enum {
+    EVENT_LOG_LOST = 0x01,                  // arg: number of events lost
+    EVENT_INITIALIZED = 0x02,
+    EVENT_STACK = 0x03,                     // arg: lowest stack address used
+    EVENT_CHANNELS = 0x04,                  // arg: ST << 16 | TH (int16 each)
+    EVENT_UART_OVERRUN = 0x10,
+    EVENT_UART_FRAME_ERROR = 0x11,
+    EVENT_UART_NOISE = 0x12,
+    EVENT_UART_RECEIVE_OVERFLOW = 0x13,     // arg: number of bytes lost
+    EVENT_UART_TRANSMIT_STATISTICS = 0x14,  // arg: see event_log.c
+    EVENT_CH3_ADD_CLICK = 0x20,
+    EVENT_CH3_CLICK_TIMEOUT = 0x21,         // arg: number of clicks
+    EVENT_CH3_GESTURE = 0x22,               // arg: CH3_GESTURE_TYPE_T << 8 | clicks
+    EVENT_LIGHT_SWITCH_POSITION = 0x30,     // arg: new position
+    EVENT_RENDER_STATISTICS = 0x31,         // arg: see lights.c
+    EVENT_UNKNOWN_PARAMETER_TYPE = 0x40,    // arg: parameter type
+    EVENT_UNKNOWN_OPCODE = 0x41,            // arg: opcode
+    EVENT_SLAVE_CRC_ERROR = 0x50,           // arg: sequence number, or 0x8a for a state frame
+    EVENT_SLAVE_SEQUENCE_ERROR = 0x51,      // arg: sequence number
+    EVENT_PREPROCESSOR_CRC_ERROR = 0x60,    // arg: sequence number
+    EVENT_PREPROCESSOR_SEQUENCE_ERROR = 0x61,   // arg: sequence number
+    EVENT_PREPROCESSOR_STATISTICS = 0x62,   // arg: see uart_reader.c
+    EVENT_SCT_IRQ_STATISTICS = 0x70,        // arg: see servo_reader.c
+    EVENT_SERVO_QUALITY = 0x71,             // arg: see servo_reader.c
+    EVENT_INPUT_MODE_DETECTED = 0x80,       // arg: MASTER_MODE_T
+    EVENT_FLASH_ERROR = 0x90                // arg: IAP command << 8 | status
+} EVENT_ID_T;
+
+void log_event(EVENT_ID_T id, uint32_t arg);
+void process_event_log(void);
+
+#endif // __EVENT_LOG_H
@@ -5,8 +5,15 @@
 #include <stdbool.h>
 
 #define CONFIG_VERSION 1
+#define CONFIG_SECTION_VERSION 5
+#define CAR_LIGHT_VERSION 2
 #define __SYSTICK_IN_MS 20
 
+// Render rates of the LED fade and output stage in Hz. Rates above
+// __SYSTICK_RATE are driven by the MRT, independent of the systick.
+#define __SYSTICK_RATE (1000 / __SYSTICK_IN_MS)
+#define RENDER_RATE_MAX 200
+
 
 // Suppress unused parameter or variable warning
 #ifndef UNUSED
@@ -26,7 +33,7 @@
 // PIO0_6   (15)                TLC5940 BLANK
 // PIO0_7   (14)                TLC5940 SIN
 // PIO0_8   (11, XTALIN)        NC
-// PIO0_9   (10, XTALOUT)       Switched light output (for driving a load via a MOSFET)
+// PIO0_9   (10, XTALOUT)       Switched light output (for driving a load via a MOSFET), PWM on CTOUT_2
 // PIO0_10  (8,  Open drain)    NC
 // PIO0_11  (7,  Open drain)    NC
 // PIO0_12  (2,  ISP-entry)     OUT / ISP
@@ -68,6 +75,11 @@
 #define TH 1
 #define CH3 2
 
+// The CPPM reader decodes up to CPPM_MAX_CHANNELS channels. CH4 and up are
+// stored in extra_channel[] and are available to light programs only.
+#define CPPM_MAX_CHANNELS 8
+#define EXTRA_CHANNELS (CPPM_MAX_CHANNELS - 3)
+
 // Number of positions of our virtual light switch. Includes the "off"
 // position 0.
 // NOTE: if you change this value you need to adjust CAR_LIGHT_FUNCTION_T
@@ -169,13 +181,59 @@
 #define PARAMETER_TYPE_STEERING 3
 #define PARAMETER_TYPE_THROTTLE 4
 #define PARAMETER_TYPE_GEAR 5
+#define PARAMETER_TYPE_CHANNEL 6        // id: channel number 4..8
+
+
+// Number of slave light controllers the master drives. With more than one
+// slave the slaves are daisy-chained and addressed; see lights.c.
+// Build with e.g. -DMAX_SLAVES=4; every slave adds a slave LED section.
+#ifndef MAX_SLAVES
+#define MAX_SLAVES 1
+#endif
+
+#if MAX_SLAVES < 1  ||  MAX_SLAVES > 4
+#error MAX_SLAVES must be between 1 and 4
+#endif
+
+// Number of LEDs: 16 lights locally, another 16 per slave.
+// Can be overridden at build time (-DMAX_LIGHTS=64) for setups with more
+// slave LEDs.
+#ifndef MAX_LIGHTS
+#define MAX_LIGHTS (16 * (1 + MAX_SLAVES))
+#endif
+
+#if MAX_LIGHTS < (16 * (1 + MAX_SLAVES))
+#error MAX_LIGHTS is too small for the number of slaves
+#endif
+
+// Set of LEDs, LED x is bit (x % 32) of word[x / 32]
+#define LED_BITSET_WORDS ((MAX_LIGHTS + 31) / 32)
+
+typedef struct {
+    uint32_t word[LED_BITSET_WORDS];
+} LED_BITSET_T;
+
+// With up to 32 LEDs the bitset is a plain uint32_t; don't waste cycles on
+// calculating the word index
+#if LED_BITSET_WORDS == 1
+#define LED_BITSET_IS_SET(s, x) ((s)->word[0] & (1u << (x)))
+#else
+#define LED_BITSET_IS_SET(s, x) ((s)->word[(x) >> 5] & (1u << ((x) & 31)))
+#endif
 
 
 // Offset of special position within every light program
+//
+// The light program header contains one 32-bit word of LEDs used per 32
+// LEDs, the opcodes start after the last one. The light program section
+// version is the number of these words: version 1 is the original format
+// with a single word (up to 32 LEDs). The firmware runs all versions up to
+// LED_BITSET_WORDS, so light programs assembled for fewer LEDs keep working.
 #define PRIORITY_STATE_OFFSET 0
 #define RUN_STATE_OFFSET 1
 #define LEDS_USED_OFFSET 2
-#define FIRST_OPCODE_OFFSET 3
+
+#define LIGHT_PROGRAMS_VERSION LED_BITSET_WORDS
 
 
 #define LED_USED(x) (1 << x)
@@ -212,6 +270,14 @@ typedef enum {
     RUN_WHEN_WINCH_IN                = (1 << 21),
     RUN_WHEN_WINCH_OUT               = (1 << 22),
 
+    // Run conditions only; not part of the car state (see
+    // CAR_STATE_SERVO_OUTPUT_SETUP_CENTRE and up)
+    RUN_WHEN_CH4                     = (1 << 23),
+    RUN_WHEN_CH5                     = (1 << 24),
+    RUN_WHEN_CH6                     = (1 << 25),
+    RUN_WHEN_CH7                     = (1 << 26),
+    RUN_WHEN_CH8                     = (1 << 27),
+
     RUN_ALWAYS                       = (1 << 31)
 } LIGHT_PROGRAM_RUN_STATE_T;
 
@@ -227,6 +293,10 @@ typedef enum {
     RUN_WHEN_REVERSING_SETUP_STEERING   = (1 << 5),
     RUN_WHEN_REVERSING_SETUP_THROTTLE   = (1 << 6),
     RUN_WHEN_GEAR_CHANGED               = (1 << 7),
+    RUN_WHEN_CH3_GESTURE_1              = (1 << 8),     // Bits 8..11
+    RUN_WHEN_CH3_GESTURE_2              = (1 << 9),
+    RUN_WHEN_CH3_GESTURE_3              = (1 << 10),
+    RUN_WHEN_CH3_GESTURE_4              = (1 << 11),
 } LIGHT_PROGRAM_PRIORITY_STATE_T;
 
 
@@ -279,7 +349,11 @@ typedef enum {
     GAMMA_TABLE = 0x02,
     LOCAL_LEDS = 0x10,
     SLAVE_LEDS = 0x20,
-    LIGHT_PROGRAMS = 0x30
+    SLAVE_LEDS_2 = 0x21,
+    SLAVE_LEDS_3 = 0x22,
+    SLAVE_LEDS_4 = 0x23,
+    LIGHT_PROGRAMS = 0x30,
+    CH3_GESTURES = 0x40
 } ROM_SECTION_T;
 
 
@@ -307,6 +381,46 @@ typedef struct {
     uint32_t programs[80];
 } LIGHT_PROGRAMS_T;
 
+// ****************************************************************************
+// CH3 gestures, see ch3_handler.c
+typedef enum {
+    CH3_GESTURE_CLICKS,         // Clicks, or presses of a momentary button
+    CH3_GESTURE_LONG_PRESS,     // Last press held for long_press_time
+    CH3_GESTURE_HOLD            // Last press still held after hold_time
+} CH3_GESTURE_TYPE_T;
+
+typedef enum {
+    CH3_ACTION_NONE,
+    CH3_ACTION_LIGHT_SWITCH_UP,         // Gear 1 / up with the gearbox servo
+    CH3_ACTION_LIGHT_SWITCH_DOWN,       // Gear 2 / down with the gearbox servo
+    CH3_ACTION_TOGGLE_LIGHT_SWITCH,
+    CH3_ACTION_HAZARD,
+    CH3_ACTION_WINCH,
+    CH3_ACTION_NEXT_LIGHT_SEQUENCE,
+    CH3_ACTION_REVERSING_SETUP,
+    CH3_ACTION_SERVO_OUTPUT_SETUP,
+    CH3_ACTION_LIGHT_PROGRAM_EVENT      // parameter: 1..CH3_GESTURE_EVENTS
+} CH3_ACTION_T;
+
+#define MAX_CH3_GESTURES 16
+#define CH3_GESTURE_EVENTS 4
+
+typedef struct {
+    uint8_t type;           // CH3_GESTURE_TYPE_T
+    uint8_t clicks;         // Number of presses including the long one
+    uint8_t action;         // CH3_ACTION_T
+    uint8_t parameter;
+} CH3_GESTURE_T;
+
+typedef struct {
+    MAGIC_T magic;
+    uint16_t number_of_gestures;
+    uint16_t long_press_time;       // systicks
+    uint16_t hold_time;             // systicks
+    CH3_GESTURE_T gesture[MAX_CH3_GESTURES];
+} CH3_GESTURES_T;
+
+
 // ****************************************************************************
 typedef struct {
     uint16_t left;
@@ -320,11 +434,26 @@ typedef struct {
     uint32_t raw_data;
     SERVO_ENDPOINTS_T endpoint;
     int16_t normalized;
+    int16_t normalized_fine;        // -500..0..500, i.e. 0.2 % resolution
     uint16_t absolute;
     bool reversed;
+
+    // Fixed-point reciprocals of the endpoint spans, see servo_reader.c
+    uint32_t reciprocal_left;
+    uint32_t reciprocal_right;
+    uint32_t reciprocal_left_fine;
+    uint32_t reciprocal_right_fine;
 } CHANNEL_T;
 
 
+// ****************************************************************************
+typedef struct {
+    uint16_t raw_data;      // Pulse in us, 0 if the channel is missing
+    int16_t normalized;     // -100..0..100 for 1000..1500..2000 us
+    bool active;            // Switch position for the RUN_WHEN_CH4.. conditions
+} EXTRA_CHANNEL_T;
+
+
 // ****************************************************************************
 typedef enum {
     GEAR_1 = 1,
@@ -362,10 +491,13 @@ typedef enum {
 // ****************************************************************************
 typedef struct {
     unsigned int systick : 1;               // Set for one mainloop every 20 ms
+    unsigned int render : 1;                // Set for one mainloop every render period (5, 10 or 20 ms)
     unsigned int new_channel_data : 1;      // Set for one mainloop every time servo pulses were received
+    unsigned int new_throttle_data : 1;     // Set with new_channel_data if it includes a new TH pulse
 
     unsigned int no_signal : 1;
     unsigned int initializing : 1;
+    unsigned int calibrated : 1;            // Channel endpoints hold a calibration (sampled or from persistent storage)
     unsigned int servo_output_setup : 3;
     unsigned int reversing_setup : 2;
 
@@ -378,6 +510,7 @@ typedef struct {
     unsigned int reversing : 1;             // Set when the car is reversing
 
     unsigned int gear_changed : 1;          // Set for one mainloop when a new gear was selected
+    unsigned int ch3_gesture_event : 3;     // 1..CH3_GESTURE_EVENTS for one mainloop when a gesture triggers a light program event
     unsigned int gear : 2;
 
     unsigned int winch_mode : 3;
@@ -390,6 +523,9 @@ typedef enum {
     MASTER_WITH_UART_READER,
     MASTER_WITH_CPPM_READER,
     SLAVE,
+    MASTER_WITH_SBUS_READER,
+    MASTER_WITH_IBUS_READER,
+    MASTER_WITH_AUTO_DETECT,
 } MASTER_MODE_T;
 
 
@@ -425,6 +561,13 @@ typedef struct {
         // there can be one UART output (slave, preprocessor or winch) and one
         // servo output (steering wheel or gearbox servo; or switched light
         // output)
+        // MASTER_WITH_SBUS_READER and MASTER_WITH_IBUS_READER are like
+        // MASTER_WITH_UART_READER, but the UART runs at the fixed baudrate
+        // and format of the receiver protocol (SBUS: 100000 8e2, iBUS:
+        // 115200 8n1).
+        // MASTER_WITH_AUTO_DETECT determines one of the master modes from the
+        // signal on the ST and TH pins at boot, see auto_detect.c. The
+        // output flags follow the rules of MASTER_WITH_SERVO_READER.
         unsigned int slave_output : 1;
         unsigned int preprocessor_output : 1;
         unsigned int winch_output : 1;
@@ -437,6 +580,28 @@ typedef struct {
 
         unsigned int auto_brake_lights_forward_enabled : 1;
         unsigned int auto_brake_lights_reverse_enabled : 1;
+
+        // Use the slave protocol v2 (delta frames with CRC) on the slave
+        // output. Slaves always accept both v1 and v2.
+        unsigned int slave_protocol_v2 : 1;
+
+        // In SLAVE mode: forward addressed frames for other slaves on the
+        // UART TX pin to the next slave in the daisy-chain
+        unsigned int slave_pass_through : 1;
+
+        // MASTER: send the car state to the slaves instead of LED values.
+        // SLAVE: run the car lights and light programs locally from the
+        // received car state.
+        unsigned int distributed_rendering : 1;
+
+        // Use the preprocessor protocol v2 (full resolution channels, with
+        // CRC) on the preprocessor output. The UART reader always accepts
+        // both v1 and v2.
+        unsigned int preprocessor_protocol_v2 : 1;
+
+        // MASTER_WITH_SERVO_READER: publish each channel on its falling edge
+        // instead of once per frame
+        unsigned int servo_reader_low_latency : 1;
     } flags;
 
     uint16_t auto_brake_counter_value_forward_min;
@@ -477,6 +642,25 @@ typedef struct {
     uint16_t servo_pulse_max;
 
     uint16_t startup_time;
+
+    // Rate in Hz at which the fade and output stage of the lights runs.
+    // 50 (or 0) renders on the systick, 100 and 200 use the MRT. Other
+    // values are rounded down to one of these, see get_render_rate().
+    uint16_t render_rate;
+
+    // Baudrate of the link between master and slave light controllers.
+    // 0 means config.baudrate is used. See uart0.c for supported values.
+    uint32_t slave_baudrate;
+
+    // Filter applied to the servo pulses before normalization. 0: off,
+    // 1: median of 3, 2..4: median of 3 followed by an exponential filter
+    // of increasing strength. See servo_reader.c.
+    uint16_t servo_filter;
+
+    // Number of frames the throttle is extrapolated ahead to turn the brake
+    // lights on early, per ESC_MODE_T. 0 turns the prediction off. See
+    // drive_mode.c.
+    uint8_t brake_prediction[4];
 } LIGHT_CONTROLLER_CONFIG_T;
 
 
@@ -485,8 +669,8 @@ typedef struct {
 
 typedef uint8_t LED_T;
 
-typedef struct {    // 4-bytes packed (2 bits free)
-    // Simulation of incandescent lights
+typedef struct {    // 8-bytes packed (2 bits, 2 bytes free)
+    // Simulation of incandescent lights (linear ramp, legacy)
     uint8_t max_change_per_systick;
 
     // Simulation of a weak ground connection
@@ -505,6 +689,11 @@ typedef struct {    // 4-bytes packed (2 bits free)
     unsigned int reversing_light : 1;
     unsigned int indicator_left : 1;
     unsigned int indicator_right : 1;
+
+    // Simulation of incandescent lights: time constant in milliseconds of a
+    // first-order filter. If non-zero it takes precedence over
+    // max_change_per_systick.
+    uint16_t incandescent_ms;
 } LIGHT_FEATURE_T;
 
 // For standard car light functions we have an array of values, one per LED,
@@ -512,7 +701,7 @@ typedef struct {    // 4-bytes packed (2 bits free)
 // multiple functions to a single LED (such as brake and tail light function)
 // and the software will "mix" the final color value.
 
-typedef struct {    // 20-bytes packed (1 byte free)
+typedef struct {    // 24-bytes packed (1 byte free)
     LIGHT_FEATURE_T features;
 
     LED_T always_on;
@@ -542,12 +731,18 @@ extern uint32_t entropy;
 
 extern const LIGHT_CONTROLLER_CONFIG_T config;
 extern const CAR_LIGHT_ARRAY_T local_leds;
-extern const CAR_LIGHT_ARRAY_T slave_leds;
+extern const CAR_LIGHT_ARRAY_T slave_leds[MAX_SLAVES];
 extern const GAMMA_TABLE_T gamma_table;
 extern const LIGHT_PROGRAMS_T light_programs;
+extern const CH3_GESTURES_T ch3_gestures;
 
 extern GLOBAL_FLAGS_T global_flags;
+
+// The mode the light controller runs in. Equal to config.mode, except for
+// MASTER_WITH_AUTO_DETECT where it is the detected master mode.
+extern MASTER_MODE_T operating_mode;
 extern CHANNEL_T channel[3];
+extern EXTRA_CHANNEL_T extra_channel[EXTRA_CHANNELS];
 extern SERVO_ENDPOINTS_T servo_output_endpoint;
 
 
@@ -556,18 +751,29 @@ extern SERVO_ENDPOINTS_T servo_output_endpoint;
 void SysTick_handler(void);
 
 bool diagnostics_enabled(void);
+uint16_t get_render_rate(void);
+void restart_render_tick(void);
+
+void detect_input_mode(void);
 
 void load_persistent_storage(void);
+void load_persistent_calibration(void);
 void write_persistent_storage(void);
 
 void init_servo_reader(void);
 void read_all_servo_channels(void);
+void publish_servo_pulses(const uint16_t pulse[3]);
 void SCT_irq_handler(void);
 
+void init_serial_receiver(void);
+void read_serial_receiver(void);
+
 void init_uart_reader(void);
 void read_preprocessor(void);
 
+void init_ch3_local_switch(void);
 void process_ch3_clicks(void);
+void PININT0_irq_handler(void);
 
 void process_drive_mode(void);
 
@@ -575,12 +781,14 @@ void process_indicators(void);
 void toggle_hazard_lights(void);
 
 void init_servo_output(void);
+void update_servo_output_scale(void);
 void process_servo_output(void);
 void servo_output_setup_action(uint8_t ch3_clicks);
 void gearbox_action(uint8_t ch3_clicks);
 
 void process_winch(void);
 void winch_action(uint8_t ch3_clicks);
+void toggle_winch(void);
 bool abort_winching(void);
 
 void process_channel_reversing_setup(void);
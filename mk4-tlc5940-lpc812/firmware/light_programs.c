@@ -70,6 +70,7 @@
         - Programs are active because of an event, or because of a match state
         - Program triggering events
             - Gearbox change event
+            - CH3 gesture events 1..4, see ch3_handler.c
             - There can only be one event active
             - New events stop currently running events
             - Event programs have priority over other programs regarding light use
@@ -98,7 +99,7 @@
 #include <stdbool.h>
 
 #include <globals.h>
-#include <uart0.h>
+#include <event_log.h>
 #include <utils.h>
 
 #define MAX_INSTRUCTIONS_PER_SYSTICK 30
@@ -120,15 +121,31 @@ static uint32_t priority_run_state;
 
 static int16_t var[MAX_LIGHT_PROGRAM_VARIABLES];
 
+// Number of light programs that are run. 0 if the program header format in
+// the light program section does not match the firmware.
+static int number_of_programs;
+
+// Number of LEDs-used words in the program header, given by the section
+// version. Always 1 when the firmware is built for up to 32 LEDs.
+#if LED_BITSET_WORDS == 1
+#define LEDS_USED_WORDS 1
+#else
+static int leds_used_words;
+#define LEDS_USED_WORDS leds_used_words
+#endif
+
+#define FIRST_OPCODE_OFFSET (LEDS_USED_OFFSET + LEDS_USED_WORDS)
+
 extern LED_T light_setpoint[];
 extern LED_T light_actual[];
 extern uint8_t max_change_per_systick[];
+extern uint16_t incandescent_alpha[];
 extern uint8_t light_switch_position;
 
 
 void init_light_programs(void);
 void process_light_program_events(void);
-uint32_t process_light_programs(void);
+void process_light_programs(LED_BITSET_T *leds_used);
 
 
 // ****************************************************************************
@@ -145,7 +162,20 @@ void init_light_programs(void)
 {
     int i;
 
-    for (i = 0; i < light_programs.number_of_programs; i++) {
+    number_of_programs = light_programs.number_of_programs;
+
+#if LED_BITSET_WORDS == 1
+    if (light_programs.magic.version != LIGHT_PROGRAMS_VERSION) {
+        number_of_programs = 0;
+    }
+#else
+    leds_used_words = light_programs.magic.version;
+    if (leds_used_words < 1  ||  leds_used_words > LIGHT_PROGRAMS_VERSION) {
+        number_of_programs = 0;
+    }
+#endif
+
+    for (i = 0; i < number_of_programs; i++) {
         reset_program(i);
     }
 }
@@ -161,6 +191,8 @@ void next_light_sequence(void)
 // ****************************************************************************
 static void load_light_program_environment(void)
 {
+    int i;
+
     priority_run_state = 0;
     if (global_flags.no_signal) {
         priority_run_state |= RUN_WHEN_NO_SIGNAL;
@@ -221,11 +253,22 @@ static void load_light_program_environment(void)
             run_state |= RUN_WHEN_BLINK_RIGHT;
         }
     }
+    // The servo reader clears the extra channels on the next main loop after
+    // the signal is lost; ignore them right away
+    if (!global_flags.no_signal) {
+        for (i = 0; i < EXTRA_CHANNELS; i++) {
+            if (extra_channel[i].active) {
+                run_state |= (RUN_WHEN_CH4 << i);
+            }
+        }
+    }
 
 
-    // car_state is run_state (minus run-always) plus some of the priority
-    // run conditions mixed in
-    car_state = run_state & ~RUN_ALWAYS;
+    // car_state is run_state (minus run-always and the extra channels, whose
+    // bits the car state uses otherwise) plus some of the priority run
+    // conditions mixed in
+    car_state = run_state & ~(RUN_ALWAYS | RUN_WHEN_CH4 | RUN_WHEN_CH5 |
+        RUN_WHEN_CH6 | RUN_WHEN_CH7 | RUN_WHEN_CH8);
     if (global_flags.servo_output_setup == SERVO_OUTPUT_SETUP_CENTRE) {
         car_state |= CAR_STATE_SERVO_OUTPUT_SETUP_CENTRE;
     }
@@ -273,6 +316,20 @@ static int16_t get_cmp1(uint32_t instruction)
 }
 
 
+// ****************************************************************************
+// CH4..CH8 are in extra_channel[]; other channel numbers, and all channels
+// while there is no signal, read as 0
+// ****************************************************************************
+static int16_t get_extra_channel_value(uint8_t channel_number)
+{
+    if (channel_number < 4  ||  channel_number > CPPM_MAX_CHANNELS  ||
+            global_flags.no_signal) {
+        return 0;
+    }
+    return extra_channel[channel_number - 4].normalized;
+}
+
+
 // ****************************************************************************
 static int16_t get_parameter_value(uint32_t instruction)
 {
@@ -304,13 +361,12 @@ static int16_t get_parameter_value(uint32_t instruction)
         case PARAMETER_TYPE_GEAR:
             return global_flags.gear;
 
+        case PARAMETER_TYPE_CHANNEL:
+            return get_extra_channel_value(instruction & 0xff);
+
         default:
 #ifndef NODEBUG
-            if (diagnostics_enabled()) {
-                uart0_send_cstring("UNKNOWN PARAMETER TYPE ");
-                uart0_send_uint32(type);
-                uart0_send_linefeed();
-            }
+            log_event(EVENT_UNKNOWN_PARAMETER_TYPE, type);
 #endif
             return 0;
     }
@@ -406,13 +462,16 @@ static uint8_t percent_to_uint8(int percentage)
 
 // ****************************************************************************
 static void execute_program(
-    const uint32_t *program, LIGHT_PROGRAM_CPU_T *c, uint32_t *leds_used)
+    const uint32_t *program, LIGHT_PROGRAM_CPU_T *c, LED_BITSET_T *leds_used)
 {
-    uint32_t leds_already_used;
+    LED_BITSET_T leds_already_used;
     int instructions_executed = 0;
+    int w;
 
     leds_already_used = *leds_used;
-    *leds_used |= *(program + LEDS_USED_OFFSET);
+    for (w = 0; w < LEDS_USED_WORDS; w++) {
+        leds_used->word[w] |= *(program + LEDS_USED_OFFSET + w);
+    }
 
     if (c->timer) {
         if (--c->timer) {
@@ -477,7 +536,7 @@ static void execute_program(
                 // fall through
             case OPCODE_SET_I:
                 for (i = min; i <= max; i++) {
-                    if ((leds_already_used & (1 << i)) == 0) {
+                    if (!LED_BITSET_IS_SET(&leds_already_used, i)) {
                         light_setpoint[i] = percent_to_uint8(value);
                     }
                 }
@@ -488,8 +547,9 @@ static void execute_program(
                 // fall through
             case OPCODE_FADE_I:
                 for (i = min; i <= max; i++) {
-                    if ((leds_already_used & (1 << i)) == 0) {
+                    if (!LED_BITSET_IS_SET(&leds_already_used, i)) {
                         max_change_per_systick[i] = percent_to_uint8(value);
+                        incandescent_alpha[i] = 0;
                     }
                 }
                 break;
@@ -567,11 +627,7 @@ static void execute_program(
 
             default:
 #ifndef NODEBUG
-                if (diagnostics_enabled()) {
-                    uart0_send_cstring("UNKNOWN OPCODE 0x");
-                    uart0_send_uint8_hex(opcode);
-                    uart0_send_linefeed();
-                }
+                log_event(EVENT_UNKNOWN_OPCODE, opcode);
 #endif
                 c->PC = program + FIRST_OPCODE_OFFSET;
                 c->event = 0;
@@ -581,30 +637,46 @@ static void execute_program(
 }
 
 
+// ****************************************************************************
+// Start the first program that runs on the given event
+// ****************************************************************************
+static void trigger_event(uint32_t event)
+{
+    int i;
+
+    for (i = 0; i < number_of_programs; i++) {
+        if (*(light_programs.start[i] + PRIORITY_STATE_OFFSET) & event) {
+            reset_program(i);
+            cpu[i].event = 1;
+            break;
+        }
+    }
+}
+
+
 // ****************************************************************************
 void process_light_program_events(void)
 {
     if (global_flags.gear_changed) {
-        int i;
-        for (i = 0; i < light_programs.number_of_programs; i++) {
-            if (*(light_programs.start[i] + PRIORITY_STATE_OFFSET)
-                & RUN_WHEN_GEAR_CHANGED) {
-                reset_program(i);
-                cpu[i].event = 1;
-                break;
-            }
-        }
+        trigger_event(RUN_WHEN_GEAR_CHANGED);
+    }
+
+    if (global_flags.ch3_gesture_event) {
+        trigger_event(RUN_WHEN_CH3_GESTURE_1 <<
+            (global_flags.ch3_gesture_event - 1));
     }
 }
 
 
 // ****************************************************************************
-uint32_t process_light_programs(void)
+void process_light_programs(LED_BITSET_T *leds_used)
 {
     int i;
-    uint32_t leds_used;
+    int w;
 
-    leds_used = 0;
+    for (w = 0; w < LED_BITSET_WORDS; w++) {
+        leds_used->word[w] = 0;
+    }
     load_light_program_environment();
 
     // Place the current light switch position into a global variable
@@ -612,15 +684,15 @@ uint32_t process_light_programs(void)
     var[GLOBAL_VAR_LIGHT_SWITCH_POSITION] = light_switch_position;
 
     // Run all programs that were triggered by an event
-    for (i = 0; i < light_programs.number_of_programs; i++) {
+    for (i = 0; i < number_of_programs; i++) {
         if (cpu[i].event) {
-            execute_program(light_programs.start[i], &cpu[i], &leds_used);
+            execute_program(light_programs.start[i], &cpu[i], leds_used);
             limit_light_switch_position_variable();
         }
     }
 
     // Run all priority programs where the light controller state matches
-    for (i = 0; i < light_programs.number_of_programs; i++) {
+    for (i = 0; i < number_of_programs; i++) {
         if (*(light_programs.start[i] + PRIORITY_STATE_OFFSET) == RUN_WHEN_NORMAL_OPERATION) {
             continue;
         }
@@ -631,7 +703,7 @@ uint32_t process_light_programs(void)
 
         if (*(light_programs.start[i] + PRIORITY_STATE_OFFSET) &
                 priority_run_state) {
-            execute_program(light_programs.start[i], &cpu[i], &leds_used);
+            execute_program(light_programs.start[i], &cpu[i], leds_used);
             limit_light_switch_position_variable();
         }
         else {
@@ -640,13 +712,13 @@ uint32_t process_light_programs(void)
     }
 
     // Run all non-event and non-priority programs
-    for (i = 0; i < light_programs.number_of_programs; i++) {
+    for (i = 0; i < number_of_programs; i++) {
         if (*(light_programs.start[i] + PRIORITY_STATE_OFFSET) != RUN_WHEN_NORMAL_OPERATION) {
             continue;
         }
 
         if (*(light_programs.start[i] + RUN_STATE_OFFSET) & run_state) {
-            execute_program(light_programs.start[i], &cpu[i], &leds_used);
+            execute_program(light_programs.start[i], &cpu[i], leds_used);
             limit_light_switch_position_variable();
         }
         else {
@@ -656,7 +728,5 @@ uint32_t process_light_programs(void)
 
     // Return the possibly modified value of light switch position
     light_switch_position = var[GLOBAL_VAR_LIGHT_SWITCH_POSITION];
-
-    return leds_used;
 }
 
@@ -63,6 +63,38 @@
         or half the max step size.) This should be automatically done in the
         firmware generator (max_steps_per_systick).
 
+        The linear ramp is tied to the systick: changing the systick changes
+        all fade timings. Therefore each LED can alternatively specify a time
+        constant in milliseconds (incandescent_ms), which drives a first-order
+        filter:
+
+            actual += (setpoint - actual) * alpha
+            alpha = dt / (tau + dt)
+
+        alpha is calculated once at startup as Q12 value from tau and the
+        period dt in which the filter runs, so at run-time the filter is a
+        single multiply and shift per LED. actual is kept as 8.8 fixed-point
+        value so that slow fades do not get stuck due to truncation.
+
+
+    Render rate:
+        The car logic (light programs, setpoints) runs on the 20 ms systick.
+        The fade and output stage -- filter, gamma, sending to the TLC5940 --
+        runs at the render rate, which can be configured to 100 or 200 Hz
+        (driven by the MRT) for smoother fades. dt of the filter is the render
+        period. The linear ramp still advances once per systick, so existing
+        max_change_per_systick values keep their timing.
+
+        To measure the CPU time the render rate costs, debug builds log
+        EVENT_RENDER_STATISTICS once per second:
+
+            bits 31..16: number of render passes in the last second
+            bits 15..0:  average CPU cycles per render pass
+
+        tools/decode_event_log.py converts these into the CPU load of the
+        render stage. The transfer to the TLC5940 alone, 16 x 6 bits at
+        2 MHz, blocks for 48 us (576 cycles at 12 MHz) per render pass.
+
 
     Weak ground connection:
         For each led be able to specify a flag indicating which car light
@@ -71,6 +103,92 @@
         left indicator, would set the left indicator flag only.
         There would also be a configurable brightness reduction value in %
 
+
+    Slave protocol:
+        v1: SLAVE_MAGIC_BYTE followed by the 6-bit values of all slave LEDs.
+
+        v2: only LEDs that changed since the previous frame are sent:
+
+            SLAVE_MAGIC_BYTE_V2
+            bit 6: keyframe; bits 5..0: sequence number
+            changed LEDs 0..6 (bit 0 = LED 0)
+            changed LEDs 7..13
+            changed LEDs 14..15
+            6-bit values of the changed LEDs, in ascending order
+            CRC-8 bits 7..4
+            CRC-8 bits 3..0
+
+        The CRC-8 covers all bytes between the magic byte and the CRC.
+        Every SLAVE_V2_KEYFRAME_INTERVAL frames a keyframe containing all
+        LEDs is sent. After a CRC error or a gap in the sequence numbers the
+        slave ignores delta frames until the next keyframe, so it never shows
+        stale values for longer than the keyframe interval.
+
+        In both versions all bytes except the magic byte are below 0x80, so
+        the magic byte always marks the start of a frame. A slave accepts
+        both versions, which provides the fallback to v1.
+
+    Daisy-chained slaves:
+        When built with MAX_SLAVES > 1 the master drives up to 4 slaves on a
+        single wire. Slave n shows LEDs 16 + 16 * n of the master, configured
+        in its own slave LED section. The master sends one addressed frame
+        per slave and systick:
+
+            SLAVE_MAGIC_BYTE_ADDRESSED
+            address
+            v2 frame without its magic byte (sequence, changed LEDs, values,
+            CRC-8)
+
+        Every slave has its own sequence number and keyframe schedule.
+
+        A slave consumes addressed frames with address 0. If the
+        slave_pass_through flag is set it forwards all other addressed frames
+        with the address decremented by one on its TX pin, so the first slave
+        in the chain has address 0, the next one address 1 and so on.
+        Forwarding is byte by byte as the frame arrives, each hop adds only
+        about one byte time of latency. Unaddressed v1 and v2 frames are
+        never forwarded.
+
+        The UART transmit ring can not hold keyframes for all slaves at once.
+        The master therefore sends frames round-robin, as many as fit; a
+        skipped slave is served first on the next systick.
+
+    Distributed rendering:
+        With the distributed_rendering flag the master does not send LED
+        values but broadcasts the car state once per systick:
+
+            SLAVE_MAGIC_BYTE_STATE
+            no_signal, initializing, servo_output_setup (3), reversing_setup (2)
+            blink_flag, hazard, indicator left, indicator right, forward,
+                braking, reversing
+            gear (2), gear_changed, winch_mode (3)
+            light_switch_position (4), ch3_gesture_event (3)
+            (ST + 100) << 8 | (TH + 100), bits 6..0
+            bits 13..7
+            bits 15..14
+            tick sequence number (bits 5..0)
+            CRC-8 bits 7..4
+            CRC-8 bits 3..0
+
+        A slave with distributed_rendering set runs its own local LED
+        configuration and light programs from the received state, fading at
+        its own render rate. This takes 11 bytes per systick on the link
+        instead of 17, independent of the number of slaves. The state frame
+        is a broadcast: pass-through slaves consume and forward it.
+
+        Tick synchronisation: the slave does not use its own systick for the
+        car lights. Every state frame is one master systick; the slave
+        processes it as soon as it is received, restarts its render timer and
+        renders right away, so blink (blink_flag is part of the state) and
+        fades run in phase with the master and can not drift. The tick
+        sequence number tells the slave how many master systicks passed; up
+        to SLAVE_MAX_CATCH_UP_TICKS ticks lost due to CRC errors are caught
+        up so light program timing stays correct.
+
+        Maximum skew between master and slave is the frame time plus one
+        main loop iteration: about 1 ms at 115200 baud (2.9 ms at 38400).
+        Every pass-through hop adds one byte time.
+
 ******************************************************************************/
 
 
@@ -80,12 +198,22 @@
 
 #include <globals.h>
 #include <uart0.h>
+#include <utils.h>
+#include <event_log.h>
 
 
 #define SLAVE_MAGIC_BYTE ((uint8_t)0x87)
+#define SLAVE_MAGIC_BYTE_V2 ((uint8_t)0x88)
+#define SLAVE_MAGIC_BYTE_ADDRESSED ((uint8_t)0x89)
+#define SLAVE_MAGIC_BYTE_STATE ((uint8_t)0x8a)
 
-// 16 lights locally, another 16 potentially at a slave
-#define MAX_LIGHTS 32
+#define SLAVE_LEDS 16
+#define SLAVE_V2_HEADER_LENGTH 5
+#define SLAVE_V2_MAX_FRAME_LENGTH (SLAVE_V2_HEADER_LENGTH + SLAVE_LEDS + 2)
+#define SLAVE_V2_KEYFRAME_INTERVAL 25   // Every 25 frames (500 ms)
+#define SLAVE_ADDRESSED_MAX_FRAME_LENGTH (SLAVE_V2_MAX_FRAME_LENGTH + 1)
+#define SLAVE_STATE_FRAME_LENGTH 11
+#define SLAVE_MAX_CATCH_UP_TICKS 4
 
 
 typedef enum {
@@ -111,11 +239,36 @@ uint8_t light_switch_position;
 LED_T light_setpoint[MAX_LIGHTS];
 LED_T light_actual[MAX_LIGHTS];
 uint8_t max_change_per_systick[MAX_LIGHTS];
+uint16_t incandescent_alpha[MAX_LIGHTS];
+
+// Gamma corrected 6-bit values as sent to the TLC5940 and the slave
+uint8_t light_output[MAX_LIGHTS];
+
+// Q12 filter coefficients derived from the LED configuration at startup
+static uint16_t configured_incandescent_alpha[MAX_LIGHTS];
+
+// Q16 multipliers of the weak ground simulation derived from the LED
+// configuration at startup
+static uint16_t weak_ground_multiplier[MAX_LIGHTS];
+
+// 8.8 fixed-point brightness of the incandescent simulation filter
+static uint16_t light_filtered[MAX_LIGHTS];
+
+static uint8_t render_period_ms;
+static uint8_t render_ticks_per_systick;
+static uint8_t ramp_counter = 0;
+
+static bool switched_light_output_pwm;
+
+#ifndef NODEBUG
+static uint16_t render_count;
+static uint32_t render_cycles;
+#endif
 
 
 extern void init_light_programs(void);
 extern void process_light_program_events(void);
-extern uint32_t process_light_programs(void);
+extern void process_light_programs(LED_BITSET_T *leds_used);
 
 
 // ****************************************************************************
@@ -131,7 +284,7 @@ static void send_light_data_to_tlc5940(void)
         // Wait for TXRDY
         while (!(LPC_SPI0->STAT & (1 << 1)));
 
-        LPC_SPI0->TXDAT = gamma_table.gamma_table[light_actual[i]] >> 2;
+        LPC_SPI0->TXDAT = light_output[i];
     }
 
     // Force END OF TRANSFER
@@ -142,8 +295,133 @@ static void send_light_data_to_tlc5940(void)
 
     // The switched_light_output mirrors the output of LED15 onto the
     // dedicated output pin.
-    // Fading is not applied. 0 turns the output off, any other value on.
-    GPIO_SWITCHED_LIGHT_OUTPUT = light_setpoint[15] ? 1 : 0;
+    // If the SCTimer H is available the output is a PWM signal with the full
+    // 8 bit resolution of the gamma table, so fading is applied. The new duty
+    // cycle is loaded by the SCTimer at the end of the current PWM period.
+    //
+    // Otherwise fading is not applied. 0 turns the output off, any other
+    // value on.
+    if (switched_light_output_pwm) {
+        uint8_t duty = gamma_table.gamma_table[light_actual[15]];
+
+        LPC_SCT->MATCHREL[4].H = duty;
+
+        // Event 0 sets the output at the start of each period. For a duty
+        // cycle of 0 it must be disabled as event 5 would only clear the
+        // output one clock after the set.
+        LPC_SCT->OUT[2].SET = duty ? (1 << 0) : 0;
+    }
+    else {
+        GPIO_SWITCHED_LIGHT_OUTPUT = light_setpoint[15] ? 1 : 0;
+    }
+}
+
+
+// ****************************************************************************
+// Drive the switched light output PIO0_9 with hardware PWM from CTOUT_2.
+//
+// The SCTimer H is used by the servo output; if a servo output is configured
+// the switched light output remains a GPIO that is simply switched on and off.
+//
+// The PWM period is 255 clocks of the SCTimer H so that the 8 bit gamma
+// corrected value can be loaded as duty cycle directly. A duty cycle of
+// 255 never matches, so the output stays on all the time.
+// ****************************************************************************
+static void init_switched_light_output(void)
+{
+    if (config.flags.steering_wheel_servo_output ||
+            config.flags.gearbox_servo_output) {
+        return;
+    }
+
+    switched_light_output_pwm = true;
+
+    LPC_SCT->CONFIG |= (1 << 18);           // Auto-limit on counter H
+    LPC_SCT->CTRL_H |= (1 << 3) |           // Clear the counter H
+                       (46 << 5);           // PRE_H[12:5] = 47-1 (SCTimer H clock 255 kHz)
+    LPC_SCT->MATCHREL[0].H = 255 - 1;       // 255 clocks per period (1 kHz)
+    LPC_SCT->MATCHREL[4].H = 0;             // Output off initially
+
+    LPC_SCT->EVENT[0].STATE = 0xFFFF;       // Event 0 happens in all states
+    LPC_SCT->EVENT[0].CTRL = (0 << 0) |     // Match register 0
+                             (1 << 4) |     // Select H counter
+                             (0x1 << 12);   // Match condition only
+
+    LPC_SCT->EVENT[5].STATE = 0xFFFF;       // Event 5 happens in all states
+    LPC_SCT->EVENT[5].CTRL = (4 << 0) |     // Match register 4
+                             (1 << 4) |     // Select H counter
+                             (0x1 << 12);   // Match condition only
+
+    LPC_SCT->OUT[2].SET = 0;               // Event 0 sets CTOUT_2 (once duty > 0)
+    LPC_SCT->OUT[2].CLR = (1 << 5);        // Event 5 will clear CTOUT_2
+
+    // CTOUT_2 = PIO0_9
+    LPC_SWM->PINASSIGN7 = (0xff << 24) |
+                          (0xff << 16) |
+                          (GPIO_BIT_SWITCHED_LIGHT_OUTPUT << 8) |
+                          (0xff << 0);
+
+    LPC_SCT->CTRL_H &= ~(1 << 2);          // Start the SCTimer H
+}
+
+
+// ****************************************************************************
+// Calculate the Q12 coefficient alpha = dt / (tau + dt) for the incandescent
+// simulation filter. dt is the render period in which the filter runs.
+//
+// Returns 0 if the filter is not used. Since dt is at least 1 ms the result
+// of a non-zero time constant is always smaller than 4096; it is clamped to
+// 1 so that extremely long time constants still make progress.
+// ****************************************************************************
+static uint16_t calculate_incandescent_alpha(uint16_t time_constant_ms)
+{
+    uint32_t alpha;
+    uint32_t dt = render_period_ms;
+
+    if (time_constant_ms == 0) {
+        return 0;
+    }
+
+    alpha = ((4096 * dt) + ((time_constant_ms + dt) / 2)) /
+        (time_constant_ms + dt);
+
+    return (uint16_t)MAX(alpha, 1);
+}
+
+
+// ****************************************************************************
+// Calculate the Q16 multiplier for the weak ground simulation so that
+//
+//      (led * multiplier) >> 16 == led * (100 - reduction_percent) / 100
+//
+// for all 8-bit led values. Rounding the multiplier up adds less than
+// 255 / 65536 to the product, which is too little to cross the next integer
+// as the fractional part of the exact result is a multiple of 1/100.
+// ****************************************************************************
+static uint16_t calculate_weak_ground_multiplier(uint8_t reduction_percent)
+{
+    if (reduction_percent == 0  ||  reduction_percent >= 100) {
+        return 0;
+    }
+
+    return (((uint32_t)(100 - reduction_percent) << 16) + 99) / 100;
+}
+
+
+// ****************************************************************************
+static void init_car_light_coefficients(const CAR_LIGHT_ARRAY_T *leds,
+    int offset)
+{
+    int i;
+
+    for (i = 0; i < leds->led_count ; i++) {
+        configured_incandescent_alpha[offset + i] =
+            calculate_incandescent_alpha(
+                leds->car_lights[i].features.incandescent_ms);
+
+        weak_ground_multiplier[offset + i] = calculate_weak_ground_multiplier(
+            leds->car_lights[i].features.reduction_percent);
+    }
 }
 
 
@@ -156,10 +434,14 @@ static void send_light_data_to_tlc5940(void)
 // ****************************************************************************
 void init_lights(void)
 {
+    int i;
+
     GPIO_BLANK = 1;
     GPIO_GSCLK = 0;
     GPIO_XLAT = 0;
 
+    init_switched_light_output();
+
     LPC_GPIO_PORT->DIR0 |= (1 << GPIO_BIT_GSCLK) |
                            (1 << GPIO_BIT_SCK) |
                            (1 << GPIO_BIT_XLAT) |
@@ -195,6 +477,13 @@ void init_lights(void)
 
     send_light_data_to_tlc5940();
 
+    render_period_ms = 1000 / get_render_rate();
+    render_ticks_per_systick = get_render_rate() / __SYSTICK_RATE;
+    init_car_light_coefficients(&local_leds, 0);
+    for (i = 0; i < MAX_SLAVES; i++) {
+        init_car_light_coefficients(&slave_leds[i], SLAVE_LEDS * (1 + i));
+    }
+
     GPIO_BLANK = 0;
     // Do this short function in-between clearing BLANK and setting GSCLK to
     // surely meet the setup time requirement of the TLC5940
@@ -319,6 +608,40 @@ static LED_T calculate_step_value(LED_T current, LED_T new, uint8_t max_change)
 }
 
 
+// ****************************************************************************
+// First-order filter in 8.8 fixed-point, see "Incadescent" at the top of this
+// file. The step is rounded away from zero so that the filter always reaches
+// the setpoint exactly.
+// ****************************************************************************
+static LED_T calculate_filtered_value(uint16_t *filtered, LED_T new,
+    uint16_t alpha)
+{
+    int32_t difference;
+    int32_t step;
+
+    difference = ((int32_t)new << 8) - *filtered;
+
+    if (difference > 0) {
+        step = (difference * alpha) >> 12;
+        if (step == 0) {
+            step = 1;
+        }
+    }
+    else if (difference < 0) {
+        step = -(((-difference) * alpha) >> 12);
+        if (step == 0) {
+            step = -1;
+        }
+    }
+    else {
+        step = 0;
+    }
+
+    *filtered = (uint16_t)(*filtered + step);
+    return (*filtered + 0x80) >> 8;
+}
+
+
 // ****************************************************************************
 static void set_car_light(LED_T *led, const CAR_LIGHT_T *light,
     CAR_LIGHT_FUNCTION_T function)
@@ -467,7 +790,8 @@ static bool is_light_affected(const LIGHT_FEATURE_T *w)
 
 
 // ****************************************************************************
-static void simulate_weak_ground(LED_T *led, const CAR_LIGHT_T *light)
+static void simulate_weak_ground(LED_T *led, const CAR_LIGHT_T *light,
+    uint16_t multiplier)
 {
 
     if (light->features.reduction_percent == 0) {
@@ -475,18 +799,18 @@ static void simulate_weak_ground(LED_T *led, const CAR_LIGHT_T *light)
     }
 
     if (is_light_affected(&light->features)) {
-        *led = (uint16_t)(*led) *
-            (100 - light->features.reduction_percent) / 100;
+        *led = ((uint32_t)(*led) * multiplier) >> 16;
     }
 }
 
 
 // ****************************************************************************
-static void process_light(const CAR_LIGHT_T *light, LED_T *led, uint8_t *limit)
+static void process_light(const CAR_LIGHT_T *light, int i)
 {
     LED_T result = 0;
 
-    *limit = light->features.max_change_per_systick;
+    max_change_per_systick[i] = light->features.max_change_per_systick;
+    incandescent_alpha[i] = configured_incandescent_alpha[i];
 
     set_car_light(&result, light, ALWAYS_ON);
 
@@ -518,83 +842,545 @@ static void process_light(const CAR_LIGHT_T *light, LED_T *led, uint8_t *limit)
         }
     }
 
-    simulate_weak_ground(&result, light);
-    *led = result;
+    simulate_weak_ground(&result, light, weak_ground_multiplier[i]);
+    light_setpoint[i] = result;
 }
 
 
+// ****************************************************************************
+// Output kernel: in a single pass per LED apply the incandescent simulation
+// while copying from light_setpoint to light_actual, followed by gamma
+// correction and quantization to the 6 bits of the TLC5940 and slave.
+//
+// Runs once per render period. The linear ramp only advances on every
+// render_ticks_per_systick-th call so that its timing does not depend on the
+// render rate.
+//
+// The filter state follows light_actual when the filter is not in use so
+// that switching between the methods does not cause a jump.
+// ****************************************************************************
+static void process_light_output(void)
+{
+    bool ramp;
+    int i;
+    LED_T actual;
+
+    ++ramp_counter;
+    ramp = (ramp_counter >= render_ticks_per_systick);
+    if (ramp) {
+        ramp_counter = 0;
+    }
+
+    for (i = 0; i < MAX_LIGHTS ; i++) {
+        if (incandescent_alpha[i] > 0) {
+            actual = calculate_filtered_value(
+                &light_filtered[i], light_setpoint[i], incandescent_alpha[i]);
+        }
+        else {
+            if (max_change_per_systick[i] > 0) {
+                actual = light_actual[i];
+                if (ramp) {
+                    actual = calculate_step_value(actual,
+                        light_setpoint[i], max_change_per_systick[i]);
+                }
+            }
+            else {
+                actual = light_setpoint[i];
+            }
+            light_filtered[i] = actual << 8;
+        }
+
+        light_actual[i] = actual;
+        light_output[i] = gamma_table.gamma_table[actual] >> 2;
+    }
+}
+
+
+// ****************************************************************************
+// One pass of the render stage: fade, gamma correction and sending the new
+// values to the TLC5940
+// ****************************************************************************
+static void render_lights(void)
+{
+#ifndef NODEBUG
+    uint32_t entry = SysTick->VAL;
+    uint32_t now;
+#endif
+
+    process_light_output();
+    send_light_data_to_tlc5940();
+
+#ifndef NODEBUG
+    // SysTick counts down and reloads every systick
+    now = SysTick->VAL;
+    if (now > entry) {
+        entry += SysTick->LOAD + 1;
+    }
+    render_cycles += entry - now;
+    ++render_count;
+#endif
+}
+
+
+#ifndef NODEBUG
+// ****************************************************************************
+static void report_render_statistics(void)
+{
+    static uint8_t systicks = 0;
+    uint32_t cycles = render_cycles;
+
+    if (++systicks < (1000 / __SYSTICK_IN_MS)) {
+        return;
+    }
+    systicks = 0;
+
+    if (render_count) {
+        cycles /= render_count;
+    }
+
+    log_event(EVENT_RENDER_STATISTICS,
+        ((uint32_t)render_count << 16) | MIN(cycles, 0xffff));
+
+    render_count = 0;
+    render_cycles = 0;
+}
+#endif
+
+
 // ****************************************************************************
 static void process_car_lights(void)
 {
     int i;
-    uint32_t leds_used;
+    int s;
+    LED_BITSET_T leds_used;
 
-    leds_used = process_light_programs();
+    process_light_programs(&leds_used);
 
     if (diagnostics_enabled()) {
         static uint8_t old_light_switch_position = 0xff;
 
         if (light_switch_position != old_light_switch_position) {
             old_light_switch_position = light_switch_position;
-            uart0_send_cstring("light_switch_position ");
-            uart0_send_uint32(light_switch_position);
-            uart0_send_linefeed();
+            log_event(EVENT_LIGHT_SWITCH_POSITION, light_switch_position);
         }
     }
 
     // Handle LEDs connected to the TLC5940 locally
     for (i = 0; i < local_leds.led_count ; i++) {
-        if (leds_used & (1 << i)) {
+        if (LED_BITSET_IS_SET(&leds_used, i)) {
             continue;
         }
-        process_light(&local_leds.car_lights[i], &light_setpoint[i],
-            &max_change_per_systick[i]);
+        process_light(&local_leds.car_lights[i], i);
     }
 
-    if (config.flags.slave_output) {
-        // Handle LEDs connected to a slave light controller
-        for (i = 0; i < slave_leds.led_count ; i++) {
-            if (leds_used & (1 << (16 + i))) {
-                continue;
+    // With distributed rendering the slaves process their LEDs themselves
+    if (config.flags.slave_output  &&  !config.flags.distributed_rendering) {
+        // Handle LEDs connected to slave light controllers
+        for (s = 0; s < MAX_SLAVES; s++) {
+            int offset = SLAVE_LEDS * (1 + s);
+
+            for (i = 0; i < slave_leds[s].led_count ; i++) {
+                if (LED_BITSET_IS_SET(&leds_used, offset + i)) {
+                    continue;
+                }
+
+                process_light(&slave_leds[s].car_lights[i], offset + i);
             }
+        }
+    }
+}
+
+
+// ****************************************************************************
+// The slave stream is sent once per systick regardless of the render rate,
+// it carries the latest rendered values.
+//
+// If the UART transmit ring can not take the whole frame the frame is
+// skipped; the next systick sends fresh values anyway.
+// ****************************************************************************
+static void send_light_data_to_slave_v1(void)
+{
+    int i;
+
+    if (uart0_send_space() < (1 + slave_leds[0].led_count)) {
+        return;
+    }
+
+    uart0_send_char(SLAVE_MAGIC_BYTE);
+
+    for (i = 0; i < slave_leds[0].led_count ; i++) {
+        uart0_send_char(light_output[16 + i]);
+    }
+}
 
-            process_light(&slave_leds.car_lights[i], &light_setpoint[16 + i],
-                &max_change_per_systick[16 + i]);
+
+// ****************************************************************************
+// Builds the v2 frame for the given slave in frame[], starting with the magic
+// byte, and returns its length.
+// ****************************************************************************
+static int build_slave_v2_frame(int slave, uint8_t *frame)
+{
+    static uint8_t sequence[MAX_SLAVES];
+    static uint8_t frames_until_keyframe[MAX_SLAVES];
+    static uint8_t sent[MAX_SLAVES][SLAVE_LEDS];
+    const uint8_t *output = &light_output[SLAVE_LEDS * (1 + slave)];
+    uint16_t changed = 0;
+    bool keyframe;
+    uint8_t crc;
+    int length;
+    int i;
+
+    keyframe = (frames_until_keyframe[slave] == 0);
+
+    length = SLAVE_V2_HEADER_LENGTH;
+    for (i = 0; i < slave_leds[slave].led_count ; i++) {
+        if (keyframe  ||  output[i] != sent[slave][i]) {
+            changed |= (1 << i);
+            sent[slave][i] = output[i];
+            frame[length++] = output[i];
         }
     }
 
-    // Apply max_change_per_systick while copying from light_setpoint to
-    // light_actual
-    for (i = 0; i < MAX_LIGHTS ; i++) {
-        if (max_change_per_systick[i] > 0) {
-            light_actual[i] = calculate_step_value(
-                light_actual[i], light_setpoint[i], max_change_per_systick[i]);
+    frame[0] = SLAVE_MAGIC_BYTE_V2;
+    frame[1] = (keyframe ? (1 << 6) : 0) | sequence[slave];
+    frame[2] = changed & 0x7f;
+    frame[3] = (changed >> 7) & 0x7f;
+    frame[4] = (changed >> 14) & 0x03;
+
+    crc = crc8(&frame[1], length - 1);
+    frame[length++] = crc >> 4;
+    frame[length++] = crc & 0x0f;
+
+    sequence[slave] = (sequence[slave] + 1) & 0x3f;
+    if (keyframe) {
+        frames_until_keyframe[slave] = SLAVE_V2_KEYFRAME_INTERVAL;
+    }
+    --frames_until_keyframe[slave];
+
+    return length;
+}
+
+
+// ****************************************************************************
+static void send_light_data_to_slave_v2(void)
+{
+    uint8_t frame[SLAVE_V2_MAX_FRAME_LENGTH];
+    int length;
+    int i;
+
+    if (uart0_send_space() < SLAVE_V2_MAX_FRAME_LENGTH) {
+        return;
+    }
+
+    length = build_slave_v2_frame(0, frame);
+    for (i = 0; i < length; i++) {
+        uart0_send_char(frame[i]);
+    }
+}
+
+
+// ****************************************************************************
+// Sends addressed frames round-robin to all slaves in the daisy-chain, as
+// many as fit into the UART transmit ring.
+// ****************************************************************************
+static void send_light_data_to_slaves_addressed(void)
+{
+    static uint8_t next_slave = 0;
+    uint8_t frame[SLAVE_ADDRESSED_MAX_FRAME_LENGTH];
+    int length;
+    int n;
+    int i;
+
+    for (n = 0; n < MAX_SLAVES; n++) {
+        if (uart0_send_space() < SLAVE_ADDRESSED_MAX_FRAME_LENGTH) {
+            return;
         }
-        else {
-            light_actual[i] = light_setpoint[i];
+
+        // The addressed frame is the v2 frame with the magic byte replaced
+        // by SLAVE_MAGIC_BYTE_ADDRESSED and the address
+        length = build_slave_v2_frame(next_slave, &frame[1]) + 1;
+        frame[0] = SLAVE_MAGIC_BYTE_ADDRESSED;
+        frame[1] = next_slave;
+
+        for (i = 0; i < length; i++) {
+            uart0_send_char(frame[i]);
+        }
+
+        if (++next_slave >= MAX_SLAVES) {
+            next_slave = 0;
+        }
+    }
+}
+
+
+// ****************************************************************************
+static uint8_t encode_channel(int16_t normalized)
+{
+    if (normalized < -100) {
+        return 0;
+    }
+    if (normalized > 100) {
+        return 200;
+    }
+    return normalized + 100;
+}
+
+
+// ****************************************************************************
+static void send_car_state_to_slaves(bool gear_changed,
+    uint8_t ch3_gesture_event)
+{
+    static uint8_t tick_sequence = 0;
+    uint8_t frame[SLAVE_STATE_FRAME_LENGTH];
+    uint16_t channels;
+    uint8_t crc;
+    int i;
+
+    // Counts master systicks, also the ones where the frame is skipped
+    tick_sequence = (tick_sequence + 1) & 0x3f;
+
+    if (uart0_send_space() < SLAVE_STATE_FRAME_LENGTH) {
+        return;
+    }
+
+    channels = (encode_channel(channel[ST].normalized) << 8) |
+        encode_channel(channel[TH].normalized);
+
+    frame[0] = SLAVE_MAGIC_BYTE_STATE;
+    frame[1] = global_flags.no_signal |
+        (global_flags.initializing << 1) |
+        (global_flags.servo_output_setup << 2) |
+        (global_flags.reversing_setup << 5);
+    frame[2] = global_flags.blink_flag |
+        (global_flags.blink_hazard << 1) |
+        (global_flags.blink_indicator_left << 2) |
+        (global_flags.blink_indicator_right << 3) |
+        (global_flags.forward << 4) |
+        (global_flags.braking << 5) |
+        (global_flags.reversing << 6);
+    frame[3] = global_flags.gear |
+        ((gear_changed ? 1 : 0) << 2) |
+        (global_flags.winch_mode << 3);
+    frame[4] = (light_switch_position & 0x0f) |
+        ((ch3_gesture_event & 0x07) << 4);
+    frame[5] = channels & 0x7f;
+    frame[6] = (channels >> 7) & 0x7f;
+    frame[7] = channels >> 14;
+    frame[8] = tick_sequence;
+
+    crc = crc8(&frame[1], 8);
+    frame[9] = crc >> 4;
+    frame[10] = crc & 0x0f;
+
+    for (i = 0; i < SLAVE_STATE_FRAME_LENGTH; i++) {
+        uart0_send_char(frame[i]);
+    }
+}
+
+
+// ****************************************************************************
+static void send_light_data_to_slave(void)
+{
+    if (MAX_SLAVES > 1) {
+        send_light_data_to_slaves_addressed();
+    }
+    else if (config.flags.slave_protocol_v2) {
+        send_light_data_to_slave_v2();
+    }
+    else {
+        send_light_data_to_slave_v1();
+    }
+}
+
+
+// ****************************************************************************
+static void set_slave_light(int i, uint8_t value)
+{
+    // Set lights_setpoint, lights_actual and light_output as
+    // lights_setpoint drives the switched light output and
+    // light_output drives the TLC5940
+    light_setpoint[i] = value << 2;
+    light_actual[i]   = value << 2;
+    light_output[i]   = gamma_table.gamma_table[value << 2] >> 2;
+}
+
+
+// ****************************************************************************
+// Returns the total length of a v2 frame, derived from the bitmask of
+// changed LEDs in its header. Returns 0 if the header is invalid.
+// ****************************************************************************
+static int get_slave_v2_frame_length(const uint8_t *frame)
+{
+    uint16_t changed;
+    int length = SLAVE_V2_HEADER_LENGTH + 2;
+
+    if (frame[4] & ~0x03) {
+        return 0;
+    }
+
+    changed = frame[2] | (frame[3] << 7) | (frame[4] << 14);
+    while (changed) {
+        length += changed & 1;
+        changed >>= 1;
+    }
+
+    return length;
+}
+
+
+// ****************************************************************************
+static void process_slave_v2_frame(const uint8_t *frame, int length)
+{
+    static bool synchronized = false;
+    static uint8_t expected_sequence;
+    uint8_t sequence;
+    uint16_t changed;
+    int value_index;
+    int i;
+
+    sequence = frame[1] & 0x3f;
+
+    if (crc8(&frame[1], length - 3) !=
+            ((frame[length - 2] << 4) | frame[length - 1])) {
+        synchronized = false;
+        log_event(EVENT_SLAVE_CRC_ERROR, sequence);
+        return;
+    }
+
+    if (!(frame[1] & (1 << 6))) {
+        if (!synchronized) {
+            return;
+        }
+
+        if (sequence != expected_sequence) {
+            synchronized = false;
+            log_event(EVENT_SLAVE_SEQUENCE_ERROR, sequence);
+            return;
+        }
+    }
+
+    synchronized = true;
+    expected_sequence = (sequence + 1) & 0x3f;
+
+    changed = frame[2] | (frame[3] << 7) | (frame[4] << 14);
+    value_index = SLAVE_V2_HEADER_LENGTH;
+    for (i = 0; i < SLAVE_LEDS; i++) {
+        if (changed & (1 << i)) {
+            set_slave_light(i, frame[value_index++] & 0x3f);
         }
     }
 
     send_light_data_to_tlc5940();
-    if (config.flags.slave_output) {
-        uart0_send_char(SLAVE_MAGIC_BYTE);
+}
+
+
+// ****************************************************************************
+// The received car state is applied right before the car lights are
+// processed, so that the slave's own indicator and drive mode handling
+// (which have no input in slave mode) can not interfere.
+// ****************************************************************************
+static uint8_t slave_state[SLAVE_STATE_FRAME_LENGTH];
+static uint8_t slave_ticks_pending = 0;
+static bool slave_gear_changed = false;
+static uint8_t slave_ch3_gesture_event = 0;
+
+static void process_slave_state_frame(const uint8_t *frame)
+{
+    static bool synchronized = false;
+    static uint8_t last_tick_sequence;
+    uint8_t ticks;
+    int i;
+
+    if (crc8(&frame[1], 8) != ((frame[9] << 4) | frame[10])) {
+        log_event(EVENT_SLAVE_CRC_ERROR, SLAVE_MAGIC_BYTE_STATE);
+        return;
+    }
 
-        for (i = 0; i < slave_leds.led_count ; i++) {
-            uart0_send_char(gamma_table.gamma_table[light_actual[16 + i]] >> 2);
+    ticks = 1;
+    if (synchronized) {
+        ticks = (frame[8] - last_tick_sequence) & 0x3f;
+        if (ticks == 0) {
+            return;
+        }
+        if (ticks > 1) {
+            log_event(EVENT_SLAVE_SEQUENCE_ERROR, frame[8]);
+        }
+        if (ticks > SLAVE_MAX_CATCH_UP_TICKS) {
+            ticks = 1;
         }
     }
+    synchronized = true;
+    last_tick_sequence = frame[8];
+
+    for (i = 0; i < SLAVE_STATE_FRAME_LENGTH; i++) {
+        slave_state[i] = frame[i];
+    }
+    slave_ticks_pending += ticks;
+
+    // gear_changed and ch3_gesture_event are events; make sure they are not
+    // lost if two frames arrive within one systick
+    if (frame[3] & (1 << 2)) {
+        slave_gear_changed = true;
+    }
+    if (frame[4] >> 4) {
+        slave_ch3_gesture_event = frame[4] >> 4;
+    }
+}
+
+
+// ****************************************************************************
+static void apply_slave_state(void)
+{
+    uint16_t channels;
+
+    global_flags.no_signal = slave_state[1] & 1;
+    global_flags.initializing = (slave_state[1] >> 1) & 1;
+    global_flags.servo_output_setup = (slave_state[1] >> 2) & 0x07;
+    global_flags.reversing_setup = (slave_state[1] >> 5) & 0x03;
+
+    global_flags.blink_flag = slave_state[2] & 1;
+    global_flags.blink_hazard = (slave_state[2] >> 1) & 1;
+    global_flags.blink_indicator_left = (slave_state[2] >> 2) & 1;
+    global_flags.blink_indicator_right = (slave_state[2] >> 3) & 1;
+    global_flags.forward = (slave_state[2] >> 4) & 1;
+    global_flags.braking = (slave_state[2] >> 5) & 1;
+    global_flags.reversing = (slave_state[2] >> 6) & 1;
+
+    global_flags.gear = slave_state[3] & 0x03;
+    global_flags.gear_changed = slave_gear_changed;
+    slave_gear_changed = false;
+    global_flags.winch_mode = (slave_state[3] >> 3) & 0x07;
+
+    light_switch_position = slave_state[4] & 0x0f;
+    global_flags.ch3_gesture_event = slave_ch3_gesture_event;
+    slave_ch3_gesture_event = 0;
+
+    channels = slave_state[5] | (slave_state[6] << 7) | (slave_state[7] << 14);
+    channel[ST].normalized = (int16_t)(channels >> 8) - 100;
+    channel[TH].normalized = (int16_t)(channels & 0xff) - 100;
 }
 
 
 // ****************************************************************************
 static void process_slave(void)
 {
-    uint8_t uart_byte;
+    static uint8_t frame[SLAVE_V2_MAX_FRAME_LENGTH];
+    static int frame_length = 0;
+    static int received = 0;
     static int state = 0;
+    static bool address_pending = false;
+    static bool forwarding = false;
+    uint8_t uart_byte;
 
     while (uart0_read_is_byte_pending()) {
         uart_byte = uart0_read_byte();
 
+        // Any magic byte ends a frame that is being forwarded
+        if (uart_byte >= 0x80) {
+            forwarding = false;
+            address_pending = false;
+        }
+
         // The slave/preprocessor protocol is designed such that only the first
         // byte can have the MAGIC value. This allows us to be in sync at all
         // times.
@@ -602,22 +1388,83 @@ static void process_slave(void)
         // can kick off the state machine.
         if (uart_byte == SLAVE_MAGIC_BYTE) {
             state = 1;
+            received = 0;
         }
-        else {
-            if (state >= 1) {
-                // Set both lights_setpoint and lights_actual as lights_setpoint
-                // drives the switched light output and lights_actual drives
-                // the TLC5940
-                light_setpoint[state - 1] = uart_byte << 2;
-                light_actual[state - 1]   = uart_byte << 2;
-                ++state;
-
-                // Once we got all 16 LED values we send the data to the LEDs
-                // and reset the state machine to wait for the next packet
-                if (state > 16) {
-                    state = 0;
-                    send_light_data_to_tlc5940();
+        else if (uart_byte == SLAVE_MAGIC_BYTE_V2) {
+            state = 0;
+            frame[0] = uart_byte;
+            received = 1;
+            frame_length = SLAVE_V2_HEADER_LENGTH;
+        }
+        else if (uart_byte == SLAVE_MAGIC_BYTE_STATE) {
+            state = 0;
+            frame[0] = uart_byte;
+            received = 1;
+            frame_length = SLAVE_STATE_FRAME_LENGTH;
+
+            // The state frame is a broadcast for all slaves in the chain
+            if (config.flags.slave_pass_through) {
+                uart0_send_char(uart_byte);
+                forwarding = true;
+            }
+        }
+        else if (uart_byte == SLAVE_MAGIC_BYTE_ADDRESSED) {
+            state = 0;
+            received = 0;
+            address_pending = true;
+        }
+        else if (address_pending) {
+            address_pending = false;
+
+            if (uart_byte == 0) {
+                // Our frame: continue as with an unaddressed v2 frame
+                frame[0] = SLAVE_MAGIC_BYTE_V2;
+                received = 1;
+                frame_length = SLAVE_V2_HEADER_LENGTH;
+            }
+            else if (config.flags.slave_pass_through) {
+                uart0_send_char(SLAVE_MAGIC_BYTE_ADDRESSED);
+                uart0_send_char(uart_byte - 1);
+                forwarding = true;
+            }
+        }
+        else if (forwarding  &&  received == 0) {
+            uart0_send_char(uart_byte);
+        }
+        else if (state >= 1) {
+            set_slave_light(state - 1, uart_byte);
+            ++state;
+
+            // Once we got all 16 LED values we send the data to the LEDs
+            // and reset the state machine to wait for the next packet
+            if (state > 16) {
+                state = 0;
+                send_light_data_to_tlc5940();
+            }
+        }
+        else if (received > 0) {
+            frame[received++] = uart_byte;
+            if (forwarding) {
+                uart0_send_char(uart_byte);
+            }
+
+            if (frame[0] == SLAVE_MAGIC_BYTE_V2  &&
+                    received == SLAVE_V2_HEADER_LENGTH) {
+                frame_length = get_slave_v2_frame_length(frame);
+                if (frame_length == 0) {
+                    received = 0;
+                    continue;
+                }
+            }
+
+            if (received == frame_length) {
+                if (frame[0] == SLAVE_MAGIC_BYTE_STATE) {
+                    process_slave_state_frame(frame);
+                }
+                else {
+                    process_slave_v2_frame(frame, frame_length);
                 }
+                received = 0;
             }
         }
     }
@@ -627,13 +1474,68 @@ static void process_slave(void)
 // ****************************************************************************
 void process_lights(void)
 {
-    if (config.mode == SLAVE) {
+    static bool gear_changed_since_last_state = false;
+    static uint8_t ch3_gesture_event_since_last_state = 0;
+
+    if (operating_mode == SLAVE) {
         process_slave();
+
+        if (config.flags.distributed_rendering) {
+            if (slave_ticks_pending) {
+                // A state frame is the master's systick
+                apply_slave_state();
+                process_light_program_events();
+                while (slave_ticks_pending) {
+                    process_car_lights();
+                    --slave_ticks_pending;
+                }
+
+                // Render right away and restart the render clock, so the
+                // fades run in phase with the master
+                restart_render_tick();
+                ramp_counter = render_ticks_per_systick - 1;
+                render_lights();
+            }
+            else if (global_flags.render  &&
+                    get_render_rate() > __SYSTICK_RATE) {
+                render_lights();
+            }
+        }
     }
     else {
         process_light_program_events();
         if (global_flags.systick) {
             process_car_lights();
         }
+
+        if (global_flags.render) {
+            render_lights();
+        }
+
+        if (global_flags.gear_changed) {
+            gear_changed_since_last_state = true;
+        }
+        if (global_flags.ch3_gesture_event) {
+            ch3_gesture_event_since_last_state =
+                global_flags.ch3_gesture_event;
+        }
+
+        if (global_flags.systick  &&  config.flags.slave_output) {
+            if (config.flags.distributed_rendering) {
+                send_car_state_to_slaves(gear_changed_since_last_state,
+                    ch3_gesture_event_since_last_state);
+                gear_changed_since_last_state = false;
+                ch3_gesture_event_since_last_state = 0;
+            }
+            else {
+                send_light_data_to_slave();
+            }
+        }
+    }
+
+#ifndef NODEBUG
+    if (global_flags.systick) {
+        report_render_statistics();
     }
+#endif
 }
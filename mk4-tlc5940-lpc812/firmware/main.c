@@ -11,9 +11,11 @@
 
 #include <globals.h>
 #include <uart0.h>
+#include <event_log.h>
 
 
 GLOBAL_FLAGS_T global_flags;
+MASTER_MODE_T operating_mode;
 
 CHANNEL_T channel[3] = {
     {   // STEERING
@@ -48,6 +50,8 @@ CHANNEL_T channel[3] = {
     }
 };
 
+EXTRA_CHANNEL_T extra_channel[EXTRA_CHANNELS];
+
 static volatile uint32_t systick_count;
 static bool diagnostics_output_enabled;
 
@@ -78,34 +82,6 @@ static void init_hardware(void)
     // Enable reset, all other special functions disabled
     LPC_SWM->PINENABLE0 = 0xffffffbf;
 
-    // Configure the UART input and output
-    diagnostics_output_enabled = true;
-    if (config.flags.slave_output || config.flags.preprocessor_output ||
-            config.flags.winch_output) {
-        diagnostics_output_enabled = false;
-    }
-    if (config.mode == MASTER_WITH_SERVO_READER) {
-        // Turn the UART output on unless a servo output is requested
-        if (config.flags.steering_wheel_servo_output ||
-                config.flags.gearbox_servo_output) {
-            diagnostics_output_enabled = false;
-        }
-        else {
-            // U0_TXT_O=PIO0_12
-            LPC_SWM->PINASSIGN0 = (0xff << 24) |
-                                  (0xff << 16) |
-                                  (0xff << 8) |
-                                  (GPIO_BIT_OUT << 0);
-        }
-    }
-    else {
-        // U0_TXT_O=PIO0_4 (TH), U0_RXD_I=PIO0_0 (ST)
-        LPC_SWM->PINASSIGN0 = (0xff << 24) |
-                              (0xff << 16) |
-                              (GPIO_BIT_ST << 8) |
-                              (GPIO_BIT_TH << 0);
-    }
-
     // Make the open drain ports PIO0_10, PIO0_11 outputs and pull to ground
     // to prevent them from floating.
     // Make the switched light output PIO0_9 an output and shut it off.
@@ -152,6 +128,11 @@ static void init_hardware(void)
                     (1 << 2);               // Use system clock
 
 
+    // Determine the operating mode. This needs the SysTick for timing; the
+    // systicks that elapse during detection are discarded below.
+    detect_input_mode();
+
+
     // Wait for 100ms to have the supply settle down before initializing the
     // rest of the system. This is especially important for the TLC5940,
     // which misbehaves (certain LEDs don't work) when being addressed before
@@ -161,6 +142,91 @@ static void init_hardware(void)
 }
 
 
+// ****************************************************************************
+// Assigns the UART pins. The pin usage depends on the operating mode, which
+// is known once init_hardware() has run detect_input_mode().
+// ****************************************************************************
+static void init_uart_pins(void)
+{
+    uint8_t tx = GPIO_BIT_TH;
+    uint8_t rx = GPIO_BIT_ST;
+
+    diagnostics_output_enabled = true;
+    if (config.flags.slave_output || config.flags.preprocessor_output ||
+            config.flags.winch_output || config.flags.slave_pass_through) {
+        diagnostics_output_enabled = false;
+    }
+    if (operating_mode == MASTER_WITH_SBUS_READER) {
+        // The UART runs at 100000 baud 8e2, which terminals can not display
+        diagnostics_output_enabled = false;
+    }
+    if (operating_mode == MASTER_WITH_SERVO_READER) {
+        rx = 0xff;
+    }
+
+    // With servo inputs TH is an input, so the UART output uses the OUT pin
+    // and is turned on unless a servo output is requested. Auto-detection
+    // does the same in all modes so that the wiring does not depend on the
+    // detected input.
+    if (operating_mode == MASTER_WITH_SERVO_READER  ||
+            config.mode == MASTER_WITH_AUTO_DETECT) {
+        if (config.flags.steering_wheel_servo_output ||
+                config.flags.gearbox_servo_output) {
+            diagnostics_output_enabled = false;
+            tx = 0xff;
+        }
+        else {
+            tx = GPIO_BIT_OUT;
+        }
+    }
+
+    // U0_TXT_O=PIO0_4 (TH) or PIO0_12 (OUT), U0_RXD_I=PIO0_0 (ST)
+    LPC_SWM->PINASSIGN0 = (0xff << 24) |
+                          (0xff << 16) |
+                          (rx << 8) |
+                          (tx << 0);
+}
+
+
+// ****************************************************************************
+// The fade and output stage of the lights can run faster than the systick.
+// In that case MRT channel 0 runs in repeat mode at the render rate. Its
+// interrupt is not enabled; the main loop polls the INTFLAG instead, so if a
+// main loop iteration takes longer than a render period the render ticks
+// coalesce rather than queue up.
+// ****************************************************************************
+static void init_render_tick(void)
+{
+    if (get_render_rate() <= __SYSTICK_RATE) {
+        return;
+    }
+
+    // Turn on peripheral clock for the MRT
+    LPC_SYSCON->SYSAHBCLKCTRL |= (1 << 10);
+
+    LPC_MRT->Channel[0].CTRL = (0 << 0) |   // Interrupt disabled
+                               (0 << 1);    // Repeat interrupt mode
+    LPC_MRT->Channel[0].INTVAL = (__SYSTEM_CLOCK / get_render_rate()) |
+                                 (1u << 31);  // Load immediately
+}
+
+
+// ****************************************************************************
+// Restarts the render period from now. Used by slaves to run their fades in
+// phase with the master's systick.
+// ****************************************************************************
+void restart_render_tick(void)
+{
+    if (get_render_rate() <= __SYSTICK_RATE) {
+        return;
+    }
+
+    LPC_MRT->Channel[0].INTVAL = (__SYSTEM_CLOCK / get_render_rate()) |
+                                 (1u << 31);  // Load immediately
+    LPC_MRT->Channel[0].STAT = (1 << 0);    // Clear INTFLAG
+}
+
+
 // ****************************************************************************
 static void init_hardware_final(void)
 {
@@ -202,6 +268,22 @@ static void service_systick(void)
 }
 
 
+// ****************************************************************************
+static void service_render_tick(void)
+{
+    if (get_render_rate() <= __SYSTICK_RATE) {
+        global_flags.render = global_flags.systick;
+        return;
+    }
+
+    global_flags.render = 0;
+    if (LPC_MRT->Channel[0].STAT & (1 << 0)) {
+        LPC_MRT->Channel[0].STAT = (1 << 0);    // Clear INTFLAG
+        global_flags.render = 1;
+    }
+}
+
+
 #ifndef NODEBUG
 // ****************************************************************************
 static void stack_check(void)
@@ -228,9 +310,7 @@ static void stack_check(void)
 
     if (now != last_found) {
         last_found = now;
-        uart0_send_cstring("Stack down to 0x");
-        uart0_send_uint32_hex((uint32_t)now);
-        uart0_send_linefeed();
+        log_event(EVENT_STACK, (uint32_t)now);
     }
 }
 #endif
@@ -267,28 +347,56 @@ bool diagnostics_enabled(void)
 }
 
 
+// ****************************************************************************
+// Returns the rate in Hz at which the fade and output stage of the lights
+// runs: 50 (the systick), 100 or 200. The linear ramp and the slave stream
+// rely on an integer number of render periods per systick, so any other
+// configured value is rounded down to the next supported rate.
+// ****************************************************************************
+uint16_t get_render_rate(void)
+{
+    if (config.render_rate >= RENDER_RATE_MAX) {
+        return RENDER_RATE_MAX;
+    }
+
+    if (config.render_rate >= 2 * __SYSTICK_RATE) {
+        return 2 * __SYSTICK_RATE;
+    }
+
+    return __SYSTICK_RATE;
+}
+
+
 // ****************************************************************************
 int main(void)
 {
     global_flags.no_signal = true;
     init_hardware();
+    init_uart_pins();
+    init_render_tick();
     init_uart0();
     load_persistent_storage();
+    load_persistent_calibration();
     init_servo_reader();
     init_uart_reader();
+    init_serial_receiver();
+    init_ch3_local_switch();
     init_servo_output();
     init_lights();
     init_hardware_final();
 
-    if (diagnostics_enabled()) {
-        uart0_send_cstring("Light controller initialized\n");
+    log_event(EVENT_INITIALIZED, 0);
+    if (config.mode == MASTER_WITH_AUTO_DETECT) {
+        log_event(EVENT_INPUT_MODE_DETECTED, operating_mode);
     }
 
     while (1) {
         service_systick();
+        service_render_tick();
 
         read_all_servo_channels();
         read_preprocessor();
+        read_serial_receiver();
         process_ch3_clicks();
         process_drive_mode();
         process_indicators();
@@ -311,11 +419,8 @@ int main(void)
                    st = channel[ST].normalized;
                    th = channel[TH].normalized;
 
-                   uart0_send_cstring("ST: ");
-                   uart0_send_int32(channel[ST].normalized);
-                   uart0_send_cstring("   TH: ");
-                   uart0_send_int32(channel[TH].normalized);
-                   uart0_send_linefeed();
+                   log_event(EVENT_CHANNELS,
+                       ((uint32_t)(uint16_t)st << 16) | (uint16_t)th);
                 }
             }
         }
@@ -323,5 +428,6 @@ int main(void)
 #ifndef NODEBUG
         stack_check();
 #endif
+        process_event_log();
     }
 }
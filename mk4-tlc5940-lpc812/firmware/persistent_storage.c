@@ -7,7 +7,19 @@
 	Uses 148 bytes of stack space
 	Use compare function to only write changes
 	Interrupts must be disabled during erase and write operations
-	Q: How long does erase and write take?
+	Erase takes 100 ms, write 1 ms (LPC81x datasheet, flash characteristics),
+	so interrupts are off for about 101 ms per update. Callers must only
+	write while nothing time critical happens (setup procedures, or the
+	throttle in neutral).
+	IAP errors are reported as EVENT_FLASH_ERROR (arg: command << 8 | status)
+
+	Version 2 adds the servo reader calibration (endpoints of ST, TH and
+	CH3) after the version 1 data. Version 1 data is still loaded, the
+	calibration is then sampled anew.
+
+	The calibration is only loaded at startup (load_persistent_calibration).
+	load_persistent_storage() is also used to undo setup procedures and must
+	not touch the live endpoints.
 
 ******************************************************************************/
 #include <stdint.h>
@@ -16,9 +28,9 @@
 #include <LPC8xx.h>
 #include <LPC8xx_ROM_API.h>
 #include <globals.h>
-#include <uart0.h>
+#include <event_log.h>
 
-#define PERSISTENT_DATA_VERSION 1
+#define PERSISTENT_DATA_VERSION 2
 #define NUMBER_OF_PERSISTENT_ELEMENTS 16
 
 __attribute__ ((section(".persistent_data")))
@@ -30,6 +42,42 @@ volatile const uint32_t persistent_data[NUMBER_OF_PERSISTENT_ELEMENTS];
 #define OFFSET_SERVO_LEFT 3
 #define OFFSET_SERVO_CENTRE 4
 #define OFFSET_SERVO_RIGHT 5
+#define OFFSET_CALIBRATED 6
+#define OFFSET_ENDPOINTS 7      // left, centre, right for ST, TH and CH3
+
+
+// ****************************************************************************
+static bool is_valid_endpoint(const volatile uint32_t *ptr)
+{
+    return ptr[0] < ptr[1]  &&  ptr[1] < ptr[2]  &&  ptr[2] <= 0xffff;
+}
+
+
+// ****************************************************************************
+void load_persistent_calibration(void)
+{
+    const volatile uint32_t *ptr;
+    int i;
+
+    if (persistent_data[OFFSET_VERSION] != PERSISTENT_DATA_VERSION  ||
+            !persistent_data[OFFSET_CALIBRATED]) {
+        return;
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (!is_valid_endpoint(&persistent_data[OFFSET_ENDPOINTS + (3 * i)])) {
+            return;
+        }
+    }
+
+    for (i = 0; i < 3; i++) {
+        ptr = &persistent_data[OFFSET_ENDPOINTS + (3 * i)];
+        channel[i].endpoint.left = ptr[0];
+        channel[i].endpoint.centre = ptr[1];
+        channel[i].endpoint.right = ptr[2];
+    }
+    global_flags.calibrated = true;
+}
 
 
 // ****************************************************************************
@@ -45,11 +93,12 @@ void load_persistent_storage(void)
     defaults[OFFSET_SERVO_CENTRE] = 1500;
     defaults[OFFSET_SERVO_RIGHT] = 2000;
 
-    if (defaults[0] != persistent_data[0]) {
-        ptr = defaults;
+    if (persistent_data[OFFSET_VERSION] == PERSISTENT_DATA_VERSION  ||
+            persistent_data[OFFSET_VERSION] == 1) {
+        ptr = persistent_data;
     }
     else {
-        ptr = persistent_data;
+        ptr = defaults;
     }
 
     channel[ST].reversed = ptr[OFFSET_STEERING_REVERSED];
@@ -57,13 +106,31 @@ void load_persistent_storage(void)
     servo_output_endpoint.left = ptr[OFFSET_SERVO_LEFT];
     servo_output_endpoint.centre = ptr[OFFSET_SERVO_CENTRE];
     servo_output_endpoint.right = ptr[OFFSET_SERVO_RIGHT];
+    update_servo_output_scale();
+}
+
+
+// ****************************************************************************
+static bool execute_iap_command(unsigned int *param)
+{
+    unsigned int command = param[0];
+
+    __disable_irq();
+    iap_entry(param, param);
+    __enable_irq();
+
+    if (param[0] != 0) {
+        log_event(EVENT_FLASH_ERROR, (command << 8) | param[0]);
+        return false;
+    }
+    return true;
 }
 
 
 // ****************************************************************************
 void write_persistent_storage(void)
 {
-    uint32_t new_data[6];
+    uint32_t new_data[NUMBER_OF_PERSISTENT_ELEMENTS];
     unsigned int param[5];
     int i;
 
@@ -73,20 +140,21 @@ void write_persistent_storage(void)
     new_data[OFFSET_SERVO_LEFT] = servo_output_endpoint.left;
     new_data[OFFSET_SERVO_CENTRE] = servo_output_endpoint.centre;
     new_data[OFFSET_SERVO_RIGHT] = servo_output_endpoint.right;
+    new_data[OFFSET_CALIBRATED] = global_flags.calibrated;
+    for (i = 0; i < 3; i++) {
+        new_data[OFFSET_ENDPOINTS + (3 * i)] = channel[i].endpoint.left;
+        new_data[OFFSET_ENDPOINTS + (3 * i) + 1] = channel[i].endpoint.centre;
+        new_data[OFFSET_ENDPOINTS + (3 * i) + 2] = channel[i].endpoint.right;
+    }
 
-    for (i = 0; i < 6; i++) {
-        if (new_data[0] != persistent_data[0]) {
+    // Only write if anything changed
+    for (i = 0; i < NUMBER_OF_PERSISTENT_ELEMENTS; i++) {
+        if (new_data[i] != persistent_data[i]) {
 
             param[0] = 50;
             param[1] = ((unsigned int)persistent_data) >> 10;
             param[2] = ((unsigned int)persistent_data) >> 10;
-            __disable_irq();
-            iap_entry(param, param);
-            __enable_irq();
-            if (param[0] != 0) {
-                if (diagnostics_enabled()) {
-                    uart0_send_cstring("ERROR: prepare sector failed\n");
-                }
+            if (!execute_iap_command(param)) {
                 break;
             }
 
@@ -94,26 +162,14 @@ void write_persistent_storage(void)
             param[1] = ((unsigned int)persistent_data) >> 6;
             param[2] = ((unsigned int)persistent_data) >> 6;
             param[3] = __SYSTEM_CLOCK / 1000;
-            __disable_irq();
-            iap_entry(param, param);
-            __enable_irq();
-            if (param[0] != 0) {
-                if (diagnostics_enabled()) {
-                    uart0_send_cstring("ERROR: erase page failed\n");
-                }
+            if (!execute_iap_command(param)) {
                 break;
             }
 
             param[0] = 50;
             param[1] = ((unsigned int)persistent_data) >> 10;
             param[2] = ((unsigned int)persistent_data) >> 10;
-            __disable_irq();
-            iap_entry(param, param);
-            __enable_irq();
-            if (param[0] != 0) {
-                if (diagnostics_enabled()) {
-                    uart0_send_cstring("ERROR: prepare sector failed\n");
-                }
+            if (!execute_iap_command(param)) {
                 break;
             }
 
@@ -122,15 +178,7 @@ void write_persistent_storage(void)
             param[2] = (unsigned int)new_data;
             param[3] = 64;
             param[4] = __SYSTEM_CLOCK / 1000;
-            __disable_irq();
-            iap_entry(param, param);
-            __enable_irq();
-            if (param[0] != 0) {
-                if (diagnostics_enabled()) {
-                    uart0_send_cstring("ERROR: copy RAM to flash failed\n");
-                }
-                break;
-            }
+            execute_iap_command(param);
 
             break;
         }
@@ -9,28 +9,103 @@
     There is also a flag sent out that indicates when the preprocessor is
     initializing and reading the 0-position of steering and throttle.
 
+    With the preprocessor_protocol_v2 flag a v2 frame is sent instead:
+
+        PREPROCESSOR_MAGIC_BYTE_V2
+        sequence number (bits 5..0)
+        flags: bit 0 = CH3 (0 or 1), bit 4 = initializing
+        ST + 512, bits 6..0
+        ST + 512, bits 9..7
+        TH + 512, bits 6..0
+        TH + 512, bits 9..7
+        CH3 + 512, bits 6..0
+        CH3 + 512, bits 9..7
+        CRC-8 bits 7..4
+        CRC-8 bits 3..0
+
+    ST, TH and CH3 are the normalized_fine values (-500..0..500, i.e. -100 %
+    to +100 % in 0.2 % steps). CH3 is sent as analog value in addition to
+    the 2-position flag. The CRC-8 covers all bytes between the magic byte and
+    the CRC. All bytes except the magic byte are below 0x80, so the magic byte
+    always marks the start of a frame.
+
+    Both versions are queued as a single burst per frame.
+
 ******************************************************************************/
 #include <stdint.h>
 
 #include <globals.h>
 #include <uart0.h>
+#include <utils.h>
 
 #define SLAVE_MAGIC_BYTE 0x87
+#define PREPROCESSOR_MAGIC_BYTE_V2 0x86
 #define CH3_HYSTERESIS 5
 
+#define PREPROCESSOR_V2_FRAME_SIZE 11
+
 static bool ch3_2pos = false;
-static uint8_t tx_data[4];
-static uint8_t next_tx_index = 0xff;
+static uint8_t tx_data[PREPROCESSOR_V2_FRAME_SIZE];
+
+
+// ****************************************************************************
+static void encode_channel(uint8_t *data, const CHANNEL_T *c)
+{
+    uint16_t value;
+
+    value = c->normalized_fine + 512;
+    data[0] = value & 0x7f;
+    data[1] = (value >> 7) & 0x07;
+}
+
+
+// ****************************************************************************
+static uint8_t build_v1_frame(uint8_t flags)
+{
+    tx_data[0] = SLAVE_MAGIC_BYTE;
+    tx_data[1] = channel[ST].normalized;
+    tx_data[2] = channel[TH].normalized;
+    tx_data[3] = flags;
+
+    return 4;
+}
+
+
+// ****************************************************************************
+static uint8_t build_v2_frame(uint8_t flags)
+{
+    static uint8_t sequence = 0;
+    uint8_t crc;
+
+    tx_data[0] = PREPROCESSOR_MAGIC_BYTE_V2;
+    tx_data[1] = sequence;
+    tx_data[2] = flags;
+    encode_channel(&tx_data[3], &channel[ST]);
+    encode_channel(&tx_data[5], &channel[TH]);
+    encode_channel(&tx_data[7], &channel[CH3]);
+
+    crc = crc8(&tx_data[1], 8);
+    tx_data[9] = crc >> 4;
+    tx_data[10] = crc & 0x0f;
+
+    sequence = (sequence + 1) & 0x3f;
+
+    return PREPROCESSOR_V2_FRAME_SIZE;
+}
 
 
 // ****************************************************************************
 void output_preprocessor(void)
 {
+    unsigned int i;
+    uint8_t flags;
+    uint8_t length;
+
     if (!config.flags.preprocessor_output) {
         return;
     }
 
-    if (!global_flags.new_channel_data) {
+    if (global_flags.new_channel_data) {
         if (ch3_2pos) {
             if (channel[2].normalized < -CH3_HYSTERESIS) {
                 ch3_2pos = false;
@@ -42,17 +117,23 @@ void output_preprocessor(void)
             }
         }
 
-        tx_data[0] = SLAVE_MAGIC_BYTE;
-        tx_data[1] = channel[ST].normalized;
-        tx_data[2] = channel[TH].normalized;
-        tx_data[3] = (ch3_2pos ? (1 << 0) : 0) |
-                     (global_flags.initializing ? (1 << 4) : 0);
+        flags = (ch3_2pos ? (1 << 0) : 0) |
+                (global_flags.initializing ? (1 << 4) : 0);
 
-        next_tx_index = 0;
-    }
+        if (config.flags.preprocessor_protocol_v2) {
+            length = build_v2_frame(flags);
+        }
+        else {
+            length = build_v1_frame(flags);
+        }
 
-    if (next_tx_index < sizeof(tx_data)  &&  uart0_send_is_ready()) {
-        uart0_send_char(tx_data[next_tx_index++]);
+        // Queue the whole frame in the UART transmit ring, or skip it if
+        // it does not fit so that the receiver never gets a partial frame.
+        if (uart0_send_space() >= length) {
+            for (i = 0; i < length; i++) {
+                uart0_send_char(tx_data[i]);
+            }
+        }
     }
 }
 
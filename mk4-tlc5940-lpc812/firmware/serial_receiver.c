@@ -0,0 +1,229 @@
+/******************************************************************************
+
+    This module reads the channels of receivers with a digital serial output,
+    connected to the ST/Rx pin.
+
+    SBUS (MASTER_WITH_SBUS_READER):
+        100000 baud, 8 data bits, even parity, 2 stop bits, inverted.
+        The USART of the LPC812 can not invert its input, so the IOCON INV
+        bit of the pin is used instead.
+
+        Frames are 25 bytes, sent every 7 or 14 ms:
+
+            0x0f
+            16 channels of 11 bits, LSB first (22 bytes)
+            flags: bit 2 = frame lost, bit 3 = failsafe
+            0x00 (SBUS2 sends 0x04, 0x14, 0x24 or 0x34)
+
+        Channel values are 172..992..1811 for 988..1500..2012 us.
+
+    iBUS (MASTER_WITH_IBUS_READER):
+        115200 baud, 8n1.
+
+        Frames are 32 bytes, sent every 7 ms:
+
+            0x20 (frame length)
+            0x40 (command)
+            14 channels in us, uint16_t little endian
+            checksum: 0xffff minus the sum of the first 30 bytes, uint16_t
+                little endian
+
+    Channels 1, 2 and 3 are used for ST, TH and CH3. The pulse widths are
+    handed to the servo reader, so neutral detection, endpoint learning and
+    channel reversing work as with servo inputs.
+
+    The frame start is found by its header. If a complete frame fails the
+    footer or checksum test the first byte is dropped and the next header
+    within the received bytes is used. Since an SBUS header and footer can
+    also appear within the channel data, a frame is only published if the
+    previous frame was valid too and directly followed by it. After losing
+    synchronization the first valid frame is therefore discarded.
+
+    Frames with the SBUS failsafe or frame lost flag set are not published;
+    the no-signal handling takes over if they persist.
+
+******************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <LPC8xx.h>
+
+#include <globals.h>
+#include <uart0.h>
+
+
+#define SBUS_FRAME_LENGTH 25
+#define SBUS_HEADER 0x0f
+#define SBUS_FLAG_FRAME_LOST (1 << 2)
+#define SBUS_FLAG_FAILSAFE (1 << 3)
+
+#define IBUS_FRAME_LENGTH 32
+#define IBUS_HEADER_LENGTH 0x20
+#define IBUS_HEADER_COMMAND 0x40
+
+#define IOCON_INV (1 << 6)
+
+
+static uint8_t frame[IBUS_FRAME_LENGTH];
+static int received = 0;
+static bool synchronized = false;
+
+
+// ****************************************************************************
+void init_serial_receiver(void)
+{
+    if (operating_mode != MASTER_WITH_SBUS_READER  &&
+        operating_mode != MASTER_WITH_IBUS_READER) {
+        return;
+    }
+
+    global_flags.initializing = 1;
+
+    if (operating_mode == MASTER_WITH_SBUS_READER) {
+        LPC_IOCON->PIO0_0 |= IOCON_INV;     // ST/Rx
+    }
+}
+
+
+// ****************************************************************************
+static int get_frame_length(void)
+{
+    if (operating_mode == MASTER_WITH_SBUS_READER) {
+        return SBUS_FRAME_LENGTH;
+    }
+    return IBUS_FRAME_LENGTH;
+}
+
+
+// ****************************************************************************
+// Returns true if the bytes received so far can be the start of a frame
+// ****************************************************************************
+static bool is_frame_start(void)
+{
+    if (operating_mode == MASTER_WITH_SBUS_READER) {
+        return frame[0] == SBUS_HEADER;
+    }
+
+    if (frame[0] != IBUS_HEADER_LENGTH) {
+        return false;
+    }
+    return (received < 2)  ||  (frame[1] == IBUS_HEADER_COMMAND);
+}
+
+
+// ****************************************************************************
+// Drop the first received byte and search for the next frame start
+// ****************************************************************************
+static void resynchronize(void)
+{
+    int i;
+
+    synchronized = false;
+
+    do {
+        --received;
+        for (i = 0; i < received; i++) {
+            frame[i] = frame[i + 1];
+        }
+    } while (received > 0  &&  !is_frame_start());
+}
+
+
+// ****************************************************************************
+// SBUS values to us: 172 -> 988 us, 992 -> 1500 us, 1811 -> 2012 us
+// ****************************************************************************
+static uint16_t sbus_to_us(uint16_t value)
+{
+    return ((value * 5) >> 3) + 880;
+}
+
+
+// ****************************************************************************
+static bool decode_sbus(uint16_t pulse[3])
+{
+    uint8_t footer = frame[SBUS_FRAME_LENGTH - 1];
+
+    if (footer != 0x00  &&  (footer & 0x0f) != 0x04) {
+        return false;
+    }
+
+    if (frame[23] & (SBUS_FLAG_FRAME_LOST | SBUS_FLAG_FAILSAFE)) {
+        // Valid frame, but no channel data to publish
+        pulse[0] = 0;
+        return true;
+    }
+
+    pulse[0] = sbus_to_us((frame[1] | (frame[2] << 8)) & 0x7ff);
+    pulse[1] = sbus_to_us(((frame[2] >> 3) | (frame[3] << 5)) & 0x7ff);
+    pulse[2] = sbus_to_us(((frame[3] >> 6) | (frame[4] << 2) |
+        (frame[5] << 10)) & 0x7ff);
+
+    return true;
+}
+
+
+// ****************************************************************************
+static bool decode_ibus(uint16_t pulse[3])
+{
+    uint16_t sum = 0;
+    int i;
+
+    for (i = 0; i < IBUS_FRAME_LENGTH - 2; i++) {
+        sum += frame[i];
+    }
+
+    if ((uint16_t)(0xffff - sum) !=
+            (frame[IBUS_FRAME_LENGTH - 2] |
+                (frame[IBUS_FRAME_LENGTH - 1] << 8))) {
+        return false;
+    }
+
+    for (i = 0; i < 3; i++) {
+        pulse[i] = (frame[2 + (2 * i)] | (frame[3 + (2 * i)] << 8)) & 0x0fff;
+    }
+
+    return true;
+}
+
+
+// ****************************************************************************
+void read_serial_receiver(void)
+{
+    uint16_t pulse[3];
+    bool valid;
+
+    if (operating_mode != MASTER_WITH_SBUS_READER  &&
+        operating_mode != MASTER_WITH_IBUS_READER) {
+        return;
+    }
+
+    while (uart0_read_is_byte_pending()) {
+        frame[received++] = uart0_read_byte();
+
+        if (!is_frame_start()) {
+            resynchronize();
+            continue;
+        }
+
+        if (received < get_frame_length()) {
+            continue;
+        }
+
+        if (operating_mode == MASTER_WITH_SBUS_READER) {
+            valid = decode_sbus(pulse);
+        }
+        else {
+            valid = decode_ibus(pulse);
+        }
+
+        if (!valid) {
+            resynchronize();
+            continue;
+        }
+
+        received = 0;
+        if (synchronized  &&  pulse[0]) {
+            publish_servo_pulses(pulse);
+        }
+        synchronized = true;
+    }
+}
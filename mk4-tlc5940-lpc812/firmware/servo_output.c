@@ -6,6 +6,8 @@
 #include <LPC8xx.h>
 #include <globals.h>
 
+#define SCALE_SHIFT 16
+
 static bool next = false;
 static uint16_t servo_pulse;
 
@@ -15,6 +17,10 @@ static bool gearbox_servo_active;
 static SERVO_ENDPOINTS_T servo_setup_endpoint;
 SERVO_ENDPOINTS_T servo_output_endpoint;
 
+// (endpoint - centre) * 2^SCALE_SHIFT / 100, see calculate_servo_pulse()
+static int32_t scale_left;
+static int32_t scale_right;
+
 
 // ****************************************************************************
 static bool servo_output_disabled(void)
@@ -134,6 +140,7 @@ void servo_output_setup_action(uint8_t ch3_clicks)
         servo_output_endpoint.left = 900;
         servo_output_endpoint.centre = 1500;
         servo_output_endpoint.right = 2100;
+        update_servo_output_scale();
         global_flags.servo_output_setup = SERVO_OUTPUT_SETUP_LEFT;
     }
     else {
@@ -159,25 +166,59 @@ void servo_output_setup_action(uint8_t ch3_clicks)
           -------------------------------- + centre
                     100
 
-    To ease calculation we first do right - centre, then calculate its absolute
-    value but store the sign. After multiplication and division using the
-    absolute value we re-apply the sign, then add centre.
+    The LPC812 has no hardware divider, so the division by 100 is folded into
+    scale_left and scale_right, which update_servo_output_scale() calculates
+    whenever the endpoints change:
+
+        scale = ceil(abs(right - centre) * 2^SCALE_SHIFT / 100)
+
+    abs(steering) * scale >> SCALE_SHIFT then equals the truncated division as
+    long as 100 * abs(steering) < 2^SCALE_SHIFT. The sign of the span (the
+    servo may be reversed) is re-applied afterwards, then centre is added.
 
     Note: this function is needed by Process_servo_setup, so it can't be
     removed e.g. if only a gearbox servo is used.
 
 ******************************************************************************/
+static int32_t scale(int32_t factor, uint16_t value)
+{
+    if (factor < 0) {
+        return -(int32_t)(((uint32_t)-factor * value) >> SCALE_SHIFT);
+    }
+    return ((uint32_t)factor * value) >> SCALE_SHIFT;
+}
+
+
+// ****************************************************************************
+static int32_t calculate_scale(int span)
+{
+    uint32_t magnitude = (span < 0) ? -span : span;
+
+    magnitude = ((magnitude << SCALE_SHIFT) + 99) / 100;
+    return (span < 0) ? -(int32_t)magnitude : (int32_t)magnitude;
+}
+
+
+// ****************************************************************************
+void update_servo_output_scale(void)
+{
+    scale_left = calculate_scale(
+        servo_output_endpoint.left - servo_output_endpoint.centre);
+    scale_right = calculate_scale(
+        servo_output_endpoint.right - servo_output_endpoint.centre);
+}
+
+
+// ****************************************************************************
 static void calculate_servo_pulse(void)
 {
     if (channel[ST].normalized < 0) {
-        servo_pulse = servo_output_endpoint.centre -
-            (((servo_output_endpoint.centre - servo_output_endpoint.left) *
-                channel[ST].absolute) / 100);
+        servo_pulse = servo_output_endpoint.centre +
+            scale(scale_left, channel[ST].absolute);
     }
     else {
         servo_pulse = servo_output_endpoint.centre +
-            (((servo_output_endpoint.right - servo_output_endpoint.centre) *
-                channel[ST].absolute) / 100);
+            scale(scale_right, channel[ST].absolute);
     }
 }
 
@@ -211,6 +252,7 @@ void process_servo_output(void)
                             config.number_of_gears == 2) {
                         servo_output_endpoint.centre = servo_setup_endpoint.centre;
                         servo_output_endpoint.left = servo_setup_endpoint.left;
+                        update_servo_output_scale();
                         write_persistent_storage();
 
                         global_flags.servo_output_setup = SERVO_OUTPUT_SETUP_OFF;
@@ -226,6 +268,7 @@ void process_servo_output(void)
                     servo_output_endpoint.right = servo_setup_endpoint.right;
                     servo_output_endpoint.centre = servo_setup_endpoint.centre;
                     servo_output_endpoint.left = servo_setup_endpoint.left;
+                    update_servo_output_scale();
                     write_persistent_storage();
 
                     global_flags.servo_output_setup = SERVO_OUTPUT_SETUP_OFF;
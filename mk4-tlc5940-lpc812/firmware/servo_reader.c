@@ -8,6 +8,10 @@
 
     It populates the global channel[] array with the read data.
 
+    Serial receivers (SBUS, iBUS) are decoded in serial_receiver.c, which
+    hands the pulse widths to publish_servo_pulses(). From there on they are
+    processed like servo pulses.
+
 
     Internal operation for reading servo pulses:
     --------------------------------------------
@@ -20,9 +24,11 @@
     When an edge is detected the value is retrieved from the capture register
     and stored in a holding place. The edge of the capture block is toggled.
 
-    When a falling edge is detected we calculate the difference (taking
-    overflow into account) and store it in a result registers (raw_data, one
-    per channel).
+    When a falling edge is detected we calculate the difference and store
+    it in a result registers (raw_data, one per channel). Counter L runs
+    freely over the full 16 bit range (32.8 ms), so the unsigned 16 bit
+    difference of two captures is correct even if the counter wrapped in
+    between; no software compensation is needed.
 
     In order to be able to be able to handle missing channels we do the
     following:
@@ -45,6 +51,20 @@
     of the output, but it is very robust for use in the pre-processor.
 
 
+    Low-latency mode for reading servo pulses:
+    ------------------------------------------
+    With the servo_reader_low_latency flag set each channel is published
+    as soon as its falling edge is captured, removing the one frame delay.
+    Throttle changes, and therefore brake and reverse lights, are processed
+    up to one frame (about 20 ms) sooner.
+
+    Every published channel gets a freshness timestamp (in systicks). A
+    channel that has not been published for SERVO_CHANNEL_TIMEOUT is
+    considered missing and its raw_data is set to 0, like the frame based
+    algorithm does. If all channels go missing no data is published at all
+    and the no-signal handling takes over.
+
+
     Internal operation for reading CPPM:
     ------------------------------------
     The SCTimer in 16-bit mode is utilized.
@@ -61,13 +81,105 @@
     we set our state-machine so that the next edge is stored as CH1, then
     the next as CH2, and one more edge as CH3. After we received all
     3 channels we update the rest of the light controller with the new
-    data and setup the CPPM reader to wait for a frame sync signal (= >2/5ms
-    between interrupts). Smaller pulses (i.e. because the receiver outputs
-    more than 3 channles) are ignored.
+    data right away.
+
+    The following pulses are stored as CH4 up to CH8 (CPPM_MAX_CHANNELS)
+    in extra_channel[]. They are published when CH8 has been received or
+    when the frame sync signal (= >2.5ms between interrupts) arrives, so
+    receivers with fewer channels work too; the channels not received are
+    set to 0 (missing). Pulses beyond CH8 are ignored.
 
     In case the receiver outputs less than 3 channels, the frame detection
     function outputs the channels that have been received so far.
 
+    The extra channels are meant for transmitter switches driving light
+    programs. They are normalized to -100..0..100 % for the nominal
+    1000..1500..2000 us, without endpoint learning or reversing. A channel
+    is "active" for the RUN_WHEN_CH4..RUN_WHEN_CH8 run conditions above
+    EXTRA_CHANNEL_ON %, and inactive again below EXTRA_CHANNEL_OFF %.
+    If no CPPM frame arrives for EXTRA_CHANNEL_TIMEOUT, or the light
+    controller has no signal, the extra channels are set to 0 % and
+    inactive, so light programs do not run on stale switch positions.
+
+
+    Pulse filter and signal quality:
+    --------------------------------
+    Receivers jitter by a few us, which is enough to move the throttle across
+    centre_threshold_low/high and make the brake and reverse lights flicker.
+    Every received pulse can therefore pass through a filter before it is
+    normalized, selected by config.servo_filter. The filter adds latency, so
+    it is off by default:
+
+        0   no filter (default)
+        1   median of the last 3 pulses; removes single outliers, delays
+            steps by one frame
+        2   median of 3, then exponential filter with weight 1/2
+        3   median of 3, then exponential filter with weight 1/4
+        4   median of 3, then exponential filter with weight 1/8
+
+    The exponential filter keeps 4 fractional bits so that it settles
+    within 0.5 us of the input.
+
+    Missing (0) and out-of-range pulses are not filtered and restart the
+    filter. Unless built with NODEBUG they are counted per channel, together
+    with the largest change between two consecutive pulses (jitter, read it
+    with the sticks at rest). Once per second each channel logs
+    EVENT_SERVO_QUALITY (bits 31..24: channel, 23..16: jitter in us,
+    15..8: missing pulses, 7..0: out-of-range pulses; saturating at 255).
+
+
+    Stored calibration:
+    -------------------
+    Without a calibration the neutral position of steering and throttle is
+    sampled config.startup_time after the first pulse, and the endpoints
+    start at config.initial_endpoint_delta around it.
+
+    The endpoints of all channels (neutral and learned end points) are
+    therefore kept in persistent storage. They are saved
+    CALIBRATION_SAVE_DELAY after the startup procedure completed, and after
+    the last time the endpoints grew while driving, so that a slowly
+    widening stick throw only causes a single write to flash.
+    Writing to flash disables the interrupts for about 101 ms, during which
+    pulses are lost. The write is therefore deferred until the throttle has
+    been in neutral for CALIBRATION_SAVE_NEUTRAL_TIME.
+
+    When a stored calibration exists, steering and throttle of the first
+    CALIBRATION_FRAMES frames are compared with the stored neutral. If all
+    are within CALIBRATION_TOLERANCE the stored calibration is used right
+    away; otherwise (e.g. the trim was changed, or a stick is not at neutral)
+    the stored calibration is discarded and the startup procedure runs as
+    before.
+
+
+    Normalization:
+    --------------
+    The LPC812 has no hardware divider, so dividing by the endpoint span for
+    every channel and frame would call the division library routine six
+    times per frame. Instead the fixed-point reciprocals
+
+        ceil(2^RECIPROCAL_SHIFT * 101 / span) and
+        ceil(2^RECIPROCAL_SHIFT * 501 / span)
+
+    are calculated for both sides whenever the endpoints change, and the
+    normalized values are obtained with a multiplication and a shift.
+    As the pulse is always within the span (endpoints are learned first) the
+    result is identical to the division as long as pulse * span is below
+    2^RECIPROCAL_SHIFT, i.e. for spans up to 2896 us.
+
+
+    Interrupt load:
+    ---------------
+    Reading servo pulses takes two interrupts per channel and frame, CPPM
+    one per channel. Latching both edges of a pulse in hardware would need
+    two events and two capture registers per input; the SCTimer of the
+    LPC812 has only 6 events and 5 match/capture registers, and events 0, 4
+    and 5 are used by the servo and switched light outputs on counter H.
+
+    Unless built with NODEBUG the number of SCT interrupts and the average
+    number of clock cycles spent in the handler are logged once per second
+    as EVENT_SCT_IRQ_STATISTICS (bits 31..16: interrupts, bits 15..0:
+    average cycles per interrupt).
+
 
 ******************************************************************************/
 #include <stdio.h>
@@ -75,14 +187,35 @@
 #include <LPC8xx.h>
 
 #include <globals.h>
+#include <event_log.h>
 
 
 #define SERVO_PULSE_CLAMP_LOW 800
 #define SERVO_PULSE_CLAMP_HIGH 2300
 
+// A channel is missing in low-latency mode if it was not received for
+// longer than this (in systicks)
+#define SERVO_CHANNEL_TIMEOUT (100 / __SYSTICK_IN_MS)
+
+#define RECIPROCAL_SHIFT 23
+
+#define SERVO_FILTER_MAX 4
+
+#define EXTRA_CHANNEL_CENTRE 1500
+#define EXTRA_CHANNEL_ON 50
+#define EXTRA_CHANNEL_OFF 30
+#define EXTRA_CHANNEL_TIMEOUT (100 / __SYSTICK_IN_MS)
+#define FILTER_FRACTION_BITS 4
+
+#define CALIBRATION_FRAMES 3
+#define CALIBRATION_TOLERANCE 10
+#define CALIBRATION_SAVE_DELAY (5000 / __SYSTICK_IN_MS)
+#define CALIBRATION_SAVE_NEUTRAL_TIME (1000 / __SYSTICK_IN_MS)
+
 
 static enum {
     WAIT_FOR_FIRST_PULSE,
+    VERIFY_CALIBRATION,
     WAIT_FOR_TIMEOUT,
     NORMAL_OPERATION
 } servo_reader_state = WAIT_FOR_FIRST_PULSE;
@@ -92,18 +225,46 @@ typedef enum {
     WAIT_FOR_IDLE_PULSE,
     WAIT_FOR_CH1,
     WAIT_FOR_CH2,
-    WAIT_FOR_CH3
+    WAIT_FOR_CH3,
+    WAIT_FOR_EXTRA_CHANNEL
 } CPPM_STATE_T;
 
+typedef struct {
+    uint16_t history[2];        // Previous pulses, newest first
+    uint8_t samples;            // Number of valid pulses in history
+    uint32_t average;           // Exponential filter, FILTER_FRACTION_BITS
+#ifndef NODEBUG
+    uint16_t jitter;
+    uint16_t missing;
+    uint16_t out_of_range;
+#endif
+} PULSE_FILTER_T;
+
 static volatile bool new_raw_channel_data = false;
+static volatile bool new_extra_channel_data = false;
+static volatile uint8_t updated_channels;
 static uint32_t servo_reader_timer;
+static uint8_t calibration_frames;
+static uint16_t calibration_save_timer;
+static uint8_t extra_channel_timer;
+
+static PULSE_FILTER_T pulse_filter[3];
+
+// Low-latency mode: systick counter and the time each channel was received
+static volatile uint16_t servo_reader_ticks;
+static volatile uint16_t channel_timestamp[3];
+
+#ifndef NODEBUG
+static volatile uint16_t irq_count;
+static volatile uint32_t irq_cycles;
+#endif
 
 
 // ****************************************************************************
 void init_servo_reader(void)
 {
-    if (config.mode != MASTER_WITH_SERVO_READER  &&
-        config.mode != MASTER_WITH_CPPM_READER) {
+    if (operating_mode != MASTER_WITH_SERVO_READER  &&
+        operating_mode != MASTER_WITH_CPPM_READER) {
         return;
     }
 
@@ -121,7 +282,7 @@ void init_servo_reader(void)
                        (5 << 5);    // PRE_L[12:5] = 6-1 (SCTimer L clock 2 MHz)
 
 
-    if (config.mode == MASTER_WITH_SERVO_READER) {
+    if (operating_mode == MASTER_WITH_SERVO_READER) {
         int i;
 
         // Configure registers 1..3 to capture servo pulses on SCTimer L
@@ -170,8 +331,10 @@ static void output_raw_channels(uint16_t result[3])
 {
     channel[ST].raw_data = result[0] >> 1;
     channel[TH].raw_data = result[1] >> 1;
+    updated_channels = (1 << ST) | (1 << TH);
     if (!config.flags.ch3_is_local_switch) {
         channel[CH3].raw_data = result[2] >> 1;
+        updated_channels |= (1 << CH3);
     }
 
     result[0] = result[1] = result[2] = 0;
@@ -179,6 +342,54 @@ static void output_raw_channels(uint16_t result[3])
 }
 
 
+// ****************************************************************************
+// CPPM: publish CH4 and up. count is the number of channels received.
+// ****************************************************************************
+static void output_extra_channels(uint16_t result[EXTRA_CHANNELS], int count)
+{
+    int i;
+
+    for (i = 0; i < EXTRA_CHANNELS; i++) {
+        extra_channel[i].raw_data = (i < count) ? (result[i] >> 1) : 0;
+    }
+
+    new_extra_channel_data = true;
+}
+
+
+// ****************************************************************************
+// Low-latency mode: publish a single channel. pulse is in 0.5 us.
+// ****************************************************************************
+static void output_raw_channel(int index, uint16_t pulse)
+{
+    if (index != CH3  ||  !config.flags.ch3_is_local_switch) {
+        channel[index].raw_data = pulse >> 1;
+        updated_channels |= (1 << index);
+    }
+
+    channel_timestamp[index] = servo_reader_ticks;
+    new_raw_channel_data = true;
+}
+
+
+// ****************************************************************************
+// Pulse widths in us, decoded by another input module. A value of 0 marks a
+// missing channel.
+// ****************************************************************************
+void publish_servo_pulses(const uint16_t pulse[3])
+{
+    channel[ST].raw_data = pulse[0];
+    channel[TH].raw_data = pulse[1];
+    updated_channels = (1 << ST) | (1 << TH);
+    if (!config.flags.ch3_is_local_switch) {
+        channel[CH3].raw_data = pulse[2];
+        updated_channels |= (1 << CH3);
+    }
+
+    new_raw_channel_data = true;
+}
+
+
 // ****************************************************************************
 void SCT_irq_handler(void)
 {
@@ -186,8 +397,12 @@ void SCT_irq_handler(void)
     static uint16_t result[3] = {0, 0, 0};
     static uint8_t channel_flags = 0;
     uint16_t capture_value;
+#ifndef NODEBUG
+    uint32_t entry = SysTick->VAL;
+    uint32_t now;
+#endif
 
-    if (config.mode == MASTER_WITH_SERVO_READER) {
+    if (operating_mode == MASTER_WITH_SERVO_READER) {
         int i;
 
         for (i = 1; i <= 3; i++) {
@@ -199,19 +414,21 @@ void SCT_irq_handler(void)
                     // Rising edge triggered
                     start[i - 1] = capture_value;
 
-                    if (channel_flags & (1 << i)) {
-                        output_raw_channels(result);
-                        channel_flags = (1 << i);
+                    if (!config.flags.servo_reader_low_latency) {
+                        if (channel_flags & (1 << i)) {
+                            output_raw_channels(result);
+                            channel_flags = (1 << i);
+                        }
+                        channel_flags |= (1 << i);
                     }
-                    channel_flags |= (1 << i);
                 }
                 else {
                     // Falling edge triggered
-                    if (start[i - 1] > capture_value) {
-                        // Compensate for wrap-around
-                        capture_value += LPC_SCT->MATCHREL[0].L + 1;
+                    result[i - 1] = (uint16_t)(capture_value - start[i - 1]);
+
+                    if (config.flags.servo_reader_low_latency) {
+                        output_raw_channel(i - 1, result[i - 1]);
                     }
-                    result[i - 1] = capture_value - start[i - 1];
                 }
 
                 LPC_SCT->EVENT[i].CTRL ^= (0x3 << 10);   // IOCOND: toggle edge
@@ -222,13 +439,11 @@ void SCT_irq_handler(void)
 
     else { // MASTER_WITH_CPPM_READER
         static CPPM_STATE_T cppm_mode = WAIT_FOR_ANY_PULSE;
+        static uint16_t extra_result[EXTRA_CHANNELS];
+        static uint8_t extra_count;
 
-        start[1] = capture_value = LPC_SCT->CAP[1].L;
-        if (start[0] > capture_value) {
-            // Compensate for wrap-around
-            capture_value += LPC_SCT->MATCHREL[0].L + 1;
-        }
-        capture_value -= start[0];
+        start[1] = LPC_SCT->CAP[1].L;
+        capture_value = (uint16_t)(start[1] - start[0]);
         start[0] = start[1];
 
 
@@ -244,6 +459,10 @@ void SCT_irq_handler(void)
                 channel_flags = 0;
             }
 
+            if (cppm_mode == WAIT_FOR_EXTRA_CHANNEL) {
+                output_extra_channels(extra_result, extra_count);
+            }
+
             cppm_mode = WAIT_FOR_CH1;
         }
         else {
@@ -264,7 +483,16 @@ void SCT_irq_handler(void)
                     result[2] = capture_value;
                     output_raw_channels(result);
                     channel_flags = 0;
-                    cppm_mode = WAIT_FOR_IDLE_PULSE;
+                    extra_count = 0;
+                    cppm_mode = WAIT_FOR_EXTRA_CHANNEL;
+                    break;
+
+                case WAIT_FOR_EXTRA_CHANNEL:
+                    extra_result[extra_count++] = capture_value;
+                    if (extra_count >= EXTRA_CHANNELS) {
+                        output_extra_channels(extra_result, extra_count);
+                        cppm_mode = WAIT_FOR_IDLE_PULSE;
+                    }
                     break;
 
                 case WAIT_FOR_ANY_PULSE:
@@ -277,14 +505,129 @@ void SCT_irq_handler(void)
 
         LPC_SCT->EVFLAG = (1 << 1);
     }
+
+#ifndef NODEBUG
+    // SysTick counts down and reloads every systick
+    now = SysTick->VAL;
+    if (now > entry) {
+        entry += SysTick->LOAD + 1;
+    }
+    irq_cycles += entry - now;
+    ++irq_count;
+#endif
+}
+
+
+// ****************************************************************************
+static uint16_t median3(uint16_t a, uint16_t b, uint16_t c)
+{
+    uint16_t low = MIN(a, b);
+    uint16_t high = MAX(a, b);
+
+    return MAX(low, MIN(high, c));
+}
+
+
+// ****************************************************************************
+// Apply config.servo_filter to a newly received pulse in c->raw_data
+// ****************************************************************************
+static void filter_pulse(CHANNEL_T *c, PULSE_FILTER_T *f)
+{
+    uint16_t pulse = c->raw_data;
+    uint16_t result = pulse;
+    uint32_t target;
+    uint8_t shift;
+
+    if (pulse < config.servo_pulse_min  ||  pulse > config.servo_pulse_max) {
+#ifndef NODEBUG
+        if (pulse == 0) {
+            ++f->missing;
+        }
+        else {
+            ++f->out_of_range;
+        }
+#endif
+        f->samples = 0;
+        return;
+    }
+
+#ifndef NODEBUG
+    if (f->samples) {
+        uint16_t delta = (pulse > f->history[0]) ?
+            pulse - f->history[0] : f->history[0] - pulse;
+
+        f->jitter = MAX(f->jitter, delta);
+    }
+#endif
+
+    if (f->samples >= 2) {
+        result = median3(pulse, f->history[0], f->history[1]);
+    }
+    f->history[1] = f->history[0];
+    f->history[0] = pulse;
+
+    if (config.servo_filter >= 2) {
+        target = (uint32_t)result << FILTER_FRACTION_BITS;
+
+        if (f->samples == 0) {
+            f->average = target;
+        }
+        else {
+            shift = MIN(config.servo_filter, SERVO_FILTER_MAX) - 1;
+            if (target > f->average) {
+                f->average += (target - f->average) >> shift;
+            }
+            else {
+                f->average -= (f->average - target) >> shift;
+            }
+        }
+
+        result = (f->average + (1 << (FILTER_FRACTION_BITS - 1))) >>
+            FILTER_FRACTION_BITS;
+    }
+
+    if (f->samples < 2) {
+        ++f->samples;
+    }
+
+    if (config.servo_filter) {
+        c->raw_data = result;
+    }
+}
+
+
+// ****************************************************************************
+static uint32_t reciprocal(int span, uint32_t factor)
+{
+    if (span <= 0) {
+        return 0;
+    }
+
+    return ((factor << RECIPROCAL_SHIFT) + span - 1) / span;
+}
+
+
+// ****************************************************************************
+static void update_reciprocals(CHANNEL_T *c)
+{
+    int left = c->endpoint.centre - c->endpoint.left;
+    int right = c->endpoint.right - c->endpoint.centre;
+
+    c->reciprocal_left = reciprocal(left, 101);
+    c->reciprocal_right = reciprocal(right, 101);
+    c->reciprocal_left_fine = reciprocal(left, 501);
+    c->reciprocal_right_fine = reciprocal(right, 501);
 }
 
 
 // ****************************************************************************
 static void normalize_channel(CHANNEL_T *c)
 {
+    uint32_t delta;
+
     if (c->raw_data < config.servo_pulse_min  ||  c->raw_data > config.servo_pulse_max) {
         c->normalized = 0;
+        c->normalized_fine = 0;
         c->absolute = 0;
         return;
     }
@@ -299,33 +642,50 @@ static void normalize_channel(CHANNEL_T *c)
 
     if (c->raw_data == c->endpoint.centre) {
         c->normalized = 0;
+        c->normalized_fine = 0;
     }
     else if (c->raw_data < c->endpoint.centre) {
         if (c->raw_data < c->endpoint.left) {
             c->endpoint.left = c->raw_data;
+            update_reciprocals(c);
+            calibration_save_timer = CALIBRATION_SAVE_DELAY;
         }
         // In order to acheive a stable 100% value we actually calculate the
         // percentage up to 101%, and then clamp to 100%.
-        c->normalized = (c->endpoint.centre - c->raw_data) * 101 /
-            (c->endpoint.centre - c->endpoint.left);
+        delta = c->endpoint.centre - c->raw_data;
+        c->normalized = (delta * c->reciprocal_left) >> RECIPROCAL_SHIFT;
         if (c->normalized > 100) {
             c->normalized = 100;
         }
+        c->normalized_fine =
+            (delta * c->reciprocal_left_fine) >> RECIPROCAL_SHIFT;
+        if (c->normalized_fine > 500) {
+            c->normalized_fine = 500;
+        }
         if (!c->reversed) {
             c->normalized = -c->normalized;
+            c->normalized_fine = -c->normalized_fine;
         }
     }
     else {
         if (c->raw_data > c->endpoint.right) {
             c->endpoint.right = c->raw_data;
+            update_reciprocals(c);
+            calibration_save_timer = CALIBRATION_SAVE_DELAY;
         }
-        c->normalized = (c->raw_data - c->endpoint.centre) * 101 /
-            (c->endpoint.right - c->endpoint.centre);
+        delta = c->raw_data - c->endpoint.centre;
+        c->normalized = (delta * c->reciprocal_right) >> RECIPROCAL_SHIFT;
         if (c->normalized > 100) {
             c->normalized = 100;
         }
+        c->normalized_fine =
+            (delta * c->reciprocal_right_fine) >> RECIPROCAL_SHIFT;
+        if (c->normalized_fine > 500) {
+            c->normalized_fine = 500;
+        }
         if (c->reversed) {
             c->normalized = -c->normalized;
+            c->normalized_fine = -c->normalized_fine;
         }
     }
 
@@ -338,19 +698,201 @@ static void normalize_channel(CHANNEL_T *c)
 }
 
 
+// ****************************************************************************
+static void normalize_extra_channel(EXTRA_CHANNEL_T *c)
+{
+    uint16_t delta;
+    int16_t normalized;
+
+    if (c->raw_data < config.servo_pulse_min  ||  c->raw_data > config.servo_pulse_max) {
+        c->normalized = 0;
+        c->active = false;
+        return;
+    }
+
+    // 5 us per %; 13108 / 2^16 is 1/5 with sufficient precision for pulses
+    // up to 16 ms
+    if (c->raw_data < EXTRA_CHANNEL_CENTRE) {
+        delta = EXTRA_CHANNEL_CENTRE - c->raw_data;
+        normalized = -(int16_t)MIN((delta * 13108UL) >> 16, 100);
+    }
+    else {
+        delta = c->raw_data - EXTRA_CHANNEL_CENTRE;
+        normalized = MIN((delta * 13108UL) >> 16, 100);
+    }
+    c->normalized = normalized;
+
+    if (normalized > EXTRA_CHANNEL_ON) {
+        c->active = true;
+    }
+    else if (normalized < EXTRA_CHANNEL_OFF) {
+        c->active = false;
+    }
+}
+
+
+// ****************************************************************************
+// Set all extra channels to 0 % and inactive, e.g. when the signal is lost
+// ****************************************************************************
+static void clear_extra_channels(void)
+{
+    int i;
+
+    for (i = 0; i < EXTRA_CHANNELS; i++) {
+        extra_channel[i].normalized = 0;
+        extra_channel[i].active = false;
+    }
+}
+
+
 // ****************************************************************************
 static void initialize_channel(CHANNEL_T *c) {
     c->endpoint.centre = c->raw_data;
     c->endpoint.left = c->raw_data - config.initial_endpoint_delta;
     c->endpoint.right = c->raw_data + config.initial_endpoint_delta;
+    update_reciprocals(c);
+}
+
+
+// ****************************************************************************
+// Returns true if the pulse is within CALIBRATION_TOLERANCE of the stored
+// neutral position. Missing channels (0) never match.
+// ****************************************************************************
+static bool is_at_stored_centre(const CHANNEL_T *c)
+{
+    if (c->raw_data > c->endpoint.centre) {
+        return (c->raw_data - c->endpoint.centre) <= CALIBRATION_TOLERANCE;
+    }
+    return (c->endpoint.centre - c->raw_data) <= CALIBRATION_TOLERANCE;
+}
+
+
+// ****************************************************************************
+static void save_calibration(void)
+{
+    static uint8_t neutral_time;
+
+    if (channel[TH].absolute >= config.centre_threshold_low) {
+        neutral_time = 0;
+    }
+    else if (neutral_time < CALIBRATION_SAVE_NEUTRAL_TIME) {
+        ++neutral_time;
+    }
+
+    if (!calibration_save_timer) {
+        return;
+    }
+
+    if (calibration_save_timer > 1) {
+        --calibration_save_timer;
+        return;
+    }
+
+    if (neutral_time >= CALIBRATION_SAVE_NEUTRAL_TIME) {
+        calibration_save_timer = 0;
+        write_persistent_storage();
+    }
+}
+
+
+#ifndef NODEBUG
+// ****************************************************************************
+static void report_irq_statistics(void)
+{
+    uint16_t count;
+    uint32_t cycles;
+
+    __disable_irq();
+    count = irq_count;
+    cycles = irq_cycles;
+    irq_count = 0;
+    irq_cycles = 0;
+    __enable_irq();
+
+    if (count) {
+        cycles /= count;
+    }
+
+    log_event(EVENT_SCT_IRQ_STATISTICS,
+        ((uint32_t)count << 16) | MIN(cycles, 0xffff));
+}
+
+
+// ****************************************************************************
+static void report_signal_quality(void)
+{
+    uint32_t i;
+    PULSE_FILTER_T *f;
+
+    for (i = 0; i < 3; i++) {
+        f = &pulse_filter[i];
+
+        log_event(EVENT_SERVO_QUALITY, (i << 24) |
+            ((uint32_t)MIN(f->jitter, 0xff) << 16) |
+            ((uint32_t)MIN(f->missing, 0xff) << 8) |
+            MIN(f->out_of_range, 0xff));
+
+        f->jitter = 0;
+        f->missing = 0;
+        f->out_of_range = 0;
+    }
+}
+
+
+// ****************************************************************************
+static void report_statistics(void)
+{
+    static uint8_t systicks = 0;
+
+    if (++systicks < (1000 / __SYSTICK_IN_MS)) {
+        return;
+    }
+    systicks = 0;
+
+    if (operating_mode == MASTER_WITH_SERVO_READER  ||
+            operating_mode == MASTER_WITH_CPPM_READER) {
+        report_irq_statistics();
+    }
+    report_signal_quality();
+}
+#endif
+
+
+// ****************************************************************************
+// Low-latency mode: set channels that have not been received for
+// SERVO_CHANNEL_TIMEOUT to 0, i.e. missing
+// ****************************************************************************
+static void expire_missing_channels(void)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        if (i == CH3  &&  config.flags.ch3_is_local_switch) {
+            continue;
+        }
+
+        // Prevent the SCT interrupt from publishing the channel between
+        // the check and clearing raw_data
+        __disable_irq();
+        if ((uint16_t)(servo_reader_ticks - channel_timestamp[i]) >
+                SERVO_CHANNEL_TIMEOUT) {
+            channel[i].raw_data = 0;
+        }
+        __enable_irq();
+    }
 }
 
 
 // ****************************************************************************
 void read_all_servo_channels(void)
 {
-    if (config.mode != MASTER_WITH_SERVO_READER  &&
-        config.mode != MASTER_WITH_CPPM_READER) {
+    uint8_t updated;
+    int i;
+
+    if (operating_mode != MASTER_WITH_SERVO_READER  &&
+        operating_mode != MASTER_WITH_CPPM_READER  &&
+        operating_mode != MASTER_WITH_SBUS_READER  &&
+        operating_mode != MASTER_WITH_IBUS_READER) {
         return;
     }
 
@@ -358,31 +900,111 @@ void read_all_servo_channels(void)
         if (servo_reader_timer) {
             --servo_reader_timer;
         }
+
+        if (servo_reader_state == NORMAL_OPERATION) {
+            save_calibration();
+        }
+
+        if (operating_mode == MASTER_WITH_SERVO_READER  &&
+                config.flags.servo_reader_low_latency) {
+            ++servo_reader_ticks;
+            expire_missing_channels();
+        }
+
+        if (extra_channel_timer) {
+            --extra_channel_timer;
+            if (extra_channel_timer == 0) {
+                clear_extra_channels();
+            }
+        }
+
+#ifndef NODEBUG
+        report_statistics();
+#endif
     }
 
     global_flags.new_channel_data = false;
+    global_flags.new_throttle_data = false;
+
+    if (new_extra_channel_data) {
+        new_extra_channel_data = false;
+        extra_channel_timer = EXTRA_CHANNEL_TIMEOUT;
+        for (i = 0; i < EXTRA_CHANNELS; i++) {
+            normalize_extra_channel(&extra_channel[i]);
+        }
+    }
+
+    if (global_flags.no_signal) {
+        clear_extra_channels();
+    }
 
     if (!new_raw_channel_data) {
         return;
     }
     new_raw_channel_data = false;
 
+    __disable_irq();
+    updated = updated_channels;
+    updated_channels = 0;
+    __enable_irq();
+
+    for (i = 0; i < 3; i++) {
+        if (updated & (1 << i)) {
+            filter_pulse(&channel[i], &pulse_filter[i]);
+        }
+    }
+
     switch (servo_reader_state) {
         case WAIT_FOR_FIRST_PULSE:
+            if (global_flags.calibrated) {
+                calibration_frames = 0;
+                servo_reader_state = VERIFY_CALIBRATION;
+                break;
+            }
             servo_reader_timer = config.startup_time;
             servo_reader_state = WAIT_FOR_TIMEOUT;
             break;
 
+        case VERIFY_CALIBRATION:
+            if (!is_at_stored_centre(&channel[ST])  ||
+                    !is_at_stored_centre(&channel[TH])) {
+                global_flags.calibrated = false;
+                servo_reader_timer = config.startup_time;
+                servo_reader_state = WAIT_FOR_TIMEOUT;
+            }
+            else if (++calibration_frames >= CALIBRATION_FRAMES) {
+                for (i = 0; i < 3; i++) {
+                    update_reciprocals(&channel[i]);
+                }
+                normalize_channel(&channel[ST]);
+                normalize_channel(&channel[TH]);
+                if (!config.flags.ch3_is_local_switch) {
+                    normalize_channel(&channel[CH3]);
+                }
+
+                servo_reader_state = NORMAL_OPERATION;
+                global_flags.initializing = 0;
+            }
+            global_flags.new_channel_data = true;
+            global_flags.new_throttle_data = (updated & (1 << TH)) != 0;
+            break;
+
         case WAIT_FOR_TIMEOUT:
             if (servo_reader_timer == 0) {
                 initialize_channel(&channel[ST]);
                 initialize_channel(&channel[TH]);
-                normalize_channel(&channel[CH3]);
+                update_reciprocals(&channel[CH3]);
+                if (!config.flags.ch3_is_local_switch) {
+                    normalize_channel(&channel[CH3]);
+                }
 
                 servo_reader_state = NORMAL_OPERATION;
                 global_flags.initializing = 0;
+                global_flags.calibrated = true;
+                calibration_save_timer = CALIBRATION_SAVE_DELAY;
             }
             global_flags.new_channel_data = true;
+            global_flags.new_throttle_data = (updated & (1 << TH)) != 0;
             break;
 
         case NORMAL_OPERATION:
@@ -392,6 +1014,7 @@ void read_all_servo_channels(void)
                 normalize_channel(&channel[CH3]);
             }
             global_flags.new_channel_data = true;
+            global_flags.new_throttle_data = (updated & (1 << TH)) != 0;
             break;
 
         default:
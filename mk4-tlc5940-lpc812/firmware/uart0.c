@@ -6,6 +6,7 @@
 
 #include <globals.h>
 #include <uart0.h>
+#include <event_log.h>
 
 /*
 UART register value calculation
@@ -17,25 +18,27 @@ Problem description:
         - Therefore we can use the preprocessor for calculation
     - We want to find settings for MULT and BRG for each baudrate
 
-First we need to calculate the BRG value for the highest possible baudrate
+Only USART0 is used, so the fractional rate generator (FRG) does not have to
+be shared and we calculate MULT and BRG separately for every baudrate.
+
+First we need to calculate the largest BRG value for the baudrate
 
     BAUDRATE = U_PCLK/(16 * (BRGVAL + 1))
     BAUDRATE * 16 * (BRGVAL + 1) = U_PCLK
-    U_PCLK = __SYSTEM_CLOCK
-    BAUDRATE = 115200
-    BAUDRATE * 16 * (BRGVAL_MAXBAUD + 1) = __SYSTEM_CLOCK
-    BRGVAL_MAXBAUD = (__SYSTEM_CLOCK / (BAUDRATE * 16)) - 1
-    BRGVAL_MAXBAUD = int(__SYSTEM_CLOCK / (115200 * 16)) - 1
+    U_PCLK <= __SYSTEM_CLOCK
+    BRGVAL = int(__SYSTEM_CLOCK / (BAUDRATE * 16)) - 1
+
+    For 12 MHz and 115200 BRGVAL is 5
+    For 30 MHz and 115200 BRGVAL is 15
 
-    For 12 MHz BRGVAL_MAXBAUD is 5
-    For 30 MHz BRGVAL_MAXBAUD is 15
+    A baudrate above __SYSTEM_CLOCK / 16 can not be generated.
 
 Then we can calculate the exact U_PCLK we need:
 
-    U_PCLK = BAUDRATE * 16 * (BRGVAL_MAXBAUD + 1)
+    U_PCLK = BAUDRATE * 16 * (BRGVAL + 1)
 
-    For 12 MHZ U_PCLK is 11059200
-    For 30 MHZ U_PCLK is 29491200
+    For 12 MHZ and 115200 U_PCLK is 11059200
+    For 30 MHZ and 115200 U_PCLK is 29491200
 
 Now we can calculate the MULT needed:
 
@@ -51,30 +54,67 @@ The rounding we implement by adding the divisor / 2 to the nominator.
 
     MULT = ((DIV *__SYSTEM_CLOCK) + (U_PCLK / 2)) / U_PCLK - DIV
 
-Note that we need 64 bit math for that!
+Note that we need 64 bit math for that! The macros use unsigned long long
+constants so that they also work in #if.
 
-    For 12 MHZ MULT is 22
-    For 30 MHZ MULT is 4
+    For 12 MHZ and 115200 MULT is 22
+    For 30 MHZ and 115200 MULT is 4
 
-With the given MULT we can calculate the BRG values for other baudrates:
+The resulting baudrate and its error (in 0.01 %) are:
 
-    U_PCLK = (__SYSTEM_CLOCK / UARTCLKDIV) / (1 + (MULT / DIV))
-    BRGVAL = U_PCLK / (BAUDRATE * 16) - 1
+    BAUDRATE_ACTUAL = __SYSTEM_CLOCK * DIV / ((DIV + MULT) * 16 * (BRGVAL + 1))
 
-Again we have to round by adding BAUDRATE * 16 / 2 to the nominator:
-
-    BRGVAL = (U_PCLK + (BAUDRATE * 16 / 2)) / (BAUDRATE * 16) - 1
+    Baudrate    12 MHz              24 MHz              30 MHz
+                BRG MULT  error     BRG MULT  error     BRG MULT  error
+    38400       18    7   +0.06%    38    0   +0.16%    47    4   +0.16%
+    100000       6   18   +0.10%    14    0    0.00%    17   11   -0.13%
+    115200       5   22   -0.08%    12    0   +0.16%    15    4   +0.16%
+    230400       2   22   -0.08%     5   22   -0.08%     7    4   +0.16%
+    460800       0  161   -0.08%     2   22   -0.08%     3    4   +0.16%
+    750000       0    0    0.00%     1    0    0.00%     1   64    0.00%
+    1000000      -                   0  128    0.00%     0  224    0.00%
 
+At 12 MHz 750000 is the fastest baudrate; 1000000 needs at least 16 MHz.
+The #if checks below verify at compile time that every baudrate available
+at the given __SYSTEM_CLOCK is within BAUDRATE_MAX_ERROR.
 */
-#define MAX_BAUDRATE ((uint64_t)115200)
-#define DIV ((uint64_t)256)
-#define BRGVAL_MAXBAUD ((__SYSTEM_CLOCK / (MAX_BAUDRATE * 16)) - 1)
-#define U_PCLK (MAX_BAUDRATE * 16 * (BRGVAL_MAXBAUD + 1))
-#define MULT ((((__SYSTEM_CLOCK * DIV) + (U_PCLK / 2)) / U_PCLK) - DIV)
-
-#define U_PCLK_ACTUAL ((__SYSTEM_CLOCK * DIV) / (DIV + MULT))
-
-#define BRGVAL(x) ((U_PCLK_ACTUAL + (x * 8))/ (x * 16) - 1)
+#define DIV 256ULL
+#define BRGVAL(b) ((__SYSTEM_CLOCK / ((b) * 16ULL)) - 1)
+#define U_PCLK(b) ((b) * 16ULL * (BRGVAL(b) + 1))
+#define MULT_ROUNDED(b) \
+    ((((__SYSTEM_CLOCK * DIV) + (U_PCLK(b) / 2)) / U_PCLK(b)) - DIV)
+#define MULT(b) (MULT_ROUNDED(b) > 255 ? 255 : MULT_ROUNDED(b))
+
+#define BAUDRATE_ACTUAL(b) \
+    ((__SYSTEM_CLOCK * DIV) / ((DIV + MULT(b)) * 16 * (BRGVAL(b) + 1)))
+#define BAUDRATE_ERROR(b) \
+    ((BAUDRATE_ACTUAL(b) > (b) ? \
+        BAUDRATE_ACTUAL(b) - (b) : (b) - BAUDRATE_ACTUAL(b)) * 10000 / (b))
+#define BAUDRATE_MAX_ERROR 150      // 1.5 %, in 0.01 %
+
+#define BAUDRATE_POSSIBLE(b) (__SYSTEM_CLOCK >= (b) * 16ULL)
+
+#if BAUDRATE_ERROR(38400) > BAUDRATE_MAX_ERROR
+#error Baudrate error for 38400 is too large
+#endif
+#if BAUDRATE_ERROR(100000) > BAUDRATE_MAX_ERROR
+#error Baudrate error for 100000 is too large
+#endif
+#if BAUDRATE_ERROR(115200) > BAUDRATE_MAX_ERROR
+#error Baudrate error for 115200 is too large
+#endif
+#if BAUDRATE_ERROR(230400) > BAUDRATE_MAX_ERROR
+#error Baudrate error for 230400 is too large
+#endif
+#if BAUDRATE_ERROR(460800) > BAUDRATE_MAX_ERROR
+#error Baudrate error for 460800 is too large
+#endif
+#if BAUDRATE_POSSIBLE(750000)  &&  BAUDRATE_ERROR(750000) > BAUDRATE_MAX_ERROR
+#error Baudrate error for 750000 is too large
+#endif
+#if BAUDRATE_POSSIBLE(1000000)  &&  BAUDRATE_ERROR(1000000) > BAUDRATE_MAX_ERROR
+#error Baudrate error for 1000000 is too large
+#endif
 
 
 
@@ -82,13 +122,43 @@ Again we have to round by adding BAUDRATE * 16 / 2 to the nominator:
 
 #define UART_CFG_ENABLE (1 << 0)
 #define UART_CFG_DATALEN(d) ((unsigned)((d) - 7) << 2)
+#define UART_CFG_PARITY_EVEN (2 << 4)
+#define UART_CFG_STOPLEN_2 (1 << 6)
 #define UART_STAT_RXRDY (1 << 0)
 #define UART_STAT_TXRDY (1 << 2)
 #define UART_STAT_TXIDLE (1 << 3)
 
-#define RECEIVE_BUFFER_SIZE (16)        // Must be modulo 2 for speed
+#define RECEIVE_BUFFER_SIZE (32)        // Must be modulo 2 for speed
 #define RECEIVE_BUFFER_INDEX_MASK (RECEIVE_BUFFER_SIZE - 1)
 
+/*
+Receive buffer
+
+Filled by the RXRDY interrupt. If the buffer is full the most recently
+received byte is overwritten; the number of bytes lost this way is counted
+and logged as EVENT_UART_RECEIVE_OVERFLOW.
+
+receive_timestamp holds the SysTick->VAL at the time the most recent byte
+was received, so readers can measure the age of the data they process.
+*/
+
+/*
+Transmit ring
+
+All output is placed in a ring buffer that is drained by the TXRDY interrupt,
+so sending never blocks the main loop.
+
+Overflow policy: if the ring is full the new character is dropped and counted
+in transmit_dropped. Senders of binary frames (slave, preprocessor) must use
+uart0_send_space() to check that the whole frame fits, and skip the frame
+otherwise, so that the receiver never sees a truncated frame.
+
+transmit_high_watermark records the highest fill level of the ring, which
+helps to size TRANSMIT_RING_SIZE.
+*/
+#define TRANSMIT_RING_SIZE (64)         // Must be modulo 2 for speed
+#define TRANSMIT_RING_INDEX_MASK (TRANSMIT_RING_SIZE - 1)
+
 /*
 INT32_MIN  is -2147483648 (decimal needs 12 characters, incl. terminating '\0')
 INT32_MAX  is 2147483647
@@ -105,6 +175,14 @@ which is the maximum needed for decimal.
 static uint8_t receive_buffer[RECEIVE_BUFFER_SIZE];
 static volatile uint16_t read_index = 0;
 static volatile uint16_t write_index = 0;
+static volatile uint16_t receive_dropped = 0;
+static volatile uint32_t receive_timestamp = 0;
+
+static uint8_t transmit_ring[TRANSMIT_RING_SIZE];
+static volatile uint16_t transmit_read_index = 0;
+static volatile uint16_t transmit_write_index = 0;
+static uint16_t transmit_high_watermark = 0;
+static uint16_t transmit_dropped = 0;
 
 
 
@@ -149,6 +227,46 @@ static void int32_to_cstring(int32_t value, char *result, unsigned int radix)
 }
 
 
+// ****************************************************************************
+// The slave link connects two light controllers and can therefore run much
+// faster than the links to the PIC based pre-processor and winch controller.
+// In MASTER_WITH_UART_READER mode the slave output shares the UART with the
+// pre-processor input, so both must use the same baudrate.
+// The baudrate of serial receivers (SBUS, iBUS) is fixed by the protocol.
+// ****************************************************************************
+static uint32_t get_link_baudrate(void)
+{
+    if (operating_mode == MASTER_WITH_SBUS_READER) {
+        return 100000;
+    }
+
+    if (operating_mode == MASTER_WITH_IBUS_READER) {
+        return 115200;
+    }
+
+    if (config.slave_baudrate != 0) {
+        if (operating_mode == SLAVE) {
+            return config.slave_baudrate;
+        }
+
+        if (config.flags.slave_output  &&
+                operating_mode != MASTER_WITH_UART_READER) {
+            return config.slave_baudrate;
+        }
+    }
+
+    return config.baudrate;
+}
+
+
+// ****************************************************************************
+static void set_baudrate(uint8_t mult, uint16_t brgval)
+{
+    LPC_SYSCON->UARTFRGMULT = mult;
+    LPC_USART0->BRG = brgval;
+}
+
+
 // ****************************************************************************
 void init_uart0(void)
 {
@@ -161,34 +279,122 @@ void init_uart0(void)
 
     LPC_SYSCON->UARTCLKDIV = 1;
     LPC_SYSCON->UARTFRGDIV = 255;
-    LPC_SYSCON->UARTFRGMULT = MULT;
 
-    if (config.baudrate == 115200) {
-        LPC_USART0->BRG = BRGVAL(115200);
+    switch (get_link_baudrate()) {
+        case 38400:
+            set_baudrate(MULT(38400), BRGVAL(38400));
+            break;
+
+        case 100000:
+            set_baudrate(MULT(100000), BRGVAL(100000));
+            break;
+
+        case 230400:
+            set_baudrate(MULT(230400), BRGVAL(230400));
+            break;
+
+        case 460800:
+            set_baudrate(MULT(460800), BRGVAL(460800));
+            break;
+
+#if BAUDRATE_POSSIBLE(750000)
+        case 750000:
+            set_baudrate(MULT(750000), BRGVAL(750000));
+            break;
+#endif
+
+#if BAUDRATE_POSSIBLE(1000000)
+        case 1000000:
+            set_baudrate(MULT(1000000), BRGVAL(1000000));
+            break;
+#endif
+
+        case 115200:
+        default:
+            set_baudrate(MULT(115200), BRGVAL(115200));
+            break;
+    }
+
+    if (operating_mode == MASTER_WITH_SBUS_READER) {
+        LPC_USART0->CFG = UART_CFG_DATALEN(8) | UART_CFG_PARITY_EVEN |
+            UART_CFG_STOPLEN_2 | UART_CFG_ENABLE;                   // 8e2
     }
     else {
-        LPC_USART0->BRG = BRGVAL(38400);
+        LPC_USART0->CFG = UART_CFG_DATALEN(8) | UART_CFG_ENABLE;     // 8n1
     }
 
-    LPC_USART0->CFG = UART_CFG_DATALEN(8) | UART_CFG_ENABLE;     // 8n1
-
     LPC_USART0->INTENSET = (1 << 0);    // Enable RXRDY interrupt
     NVIC_EnableIRQ(UART0_IRQn);
 }
 
 
+// ****************************************************************************
+// Returns true if the transmit ring is empty and the UART has finished
+// sending, i.e. the link is idle.
 // ****************************************************************************
 bool uart0_send_is_ready(void)
 {
-    return (LPC_USART0->STAT & UART_STAT_TXRDY);
+    return (transmit_read_index == transmit_write_index)  &&
+        (LPC_USART0->STAT & UART_STAT_TXIDLE);
+}
+
+
+// ****************************************************************************
+// Returns the number of characters that can be queued without overflowing
+// the transmit ring.
+// ****************************************************************************
+uint16_t uart0_send_space(void)
+{
+    uint16_t used;
+
+    used = (transmit_write_index - transmit_read_index) &
+        TRANSMIT_RING_INDEX_MASK;
+
+    // One slot is always kept free to distinguish full from empty
+    return (TRANSMIT_RING_SIZE - 1) - used;
+}
+
+
+// ****************************************************************************
+uint16_t uart0_send_high_watermark(void)
+{
+    return transmit_high_watermark;
+}
+
+
+// ****************************************************************************
+uint16_t uart0_send_dropped(void)
+{
+    return transmit_dropped;
 }
 
 
+// ****************************************************************************
+// Queue a character for sending. Never blocks; if the transmit ring is full
+// the character is dropped (see "Transmit ring" above).
 // ****************************************************************************
 void uart0_send_char(const char c)
 {
-    while (!(LPC_USART0->STAT & UART_STAT_TXRDY));
-    LPC_USART0->TXDATA = c;
+    uint16_t next;
+    uint16_t used;
+
+    next = (transmit_write_index + 1) & TRANSMIT_RING_INDEX_MASK;
+    if (next == transmit_read_index) {
+        ++transmit_dropped;
+        return;
+    }
+
+    transmit_ring[transmit_write_index] = c;
+    transmit_write_index = next;
+
+    used = (next - transmit_read_index) & TRANSMIT_RING_INDEX_MASK;
+    if (used > transmit_high_watermark) {
+        transmit_high_watermark = used;
+    }
+
+    // (Re-)enable the TXRDY interrupt. If the UART is idle it fires right
+    // away and starts draining the ring.
+    LPC_USART0->INTENSET = UART_STAT_TXRDY;
 }
 
 
@@ -267,16 +473,34 @@ inline void uart0_send_linefeed(void)
 // ****************************************************************************
 void UART0_irq_handler(void)
 {
-    receive_buffer[write_index++] = (uint8_t)LPC_USART0->RXDATA;
-
-    // Wrap around the write pointer. This works because the buffer size is
-    // a modulo of 2.
-    write_index &= RECEIVE_BUFFER_INDEX_MASK;
+    uint32_t status = LPC_USART0->INTSTAT;
+
+    if (status & UART_STAT_RXRDY) {
+        receive_timestamp = SysTick->VAL;
+        receive_buffer[write_index++] = (uint8_t)LPC_USART0->RXDATA;
+
+        // Wrap around the write pointer. This works because the buffer size
+        // is a modulo of 2.
+        write_index &= RECEIVE_BUFFER_INDEX_MASK;
+
+        // If we are bumping into the read pointer we are dealing with a buffer
+        // overflow. Back off and rather destroy the last value.
+        if (write_index == read_index) {
+            write_index = (write_index - 1) & RECEIVE_BUFFER_INDEX_MASK;
+            ++receive_dropped;
+        }
+    }
 
-    // If we are bumping into the read pointer we are dealing with a buffer
-    // overflow. Back off and rather destroy the last value.
-    if (write_index == read_index) {
-        write_index = (write_index - 1) & RECEIVE_BUFFER_INDEX_MASK;
+    if (status & UART_STAT_TXRDY) {
+        if (transmit_read_index == transmit_write_index) {
+            // Nothing left to send
+            LPC_USART0->INTENCLR = UART_STAT_TXRDY;
+        }
+        else {
+            LPC_USART0->TXDATA = transmit_ring[transmit_read_index];
+            transmit_read_index =
+                (transmit_read_index + 1) & TRANSMIT_RING_INDEX_MASK;
+        }
     }
 }
 
@@ -285,17 +509,27 @@ void UART0_irq_handler(void)
 bool uart0_read_is_byte_pending(void)
 {
     if (LPC_USART0->STAT & (1 << 8)) {
-        uart0_send_cstring("overrun\n");
+        log_event(EVENT_UART_OVERRUN, 0);
         LPC_USART0->STAT |= (1 << 8);
     }
     if (LPC_USART0->STAT & (1 << 13)) {
-        uart0_send_cstring("frameerr\n");
+        log_event(EVENT_UART_FRAME_ERROR, 0);
         LPC_USART0->STAT |= (1 << 13);
     }
     if (LPC_USART0->STAT & (1 << 15)) {
-        uart0_send_cstring("noise\n");
+        log_event(EVENT_UART_NOISE, 0);
         LPC_USART0->STAT |= (1 << 15);
     }
+    if (receive_dropped) {
+        uint16_t dropped;
+
+        __disable_irq();
+        dropped = receive_dropped;
+        receive_dropped = 0;
+        __enable_irq();
+
+        log_event(EVENT_UART_RECEIVE_OVERFLOW, dropped);
+    }
 
     return (read_index != write_index);
 }
@@ -315,3 +549,12 @@ uint8_t uart0_read_byte(void)
 
     return data;
 }
+
+
+// ****************************************************************************
+// Returns the SysTick->VAL at which the most recent byte was received
+// ****************************************************************************
+uint32_t uart0_read_timestamp(void)
+{
+    return receive_timestamp;
+}
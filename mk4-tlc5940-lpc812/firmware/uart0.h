@@ -7,6 +7,9 @@
 void init_uart0(void);
 
 bool uart0_send_is_ready(void);
+uint16_t uart0_send_space(void);
+uint16_t uart0_send_high_watermark(void);
+uint16_t uart0_send_dropped(void);
 void uart0_send_char(const char c);
 void uart0_send_cstring(const char *cstring);
 void uart0_send_int32(int32_t number);
@@ -20,5 +23,6 @@ void uart0_send_linefeed(void);
 bool uart0_read_is_byte_pending(void);
 void UART0_irq_handler(void);
 uint8_t uart0_read_byte(void);
+uint32_t uart0_read_timestamp(void);
 
 #endif /* __UART0_H */
@@ -34,30 +34,84 @@
     HK310 expansion protocol. This module ignores that value.
     TODO: describe this better, and define the range including both SYNC values
 
+
+    Preprocessor protocol v2:
+
+    Frames starting with PREPROCESSOR_MAGIC_BYTE_V2 carry the channels with
+    0.2 % resolution, the analog value of CH3, a sequence number and a CRC-8.
+    See preprocessor_output.c for the frame layout. Frames failing the CRC
+    are dropped; gaps in the sequence numbers are logged.
+
+    The protocol version is detected by the magic byte of each frame, so v1
+    and v2 preprocessors can be used without configuration.
+
+
+    Frame processing:
+
+    Every call drains all bytes pending in the UART receive buffer. Only the
+    newest complete frame is published; older complete frames in the same
+    batch are stale and counted as dropped. A frame that is interrupted by
+    the magic byte of the next frame (e.g. because bytes were lost) is
+    counted as partial. A frame that is still incomplete when the buffer is
+    empty is continued on the next call.
+
+    The latency from the reception of the last byte of a frame to its
+    publication is measured with the SysTick counter. It is only measured
+    when no further byte has been received after the frame.
+
+    Once per second the statistics are logged as
+    EVENT_PREPROCESSOR_STATISTICS and reset:
+
+        bits 31..24: frames dropped (saturating at 255)
+        bits 23..16: partial frames (saturating at 255)
+        bits 15..0:  maximum latency in us (saturating at 65535)
+
  *****************************************************************************/
 #include <stdint.h>
 #include <LPC8xx.h>
 
 #include <globals.h>
 #include <uart0.h>
+#include <utils.h>
+#include <event_log.h>
 
 
 #define SLAVE_MAGIC_BYTE 0x87
+#define PREPROCESSOR_MAGIC_BYTE_V2 0x86
 #define CONSECUTIVE_BYTE_COUNTS 3
 
+// Frame sizes without the magic byte
+#define PREPROCESSOR_V1_PAYLOAD_SIZE 3
+#define PREPROCESSOR_V2_PAYLOAD_SIZE 10
+
+#define STATISTICS_INTERVAL (1000 / __SYSTICK_IN_MS)
+#define SYSTICK_TICKS_PER_US (__SYSTEM_CLOCK / 1000000)
+
 
 typedef enum {
     STATE_WAIT_FOR_MAGIC_BYTE = 0,
-    STATE_STEERING,
-    STATE_THROTTLE,
-    STATE_CH3
+    STATE_V1_PAYLOAD,
+    STATE_V2_PAYLOAD
 } STATE_T;
 
+typedef enum {
+    FRAME_NONE = 0,
+    FRAME_V1,
+    FRAME_V2
+} FRAME_TYPE_T;
+
+
+static struct {
+    uint16_t frames_dropped;
+    uint16_t partial_frames;
+    uint32_t latency_max;               // In SysTick clocks
+} statistics;
+
 
 // ****************************************************************************
 void init_uart_reader(void)
 {
-    if (config.mode != MASTER_WITH_UART_READER) {
+    if (operating_mode != MASTER_WITH_UART_READER) {
         return;
     }
 
@@ -66,19 +120,15 @@ void init_uart_reader(void)
 
 
 // ****************************************************************************
-static void normalize_channel(CHANNEL_T *c, uint8_t data)
+static void set_channel(CHANNEL_T *c, int16_t normalized_fine)
 {
-    if (data > 127) {
-        c->normalized = -(256 - data);
-    }
-    else {
-        c->normalized = data;
-    }
-
     if (c->reversed) {
-        c->normalized = -c->normalized;
+        normalized_fine = -normalized_fine;
     }
 
+    c->normalized_fine = normalized_fine;
+    c->normalized = normalized_fine / 5;
+
     if (c->normalized < 0) {
         c->absolute = -c->normalized;
     }
@@ -88,6 +138,22 @@ static void normalize_channel(CHANNEL_T *c, uint8_t data)
 }
 
 
+// ****************************************************************************
+static void normalize_channel(CHANNEL_T *c, uint8_t data)
+{
+    int16_t normalized;
+
+    if (data > 127) {
+        normalized = -(256 - data);
+    }
+    else {
+        normalized = data;
+    }
+
+    set_channel(c, normalized * 5);
+}
+
+
 // ****************************************************************************
 static void publish_channels(uint8_t channel_data[])
 {
@@ -103,6 +169,111 @@ static void publish_channels(uint8_t channel_data[])
     }
 
     global_flags.new_channel_data = true;
+    global_flags.new_throttle_data = true;
+}
+
+
+// ****************************************************************************
+static int16_t decode_channel(const uint8_t *data)
+{
+    return (int16_t)(data[0] | (data[1] << 7)) - 512;
+}
+
+
+// ****************************************************************************
+// Checks the CRC and sequence number of a complete v2 frame
+// ****************************************************************************
+static bool is_valid_v2_frame(const uint8_t payload[])
+{
+    static bool sequence_valid = false;
+    static uint8_t sequence;
+
+    if (crc8(payload, 8) != ((payload[8] << 4) | payload[9])) {
+        log_event(EVENT_PREPROCESSOR_CRC_ERROR, payload[0]);
+        return false;
+    }
+
+    if (sequence_valid  &&  payload[0] != ((sequence + 1) & 0x3f)) {
+        log_event(EVENT_PREPROCESSOR_SEQUENCE_ERROR, payload[0]);
+    }
+    sequence = payload[0];
+    sequence_valid = true;
+
+    return true;
+}
+
+
+// ****************************************************************************
+static void publish_v2_channels(const uint8_t payload[])
+{
+    set_channel(&channel[ST], decode_channel(&payload[2]));
+    set_channel(&channel[TH], decode_channel(&payload[4]));
+
+    global_flags.initializing = (payload[1] & 0x10) ? true : false;
+
+    if (!config.flags.ch3_is_local_switch) {
+        set_channel(&channel[CH3], decode_channel(&payload[6]));
+    }
+
+    global_flags.new_channel_data = true;
+    global_flags.new_throttle_data = true;
+}
+
+
+// ****************************************************************************
+// Called right after publishing a frame whose last byte was the last byte
+// received. SysTick counts down and wraps every systick, so latencies above
+// one systick can not be measured; the main loop is much faster than that.
+// ****************************************************************************
+static void measure_latency(void)
+{
+    uint32_t received = uart0_read_timestamp();
+    uint32_t now = SysTick->VAL;
+    uint32_t latency;
+
+    // A byte that arrived meanwhile has overwritten the timestamp
+    if (uart0_read_is_byte_pending()) {
+        return;
+    }
+
+    if (received >= now) {
+        latency = received - now;
+    }
+    else {
+        latency = received + SysTick->LOAD + 1 - now;
+    }
+
+    if (latency > statistics.latency_max) {
+        statistics.latency_max = latency;
+    }
+}
+
+
+// ****************************************************************************
+static void report_statistics(void)
+{
+    static uint8_t systicks = 0;
+    uint32_t latency_us;
+
+    if (!global_flags.systick) {
+        return;
+    }
+
+    if (++systicks < STATISTICS_INTERVAL) {
+        return;
+    }
+    systicks = 0;
+
+    latency_us = statistics.latency_max / SYSTICK_TICKS_PER_US;
+
+    log_event(EVENT_PREPROCESSOR_STATISTICS,
+        ((uint32_t)MIN(statistics.frames_dropped, 255) << 24) |
+        ((uint32_t)MIN(statistics.partial_frames, 255) << 16) |
+        MIN(latency_us, 0xffff));
+
+    statistics.frames_dropped = 0;
+    statistics.partial_frames = 0;
+    statistics.latency_max = 0;
 }
 
 
@@ -110,54 +281,105 @@ static void publish_channels(uint8_t channel_data[])
 void read_preprocessor(void)
 {
     static STATE_T state = STATE_WAIT_FOR_MAGIC_BYTE;
-    static uint8_t channel_data[3];
+    static uint8_t payload[PREPROCESSOR_V2_PAYLOAD_SIZE];
+    static uint8_t payload_count;
 
+    uint8_t newest[PREPROCESSOR_V2_PAYLOAD_SIZE];
+    FRAME_TYPE_T newest_type = FRAME_NONE;
+    FRAME_TYPE_T complete = FRAME_NONE;
     uint8_t uart_byte;
+    int i;
 
-    if (config.mode != MASTER_WITH_UART_READER) {
+    if (operating_mode != MASTER_WITH_UART_READER) {
         return;
     }
 
     global_flags.new_channel_data = false;
+    global_flags.new_throttle_data = false;
+
+    report_statistics();
 
     while (uart0_read_is_byte_pending()) {
         uart_byte = uart0_read_byte();
+        complete = FRAME_NONE;
 
         // The preprocessor protocol is designed such that only the first
         // byte can have the MAGIC value. This allows us to be in sync at all
         // times.
         // If we receive the MAGIC value we know it is the first byte, so we
         // can kick off the state machine.
-        if (uart_byte == SLAVE_MAGIC_BYTE) {
-            state = STATE_STEERING;
-            return;
+        if (uart_byte == SLAVE_MAGIC_BYTE  ||
+                uart_byte == PREPROCESSOR_MAGIC_BYTE_V2) {
+            if (state != STATE_WAIT_FOR_MAGIC_BYTE) {
+                ++statistics.partial_frames;
+            }
+
+            payload_count = 0;
+            state = (uart_byte == SLAVE_MAGIC_BYTE) ?
+                STATE_V1_PAYLOAD : STATE_V2_PAYLOAD;
+            continue;
         }
 
         switch (state) {
             case STATE_WAIT_FOR_MAGIC_BYTE:
-                // Nothing to do; SLAVE_MAGIC_BYTE is checked globally
+                // Nothing to do; the magic bytes are checked globally
                 break;
 
-            case STATE_STEERING:
-                channel_data[0] = uart_byte;
-                state = STATE_THROTTLE;
+            case STATE_V1_PAYLOAD:
+                payload[payload_count++] = uart_byte;
+                if (payload_count >= PREPROCESSOR_V1_PAYLOAD_SIZE) {
+                    complete = FRAME_V1;
+                    state = STATE_WAIT_FOR_MAGIC_BYTE;
+                }
                 break;
 
-            case STATE_THROTTLE:
-                channel_data[1] = uart_byte;
-                state = STATE_CH3;
-                break;
-
-            case STATE_CH3:
-                channel_data[2] = uart_byte;
-                publish_channels(channel_data);
-                state = STATE_WAIT_FOR_MAGIC_BYTE;
+            case STATE_V2_PAYLOAD:
+                // All v2 bytes except the magic byte are below 0x80
+                if (uart_byte & 0x80) {
+                    ++statistics.partial_frames;
+                    state = STATE_WAIT_FOR_MAGIC_BYTE;
+                    break;
+                }
+
+                payload[payload_count++] = uart_byte;
+                if (payload_count >= PREPROCESSOR_V2_PAYLOAD_SIZE) {
+                    if (is_valid_v2_frame(payload)) {
+                        complete = FRAME_V2;
+                    }
+                    state = STATE_WAIT_FOR_MAGIC_BYTE;
+                }
                 break;
 
             default:
                 state = STATE_WAIT_FOR_MAGIC_BYTE;
                 break;
         }
+
+        if (complete != FRAME_NONE) {
+            if (newest_type != FRAME_NONE) {
+                ++statistics.frames_dropped;
+            }
+
+            for (i = 0; i < payload_count; i++) {
+                newest[i] = payload[i];
+            }
+            newest_type = complete;
+        }
+    }
+
+    if (newest_type == FRAME_NONE) {
+        return;
     }
-}
 
+    if (newest_type == FRAME_V1) {
+        publish_channels(newest);
+    }
+    else {
+        publish_v2_channels(newest);
+    }
+
+    // Only measure if the last byte received completed the published frame
+    if (complete != FRAME_NONE) {
+        measure_latency();
+    }
+}
@@ -57,3 +57,26 @@ uint16_t random_min_max(uint16_t min, uint16_t max)
     next16(&lfsr);
     return (uint16_t)(min + (lfsr % (max - min + 1)));
 }
+
+
+// ****************************************************************************
+// crc8
+//
+// CRC-8 with polynomial x^8 + x^2 + x + 1 (0x07), initial value 0.
+// Bitwise implementation; we only deal with a few bytes at a time and flash
+// is more precious than the cycles a lookup table would save.
+// ****************************************************************************
+uint8_t crc8(const uint8_t *data, int length)
+{
+    uint8_t crc = 0;
+    int i;
+
+    while (length--) {
+        crc ^= *data++;
+        for (i = 0; i < 8; i++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+
+    return crc;
+}
@@ -4,5 +4,6 @@
 #include <stdint.h>
 
 uint16_t random_min_max(uint16_t min, uint16_t max);
+uint8_t crc8(const uint8_t *data, int length);
 
 #endif // __UTILS_H
\ No newline at end of file
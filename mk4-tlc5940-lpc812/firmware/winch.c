@@ -34,24 +34,31 @@ void winch_action(uint8_t ch3_clicks)
             winch_command_repeat_counter = 0;
             break;
 
-        case 5:
-            // 5 click: winch enabled/disabled toggle
-            if (global_flags.winch_mode == WINCH_DISABLED) {
-                global_flags.winch_mode = WINCH_IDLE;
-            }
-            else {
-                global_flags.winch_mode = WINCH_DISABLED;
-            }
-            winch_command_repeat_counter = 0;
-            break;
-
         default:
-            // Ignore all other clicks
+            // Ignore all other clicks. The winch is disabled with the same
+            // CH3 gesture that enabled it, see toggle_winch().
             break;
     }
 }
 
 
+// ****************************************************************************
+void toggle_winch(void)
+{
+    if (!config.flags.winch_output) {
+        return;
+    }
+
+    if (global_flags.winch_mode == WINCH_DISABLED) {
+        global_flags.winch_mode = WINCH_IDLE;
+    }
+    else {
+        global_flags.winch_mode = WINCH_DISABLED;
+    }
+    winch_command_repeat_counter = 0;
+}
+
+
 // ****************************************************************************
 bool abort_winching(void)
 {
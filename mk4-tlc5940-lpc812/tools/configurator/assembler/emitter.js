@@ -6,8 +6,6 @@ var emitter = (function () {
     var MAX_LIGHT_PROGRAMS = 25;
     // var MAX_LIGHT_PROGRAM_VARIABLES = 100;
 
-    var NUMBER_OF_LEDS = 32;
-
     // Taken from globals.h of the light controller firmware:
     var FIRST_SKIP_IF_OPCODE  = 0x20;
     var LAST_SKIP_IF_OPCODE   = 0x37;
@@ -15,8 +13,9 @@ var emitter = (function () {
     var OPCODE_SKIP_IF_ALL    = 0x80;    // 100 + 29 bits run_state!
     var OPCODE_SKIP_IF_NONE   = 0xA0;    // 101 + 29 bits run_state!
 
+    // The header holds one "leds used" word per 32 LEDs, the instructions
+    // follow after the last one.
     var LEDS_USED_OFFSET = 2;
-    var FIRST_INSTRUCTION_OFFSET = 3;
 
     var number_of_programs = 0;
     var start_offset = [];
@@ -88,7 +87,8 @@ var emitter = (function () {
                 });
             } else if (f.symbol.opcode !== f.pc) {
                 offset = start_offset[number_of_programs];
-                offset += FIRST_INSTRUCTION_OFFSET;
+                offset += LEDS_USED_OFFSET;
+                offset += parser.yy.symbols.get_leds_used_words();
                 offset += f.pc;
 
                 instruction_list[offset] =
@@ -108,10 +108,11 @@ var emitter = (function () {
             var leds_used = parser.yy.symbols.get_leds_used();
             led_list = [];
 
-            parser.yy.logger.log(MODULE, "INFO", "Adding all LEDs: " + hex(leds_used));
+            parser.yy.logger.log(MODULE, "INFO", "Adding all LEDs: " +
+                leds_used.map(hex).join(" "));
 
-            for (i = 0; i < NUMBER_OF_LEDS; i += 1) {
-                if (leds_used & Math.pow(2, i)) {
+            for (i = 0; i < parser.yy.symbols.get_number_of_leds(); i += 1) {
+                if (leds_used[i >> 5] & (1 << (i & 31))) {
                     led_list.push(i);
                 }
             }
@@ -127,7 +128,7 @@ var emitter = (function () {
             }
         }
 
-        if (led_list.length < NUMBER_OF_LEDS) {
+        if (led_list.length < parser.yy.symbols.get_number_of_leds()) {
             led_list.push(led_index);
         } else {
             throw new Error("led_list is full");
@@ -189,17 +190,24 @@ var emitter = (function () {
 
     // *************************************************************************
     var emit_run_condition = function (priority_run_condition, run_condition) {
+        var i;
+
         parser.yy.logger.log(MODULE, "INFO", "PRIORITY code: " + hex(priority_run_condition));
         parser.yy.logger.log(MODULE, "INFO", "RUN code: " + hex(run_condition));
 
         instruction_list.push(priority_run_condition);
         instruction_list.push(run_condition);
-        instruction_list.push(0);   // Placeholder for "leds used"
+        for (i = 0; i < parser.yy.symbols.get_leds_used_words(); i += 1) {
+            instruction_list.push(0);   // Placeholder for "leds used"
+        }
     };
 
 
     // *************************************************************************
     var emit_end_of_program = function () {
+        var leds_used = parser.yy.symbols.get_leds_used();
+        var i;
+
         parser.yy.logger.log(MODULE, "INFO", "emit_end_of_program()");
 
         if (pc > 0  &&  is_skip_if(instruction_list[instruction_list.length - 1])) {
@@ -213,9 +221,11 @@ var emitter = (function () {
 
         parser.yy.symbols.dump_symbol_table();
 
-        // Fill in LEDS_USED word!
-        instruction_list[start_offset[number_of_programs] + LEDS_USED_OFFSET] =
-            parser.yy.symbols.get_leds_used();
+        // Fill in LEDS_USED words!
+        for (i = 0; i < leds_used.length; i += 1) {
+            instruction_list[start_offset[number_of_programs] +
+                LEDS_USED_OFFSET + i] = leds_used[i];
+        }
 
         resolve_forward_declarations();
 
@@ -262,7 +272,10 @@ var emitter = (function () {
             "number_of_programs": number_of_programs,
             "start_offset": start_offset,
             "instructions": instruction_list,
-            "light_switch_positions": light_switch_positions
+            "light_switch_positions": light_switch_positions,
+            // Section version of the light programs: the number of "leds
+            // used" words in the program header
+            "version": parser.yy.symbols.get_leds_used_words()
         };
 
         return result;
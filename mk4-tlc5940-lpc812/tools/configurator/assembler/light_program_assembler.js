@@ -35,13 +35,23 @@ function make_c_output(source_name, output_file, programs) {
 
     var part1 =
         "#include <globals.h>\n" +
-        "\n" +
+        "\n";
+
+    // The firmware runs light programs whose header has up to
+    // LED_BITSET_WORDS "leds used" words (see globals.h)
+    var part1_check =
+        "#if LIGHT_PROGRAMS_VERSION < " + programs.version + "\n" +
+        "#error Light programs were assembled for more LEDs than MAX_LIGHTS\n" +
+        "#endif\n" +
+        "\n";
+
+    var part1a =
         "__attribute__ ((section(\".light_programs\")))\n" +
         "const LIGHT_PROGRAMS_T light_programs = {\n" +
         "    .magic = {\n" +
         "        .magic_value = ROM_MAGIC,\n" +
         "        .type = LIGHT_PROGRAMS,\n" +
-        "        .version = CONFIG_VERSION\n" +
+        "        .version = " + programs.version + "\n" +
         "    },\n" +
         "\n" +
         "    .number_of_programs = ";
@@ -81,6 +91,10 @@ function make_c_output(source_name, output_file, programs) {
     fs.writeSync(output_file, part0b);
 
     fs.writeSync(output_file, part1);
+    if (programs.version > 1) {
+        fs.writeSync(output_file, part1_check);
+    }
+    fs.writeSync(output_file, part1a);
     fs.writeSync(output_file, number_of_programs.toString());
     fs.writeSync(output_file, part1b);
 
@@ -127,6 +141,7 @@ program
     .usage('[options] <source>')
     .option('-o, --output <value>', 'Output file. If omitted, output is printed to stdout.')
     .option('-i, --include-name', 'Include the source file name in the output as comment.')
+    .option('-l, --max-lights <n>', 'Number of LEDs the firmware is built for (MAX_LIGHTS). Default: 32', parseInt, 32)
     .option('-v, --verbose', 'Verbose output. Specify multiple times for more output.', increaseVerbosity, 0)
     .parse(process.argv);
 
@@ -147,6 +162,12 @@ if (program.output) {
     output_file = fs.openSync(program.output, "w");
 }
 
+if (isNaN(program.maxLights)  ||  program.maxLights < 1  ||  program.maxLights > 256) {
+    console.error("Invalid number of LEDs given.");
+    process.exit(1);
+}
+symbols.set_number_of_leds(program.maxLights);
+
 var sourcecode = fs.readFileSync(source_file_name, "utf8");
 
 try {
@@ -22,6 +22,7 @@ var PARAMETER_TYPE_RANDOM = 2;
 var PARAMETER_TYPE_STEERING = 3;
 var PARAMETER_TYPE_THROTTLE = 4;
 var PARAMETER_TYPE_GEAR = 5;
+var PARAMETER_TYPE_CHANNEL = 6;
 
 var INSTRUCTION_MODIFIER_LED = 0x02000000;
 var INSTRUCTION_MODIFIER_IMMEDIATE = 0x01000000;
@@ -135,7 +136,7 @@ decleration
       {  yy.symbols.add_symbol($2, "LED_ID", $6, @2); }
   | LED error
   | USE ALL LEDS
-      {  yy.symbols.set_leds_used(0xffffffff); }
+      {  yy.symbols.use_all_leds(); }
   ;
 
 code_lines
@@ -318,6 +319,8 @@ parameter
       { $$ = (PARAMETER_TYPE_THROTTLE * 256); }
   | GEAR
       { $$ = (PARAMETER_TYPE_GEAR * 256); }
+  | CHANNEL
+      { $$ = (PARAMETER_TYPE_CHANNEL * 256) + Number($1); }
   | RANDOM
       { $$ = (PARAMETER_TYPE_RANDOM * 256); }
   ;
@@ -6,7 +6,8 @@ var symbols = (function () {
     var symbol_table = [];
     var forward_declaration_table = [];
     var next_variable_index = 0;
-    var leds_used = 0;
+    var number_of_leds = 32;
+    var leds_used = [0];
     var number_of_light_switch_positions = 0;
 
     var undeclared_symbol = {"token": "UNDECLARED_SYMBOL", "opcode": 0};
@@ -43,6 +44,12 @@ var symbols = (function () {
         "winch-in": {"token": "RUN_CONDITION", "opcode": (1 << 21)},
         "winch-out": {"token": "RUN_CONDITION", "opcode": (1 << 22)},
 
+        "ch4-on": {"token": "RUN_CONDITION", "opcode": (1 << 23)},
+        "ch5-on": {"token": "RUN_CONDITION", "opcode": (1 << 24)},
+        "ch6-on": {"token": "RUN_CONDITION", "opcode": (1 << 25)},
+        "ch7-on": {"token": "RUN_CONDITION", "opcode": (1 << 26)},
+        "ch8-on": {"token": "RUN_CONDITION", "opcode": (1 << 27)},
+
         "no-signal": {"token": "PRIORITY_RUN_CONDITION", "opcode": (1 << 0)},
         "initializing": {"token": "PRIORITY_RUN_CONDITION", "opcode": (1 << 1)},
         "servo-output-setup-centre": {"token": "PRIORITY_RUN_CONDITION", "opcode": (1 << 2)},
@@ -50,7 +57,11 @@ var symbols = (function () {
         "servo-output-setup-right": {"token": "PRIORITY_RUN_CONDITION", "opcode": (1 << 4)},
         "reversing-setup-steering": {"token": "PRIORITY_RUN_CONDITION", "opcode": (1 << 5)},
         "reversing-setup-throttle": {"token": "PRIORITY_RUN_CONDITION", "opcode": (1 << 6)},
-        "gear-changed": {"token": "PRIORITY_RUN_CONDITION", "opcode": (1 << 7)}
+        "gear-changed": {"token": "PRIORITY_RUN_CONDITION", "opcode": (1 << 7)},
+        "ch3-gesture-1": {"token": "PRIORITY_RUN_CONDITION", "opcode": (1 << 8)},
+        "ch3-gesture-2": {"token": "PRIORITY_RUN_CONDITION", "opcode": (1 << 9)},
+        "ch3-gesture-3": {"token": "PRIORITY_RUN_CONDITION", "opcode": (1 << 10)},
+        "ch3-gesture-4": {"token": "PRIORITY_RUN_CONDITION", "opcode": (1 << 11)}
     };
 
     var car_state_tokens = {
@@ -202,10 +213,27 @@ var symbols = (function () {
     };
 
 
+    // *************************************************************************
+    var get_leds_used_words = function () {
+        return Math.floor((number_of_leds + 31) / 32);
+    };
+
+
+    // *************************************************************************
+    var clear_leds_used = function () {
+        var i;
+
+        leds_used = [];
+        for (i = 0; i < get_leds_used_words(); i += 1) {
+            leds_used.push(0);
+        }
+    };
+
+
     // *************************************************************************
     var remove_local_symbols = function () {
         var i;
-        leds_used = 0;
+        clear_leds_used();
 
         forward_declaration_table = [];
 
@@ -292,7 +320,6 @@ var symbols = (function () {
 
     // *************************************************************************
     var add_symbol = function (name, token, opcode, location) {
-        var led_bit;
         var new_symbol = {
             "name": name,
             "token": token,
@@ -307,16 +334,14 @@ var symbols = (function () {
         }
 
         if (token === "LED_ID") {
-            if (opcode < 0  ||  opcode > 31) {
-                parser.yy.emitter.yyerror("LED index out of range (must be 0..15)", {
-                    loc: location
-                });
+            if (opcode < 0  ||  opcode >= number_of_leds) {
+                parser.yy.emitter.yyerror("LED index out of range (must be 0.." +
+                    (number_of_leds - 1) + ")", {
+                        loc: location
+                    });
             } else {
-                led_bit = Math.pow(2, opcode);
-                if (!(leds_used & led_bit)) {
-                    // Add LED to bit-field of leds_used
-                    leds_used += led_bit;
-                }
+                // Add LED to bit-field of leds_used
+                leds_used[opcode >> 5] |= (1 << (opcode & 31));
             }
         }
 
@@ -337,14 +362,36 @@ var symbols = (function () {
 
 
     // *************************************************************************
+    // The LEDs used by the current program, one 32-bit word per 32 LEDs
     var get_leds_used = function () {
-        return leds_used;
+        return leds_used.map(function (word) {
+            return word >>> 0;
+        });
+    };
+
+
+    // *************************************************************************
+    var use_all_leds = function () {
+        var i;
+
+        for (i = 0; i < number_of_leds; i += 1) {
+            leds_used[i >> 5] |= (1 << (i & 31));
+        }
+    };
+
+
+    // *************************************************************************
+    // Number of LEDs the light controller firmware is built for (MAX_LIGHTS).
+    // Not affected by reset().
+    var set_number_of_leds = function (n) {
+        number_of_leds = n;
+        clear_leds_used();
     };
 
 
     // *************************************************************************
-    var set_leds_used = function (led_bits) {
-        leds_used = led_bits;
+    var get_number_of_leds = function () {
+        return number_of_leds;
     };
 
 
@@ -359,7 +406,7 @@ var symbols = (function () {
         symbol_table = [];
         forward_declaration_table = [];
         next_variable_index = 0;
-        leds_used = 0;
+        clear_leds_used();
         number_of_light_switch_positions = 0;
 
         if (parser !== undefined) {
@@ -389,8 +436,11 @@ var symbols = (function () {
         set_symbol: set_symbol,
         get_reserved_word: get_reserved_word,
         get_number_of_light_switch_positions: get_number_of_light_switch_positions,
-        set_leds_used: set_leds_used,
+        use_all_leds: use_all_leds,
         get_leds_used: get_leds_used,
+        set_number_of_leds: set_number_of_leds,
+        get_number_of_leds: get_number_of_leds,
+        get_leds_used_words: get_leds_used_words,
         get_forward_declerations: get_forward_declerations,
         remove_local_symbols: remove_local_symbols,
         dump_symbol_table: dump_symbol_table,
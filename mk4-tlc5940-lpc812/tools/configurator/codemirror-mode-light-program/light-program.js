@@ -16,6 +16,11 @@
     var directives = {
       "abs": "operator",
       "all": "qualifier",
+      "ch4": "built-in",
+      "ch5": "built-in",
+      "ch6": "built-in",
+      "ch7": "built-in",
+      "ch8": "built-in",
       "const": "def",
       "clicks": "built-in",
       "end": "keyword",
@@ -51,6 +56,15 @@
       "blink-left": "attribute",
       "blink-right": "attribute",
       "braking": "attribute",
+      "ch3-gesture-1": "attribute",
+      "ch3-gesture-2": "attribute",
+      "ch3-gesture-3": "attribute",
+      "ch3-gesture-4": "attribute",
+      "ch4-on": "attribute",
+      "ch5-on": "attribute",
+      "ch6-on": "attribute",
+      "ch7-on": "attribute",
+      "ch8-on": "attribute",
       "forward": "attribute",
       "gear-changed": "attribute",
       "hazard": "attribute",
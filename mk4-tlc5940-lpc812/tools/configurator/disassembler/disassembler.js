@@ -5,7 +5,6 @@
 var disassembler = (function () {
 
     var MAX_NUMBER_OF_INSTRUCTIONS = 16 * 1024 / 4;
-    var NUMBER_OF_LEDS = 32;
 
     var asm = [];
     (function initialize_asm() {
@@ -15,7 +14,11 @@ var disassembler = (function () {
         }
     }());
 
-    var leds_used = 0;
+    // The program header holds one "leds used" word per 32 LEDs. The number of
+    // words is given by the version of the light programs section.
+    var number_of_leds = 32;
+    var leds_used_words = 1;
+    var leds_used = [];
     var leds_to_declare_offset;
     var variables = {};
     var var_offsets = [];
@@ -101,6 +104,7 @@ var disassembler = (function () {
     var PARAMETER_TYPE_STEERING = 3;
     var PARAMETER_TYPE_THROTTLE = 4;
     var PARAMETER_TYPE_GEAR = 5;
+    var PARAMETER_TYPE_CHANNEL = 6;
 
     var RUN_WHEN_NORMAL_OPERATION           = 0;
     var RUN_WHEN_NO_SIGNAL                  = (1 << 0);
@@ -111,6 +115,10 @@ var disassembler = (function () {
     var RUN_WHEN_REVERSING_SETUP_STEERING   = (1 << 5);
     var RUN_WHEN_REVERSING_SETUP_THROTTLE   = (1 << 6);
     var RUN_WHEN_GEAR_CHANGED               = (1 << 7);
+    var RUN_WHEN_CH3_GESTURE_1              = (1 << 8);
+    var RUN_WHEN_CH3_GESTURE_2              = (1 << 9);
+    var RUN_WHEN_CH3_GESTURE_3              = (1 << 10);
+    var RUN_WHEN_CH3_GESTURE_4              = (1 << 11);
 
     var RUN_WHEN_LIGHT_SWITCH_POSITION_0    = (1 << 0);
     var RUN_WHEN_LIGHT_SWITCH_POSITION_1    = (1 << 1);
@@ -135,6 +143,11 @@ var disassembler = (function () {
     var RUN_WHEN_WINCH_IDLE                 = (1 << 20);
     var RUN_WHEN_WINCH_IN                   = (1 << 21);
     var RUN_WHEN_WINCH_OUT                  = (1 << 22);
+    var RUN_WHEN_CH4                        = (1 << 23);
+    var RUN_WHEN_CH5                        = (1 << 24);
+    var RUN_WHEN_CH6                        = (1 << 25);
+    var RUN_WHEN_CH7                        = (1 << 26);
+    var RUN_WHEN_CH8                        = (1 << 27);
 
     var RUN_ALWAYS                          = 0x80000000;
 
@@ -208,6 +221,18 @@ var disassembler = (function () {
         if (instruction & RUN_WHEN_GEAR_CHANGED) {
             asm[offset++].decleration = "run when gear-changed";
         }
+        if (instruction & RUN_WHEN_CH3_GESTURE_1) {
+            asm[offset++].decleration = "run when ch3-gesture-1";
+        }
+        if (instruction & RUN_WHEN_CH3_GESTURE_2) {
+            asm[offset++].decleration = "run when ch3-gesture-2";
+        }
+        if (instruction & RUN_WHEN_CH3_GESTURE_3) {
+            asm[offset++].decleration = "run when ch3-gesture-3";
+        }
+        if (instruction & RUN_WHEN_CH3_GESTURE_4) {
+            asm[offset++].decleration = "run when ch3-gesture-4";
+        }
     };
 
 
@@ -291,27 +316,57 @@ var disassembler = (function () {
         if (instruction & RUN_WHEN_WINCH_OUT) {
             asm[offset++].decleration = "run when winch-out";
         }
+        if (instruction & RUN_WHEN_CH4) {
+            asm[offset++].decleration = "run when ch4-on";
+        }
+        if (instruction & RUN_WHEN_CH5) {
+            asm[offset++].decleration = "run when ch5-on";
+        }
+        if (instruction & RUN_WHEN_CH6) {
+            asm[offset++].decleration = "run when ch6-on";
+        }
+        if (instruction & RUN_WHEN_CH7) {
+            asm[offset++].decleration = "run when ch7-on";
+        }
+        if (instruction & RUN_WHEN_CH8) {
+            asm[offset++].decleration = "run when ch8-on";
+        }
     };
 
 
     // *************************************************************************
-    var decode_leds_used = function (instruction) {
+    var is_led_set = function (words, led) {
+        return Boolean(words[led >> 5] & (1 << (led & 31)));
+    };
+
+
+    // *************************************************************************
+    var decode_leds_used = function () {
         var i;
         var any_led = false;
+        var all_leds = true;
 
-        leds_used = parseInt(instruction, 16);
         leds_to_declare_offset = offset++;
-        asm[leds_to_declare_offset].leds_to_declare = leds_used;
+        asm[leds_to_declare_offset].leds_to_declare = leds_used.slice();
+
+        for (i = 0; i < number_of_leds; i++) {
+            if (!is_led_set(leds_used, i)) {
+                all_leds = false;
+            }
+        }
 
-        if (leds_used === (Math.pow(2, NUMBER_OF_LEDS) - 1)) {
-            asm[leds_to_declare_offset].leds_to_declare = 0;
+        if (all_leds) {
+            asm[leds_to_declare_offset].leds_to_declare =
+                leds_used.map(function () {
+                    return 0;
+                });
 
             asm[offset++].decleration = "use all leds";
             asm[offset++].decleration = '';  // Empty line
         }
 
-        for (i = 0; i < NUMBER_OF_LEDS; i++) {
-            if (instruction & Math.pow(2, i)) {
+        for (i = 0; i < number_of_leds; i++) {
+            if (is_led_set(leds_used, i)) {
                 asm[offset].led = i;
                 asm[offset++].decleration =
                     "led led" + i + " = led[" + i + "]";
@@ -330,21 +385,19 @@ var disassembler = (function () {
         var stop = (instruction & 0x00ff0000) >> 16;
         var start = (instruction & 0x0000ff00) >> 8;
         var result = '';
-        var led_bit_mask = 0;
+        var leds_to_declare;
 
         // If all used LEDs are used in the instruction then output "all leds"
         // instead of a giant list of leds.
-        if (start === 0  &&  stop === (NUMBER_OF_LEDS - 1)) {
+        if (start === 0  &&  stop === (number_of_leds - 1)) {
             return "all leds";
         }
 
         while (start <= stop) {
             // Remember which LEDs are used here so that we can weed out unused
             // leds in the decleration later
-            led_bit_mask = Math.pow(2, start);
-            if (!(asm[leds_to_declare_offset].leds_to_declare & led_bit_mask)) {
-                asm[leds_to_declare_offset].leds_to_declare += led_bit_mask;
-            }
+            leds_to_declare = asm[leds_to_declare_offset].leds_to_declare;
+            leds_to_declare[start >> 5] |= (1 << (start & 31));
 
             if (result !== '') {
                 result += ', ';
@@ -390,6 +443,9 @@ var disassembler = (function () {
         case PARAMETER_TYPE_GEAR:
             return "gear";
 
+        case PARAMETER_TYPE_CHANNEL:
+            return "ch" + index;
+
         default:
             return "ERROR: unknown parameter type " + parameter_type;
         }
@@ -440,7 +496,6 @@ var disassembler = (function () {
 
         parameter_type = (instruction >> 8) & 0xff;
         index = instruction & 0xff;
-        set_variable_used(index, current_program);
 
         switch (parameter_type) {
         case PARAMETER_TYPE_VARIABLE:
@@ -465,6 +520,9 @@ var disassembler = (function () {
         case PARAMETER_TYPE_GEAR:
             return "gear";
 
+        case PARAMETER_TYPE_CHANNEL:
+            return "ch" + index;
+
         default:
             return "ERROR: unknown parameter type " + parameter_type;
         }
@@ -819,13 +877,17 @@ var disassembler = (function () {
         case STATE_RUN:
             decode_run_condition(instruction);
             asm[offset++].decleration = '';  // Empty line
+            leds_used = [];
             state = STATE_LEDS_USED;
             break;
 
         case STATE_LEDS_USED:
-            decode_leds_used(instruction);
-            var_offsets.push(offset);
-            state = STATE_PROGRAM;
+            leds_used.push(Number(instruction));
+            if (leds_used.length >= leds_used_words) {
+                decode_leds_used();
+                var_offsets.push(offset);
+                state = STATE_PROGRAM;
+            }
             break;
 
         case STATE_PROGRAM:
@@ -909,7 +971,6 @@ var disassembler = (function () {
         var source_code = "";
         var program = 1;
         var i;
-        var led_bit_mask;
         var leds_to_declare;
 
         for (i = 0; i < (offset + pc); i++) {
@@ -926,9 +987,7 @@ var disassembler = (function () {
                 if (asm[i].led === null) {
                     source_code += asm[i].decleration + "\n";
                 } else {
-
-                    led_bit_mask = Math.pow(2, asm[i].led);
-                    if (leds_to_declare & led_bit_mask) {
+                    if (is_led_set(leds_to_declare, asm[i].led)) {
                         source_code += asm[i].decleration + "\n";
                     }
                 }
@@ -946,9 +1005,15 @@ var disassembler = (function () {
 
 
     // *************************************************************************
-    var disassemble = function (instructions) {
+    // leds_used_words is the version of the light programs section,
+    // number_of_leds is MAX_LIGHTS of the firmware. Both are optional and
+    // default to a single word for 32 LEDs.
+    var disassemble = function (instructions, words, leds) {
         var i;
 
+        leds_used_words = words || 1;
+        number_of_leds = leds || (32 * leds_used_words);
+
         for (i = 0; i < asm.length; i++) {
             asm[i] = {'decleration' : null, 'label' : null, 'code' : null,
                       'led' : null, 'leds_to_declare' : null};
@@ -14,6 +14,8 @@ process.stdin.on('data', function (buffer) {
 
 process.stdin.on('end', function () {
     var instructions = disassembler.parse_c_code(input);
-    var code = disassembler.disassemble(instructions);
+    var version = input.match(/\.version = (\d+)/);
+    var code = disassembler.disassemble(instructions,
+        version ? parseInt(version[1], 10) : 1);
     console.log(code);
 });
@@ -12,6 +12,11 @@ var hardware_test_configuration = {
     "ch3_is_momentary": false,
     "auto_brake_lights_forward_enabled": true,
     "auto_brake_lights_reverse_enabled": true,
+    "slave_protocol_v2": false,
+    "slave_pass_through": false,
+    "distributed_rendering": false,
+    "preprocessor_protocol_v2": false,
+    "servo_reader_low_latency": false,
     "auto_brake_counter_value_forward_min": 25,
     "auto_brake_counter_value_forward_max": 125,
     "auto_brake_counter_value_reverse_min": 25,
@@ -37,7 +42,11 @@ var hardware_test_configuration = {
     "gearbox_servo_idle_time": 450,
     "servo_pulse_min": 600,
     "servo_pulse_max": 2500,
-    "startup_time": 100
+    "startup_time": 100,
+    "render_rate": 100,
+    "slave_baudrate": 0,
+    "servo_filter": 0,
+    "brake_prediction": [0, 0, 0, 0]
   },
   "local_leds": {
     "0": {
@@ -15,6 +15,8 @@ var app = (function () {
     var config_version;
     var local_leds;
     var slave_leds;
+    var additional_slave_leds;
+    var ch3_gestures;
     var gamma_object;
     var light_programs;
 
@@ -30,25 +32,106 @@ var app = (function () {
     var SECTION_LIGHT_PROGRAMS = "Light programs";
     var SECTION_LOCAL_LEDS = "Local LEDs";
     var SECTION_SLAVE_LEDS = "Slave LEDs";
+    var SECTION_SLAVE_LEDS_2 = "Slave 2 LEDs";
+    var SECTION_SLAVE_LEDS_3 = "Slave 3 LEDs";
+    var SECTION_SLAVE_LEDS_4 = "Slave 4 LEDs";
+    var SECTION_CH3_GESTURES = "CH3 gestures";
 
     var SECTIONS = {
         0x01: SECTION_CONFIG,
         0x02: SECTION_GAMMA,
         0x10: SECTION_LOCAL_LEDS,
         0x20: SECTION_SLAVE_LEDS,
+        0x21: SECTION_SLAVE_LEDS_2,
+        0x22: SECTION_SLAVE_LEDS_3,
+        0x23: SECTION_SLAVE_LEDS_4,
         0x30: SECTION_LIGHT_PROGRAMS,
+        0x40: SECTION_CH3_GESTURES,
 
         SECTION_CONFIG: 0x01,
         SECTION_GAMMA: 0x02,
         SECTION_LOCAL_LEDS: 0x10,
         SECTION_SLAVE_LEDS: 0x20,
-        SECTION_LIGHT_PROGRAMS: 0x30
+        SECTION_SLAVE_LEDS_2: 0x21,
+        SECTION_SLAVE_LEDS_3: 0x22,
+        SECTION_SLAVE_LEDS_4: 0x23,
+        SECTION_LIGHT_PROGRAMS: 0x30,
+        SECTION_CH3_GESTURES: 0x40
     };
 
+    // Firmware built for daisy-chained slaves (MAX_SLAVES > 1) contains one
+    // LED section per additional slave. Slave n drives LEDs 16 + 16 * n.
+    var ADDITIONAL_SLAVES = [
+        {section: SECTION_SLAVE_LEDS_2, prefix: "slave2", div: "leds_slave2"},
+        {section: SECTION_SLAVE_LEDS_3, prefix: "slave3", div: "leds_slave3"},
+        {section: SECTION_SLAVE_LEDS_4, prefix: "slave4", div: "leds_slave4"}
+    ];
+
+    // Highest section version understood by the configurator.
+    // Version 2 of the LED sections adds the incandescent time constant to
+    // each LED, which grows CAR_LIGHT_T from 20 to 24 bytes.
+    // Version 2 of the configuration adds the render rate.
+    // Version 3 of the configuration adds the slave link baudrate.
+    // Version 4 of the configuration adds the servo pulse filter.
+    // Version 5 of the configuration adds the brake prediction per ESC type.
+    // The version of the light programs is the number of "leds used" words
+    // in the program header, one per 32 LEDs (up to 256 LEDs).
+    var MAX_SECTION_VERSION = {};
+    MAX_SECTION_VERSION[SECTION_CONFIG] = 5;
+    MAX_SECTION_VERSION[SECTION_GAMMA] = 1;
+    MAX_SECTION_VERSION[SECTION_LOCAL_LEDS] = 2;
+    MAX_SECTION_VERSION[SECTION_SLAVE_LEDS] = 2;
+    MAX_SECTION_VERSION[SECTION_SLAVE_LEDS_2] = 2;
+    MAX_SECTION_VERSION[SECTION_SLAVE_LEDS_3] = 2;
+    MAX_SECTION_VERSION[SECTION_SLAVE_LEDS_4] = 2;
+    MAX_SECTION_VERSION[SECTION_LIGHT_PROGRAMS] = 8;
+    MAX_SECTION_VERSION[SECTION_CH3_GESTURES] = 1;
+
+
+    // CH3 gestures, see CH3_GESTURES_T in firmware/globals.h.
+    // Each function can be assigned one gesture; the value of a gesture is
+    // "type:clicks" with type 0 = clicks, 1 = long press, 2 = press-and-hold.
+    var MAX_CH3_GESTURES = 16;
+    var CH3_ACTION_LIGHT_PROGRAM_EVENT = 9;
+
+    var CH3_GESTURE_FUNCTIONS = [
+        {action: 1, parameter: 0, name: "Light switch up (gearbox: gear 1 / up)"},
+        {action: 2, parameter: 0, name: "Light switch down (gearbox: gear 2 / down)"},
+        {action: 3, parameter: 0, name: "All lights on/off"},
+        {action: 4, parameter: 0, name: "Hazard lights on/off"},
+        {action: 5, parameter: 0, name: "Winch enable/disable"},
+        {action: 6, parameter: 0, name: "Next light sequence"},
+        {action: 7, parameter: 0, name: "Channel reversing setup"},
+        {action: 8, parameter: 0, name: "Servo output setup"},
+        {action: 9, parameter: 1, name: "Light program event ch3-gesture-1"},
+        {action: 9, parameter: 2, name: "Light program event ch3-gesture-2"},
+        {action: 9, parameter: 3, name: "Light program event ch3-gesture-3"},
+        {action: 9, parameter: 4, name: "Light program event ch3-gesture-4"}
+    ];
+
+    var CH3_GESTURE_CHOICES = [
+        {value: "", name: "Not used"},
+        {value: "0:1", name: "1 click"},
+        {value: "0:2", name: "2 clicks"},
+        {value: "0:3", name: "3 clicks"},
+        {value: "0:4", name: "4 clicks"},
+        {value: "0:5", name: "5 clicks"},
+        {value: "0:6", name: "6 clicks"},
+        {value: "0:7", name: "7 clicks"},
+        {value: "0:8", name: "8 clicks"},
+        {value: "1:1", name: "Long press"},
+        {value: "1:2", name: "Click, then long press"},
+        {value: "2:1", name: "Press and hold"},
+        {value: "2:2", name: "Click, then press and hold"}
+    ];
+
 
     var MASTER_WITH_SERVO_READER = "Master, servo inputs";
     var MASTER_WITH_UART_READER = "Master, pre-processor input";
     var MASTER_WITH_CPPM_READER = "Master, CPPM input";
+    var MASTER_WITH_SBUS_READER = "Master, SBUS input";
+    var MASTER_WITH_IBUS_READER = "Master, iBUS input";
+    var MASTER_WITH_AUTO_DETECT = "Master, auto-detect input";
     var SLAVE = "Slave";
     var TEST = "Hardware test";
 
@@ -57,12 +140,18 @@ var app = (function () {
         1: MASTER_WITH_UART_READER,
         2: MASTER_WITH_CPPM_READER,
         3: SLAVE,
+        4: MASTER_WITH_SBUS_READER,
+        5: MASTER_WITH_IBUS_READER,
+        6: MASTER_WITH_AUTO_DETECT,
         99: TEST,
 
         MASTER_WITH_SERVO_READER: 0,
         MASTER_WITH_UART_READER: 1,
         MASTER_WITH_CPPM_READER: 2,
         SLAVE: 3,
+        MASTER_WITH_SBUS_READER: 4,
+        MASTER_WITH_IBUS_READER: 5,
+        MASTER_WITH_AUTO_DETECT: 6,
         TEST: 99
     };
 
@@ -88,9 +177,15 @@ var app = (function () {
     var BAUDRATES = {
         0: 38400,
         1: 115200,
+        2: 230400,
+        3: 460800,
+        4: 750000,
 
         38400: 0,
-        115200: 1
+        115200: 1,
+        230400: 2,
+        460800: 3,
+        750000: 4
     };
 
 
@@ -167,10 +262,18 @@ var app = (function () {
     };
 
 
+    // *************************************************************************
+    var get_car_light_size = function (section) {
+        return (firmware.version[section] >= 2) ? 24 : 20;
+    };
+
+
     // *************************************************************************
     var parse_leds = function (section) {
         var data = firmware.data;
         var offset = firmware.offset[section];
+        var version = firmware.version[section];
+        var car_light_size = get_car_light_size(section);
         var result = {};
         var i;
 
@@ -206,6 +309,12 @@ var app = (function () {
             led.weak_indicator_left = get_flag(0x1000);
             led.weak_indicator_right = get_flag(0x2000);
 
+            led.incandescent_ms = 0;
+            if (version >= 2) {
+                led.incandescent_ms = get_uint16(data, offset + 4);
+                offset += 4;
+            }
+
             led.always_on = data[offset + 4];
             led.light_switch_position0 = data[offset + 5];
             led.light_switch_position1 = data[offset + 6];
@@ -226,7 +335,7 @@ var app = (function () {
         }
 
         for (i = 0; i < led_count; i += 1) {
-            result[i] = parse_led(data, car_lights_offset + (i * 20));
+            result[i] = parse_led(data, car_lights_offset + (i * car_light_size));
         }
 
         return result;
@@ -252,8 +361,10 @@ var app = (function () {
     var parse_configuration = function () {
         var data = firmware.data;
         var offset = firmware.offset[SECTION_CONFIG];
+        var i;
 
         var new_config = {};
+        var value;
 
         new_config.firmware_version = data[offset];
 
@@ -276,6 +387,11 @@ var app = (function () {
         new_config.ch3_is_momentary = get_flag(0x0080);
         new_config.auto_brake_lights_forward_enabled = get_flag(0x0100);
         new_config.auto_brake_lights_reverse_enabled = get_flag(0x0200);
+        new_config.slave_protocol_v2 = get_flag(0x0400);
+        new_config.slave_pass_through = get_flag(0x0800);
+        new_config.distributed_rendering = get_flag(0x1000);
+        new_config.preprocessor_protocol_v2 = get_flag(0x2000);
+        new_config.servo_reader_low_latency = get_flag(0x4000);
 
         new_config.auto_brake_counter_value_forward_min =
             get_uint16(data, offset + 8);
@@ -313,22 +429,101 @@ var app = (function () {
         new_config.servo_pulse_max = get_uint16(data, offset + 58);
         new_config.startup_time = get_uint16(data, offset + 60);
 
+        // The firmware rounds the render rate down to 50, 100 or 200 Hz
+        new_config.render_rate = 1000 / SYSTICK_IN_MS;
+        if (firmware.version[SECTION_CONFIG] >= 2) {
+            value = get_uint16(data, offset + 62);
+            if (value >= 200) {
+                new_config.render_rate = 200;
+            } else if (value >= 100) {
+                new_config.render_rate = 100;
+            }
+        }
+
+        new_config.slave_baudrate = 0;
+        if (firmware.version[SECTION_CONFIG] >= 3) {
+            new_config.slave_baudrate = get_uint32(data, offset + 64);
+        }
+
+        new_config.servo_filter = 0;
+        if (firmware.version[SECTION_CONFIG] >= 4) {
+            new_config.servo_filter = get_uint16(data, offset + 68);
+        }
+
+        new_config.brake_prediction = [0, 0, 0, 0];
+        if (firmware.version[SECTION_CONFIG] >= 5) {
+            for (i = 0; i < 4; i += 1) {
+                new_config.brake_prediction[i] = data[offset + 70 + i];
+            }
+        }
+
         return new_config;
     };
 
 
+    // *************************************************************************
+    var parse_ch3_gestures = function () {
+        var data = firmware.data;
+        var offset = firmware.offset[SECTION_CH3_GESTURES];
+        var result = {gestures: []};
+        var count;
+        var i;
+
+        if (offset === undefined) {
+            return undefined;
+        }
+
+        count = Math.min(get_uint16(data, offset), MAX_CH3_GESTURES);
+        result.long_press_time = get_uint16(data, offset + 2);
+        result.hold_time = get_uint16(data, offset + 4);
+
+        for (i = 0; i < count; i += 1) {
+            result.gestures.push({
+                type: data[offset + 6 + (4 * i)],
+                clicks: data[offset + 7 + (4 * i)],
+                action: data[offset + 8 + (4 * i)],
+                parameter: data[offset + 9 + (4 * i)]
+            });
+        }
+
+        return result;
+    };
+
+
+    // *************************************************************************
+    // Number of LEDs the firmware drives: 16 locally, 16 on the slave and 16
+    // on every additional slave
+    var get_number_of_leds = function () {
+        var number_of_leds = 32;
+
+        if (firmware === undefined) {
+            return number_of_leds;
+        }
+
+        ADDITIONAL_SLAVES.forEach(function (slave) {
+            if (firmware.offset[slave.section] !== undefined) {
+                number_of_leds += 16;
+            }
+        });
+
+        return number_of_leds;
+    };
+
+
     // *************************************************************************
     var disassemble_light_programs = function () {
         var data = firmware.data;
         var offset = firmware.offset[SECTION_LIGHT_PROGRAMS];
         var first_program_offset = offset + 4 + (4 * MAX_LIGHT_PROGRAMS);
+        var leds_used_words = firmware.version[SECTION_LIGHT_PROGRAMS];
 
         //var number_of_programs = get_uint32(data, offset);
 
         var instructions =
             uint8_array_to_uint32(data.slice(first_program_offset));
 
-        return disassembler.disassemble(instructions);
+        return disassembler.disassemble(instructions, leds_used_words,
+            Math.min(get_number_of_leds(), 32 * leds_used_words));
     };
 
 
@@ -338,27 +533,34 @@ var app = (function () {
         var ROM_MAGIC = [0x4c, 0x42, 0x72, 0x63];
         var ROM_MAGIC_LENGTH = 4;
         var i;
-        var result = {};
+        var result = {offset: {}, version: {}};
         var section_id;
         var section;
+        var version;
 
         for (i = 0; i < image_data.length; i += 1) {
             if (image_data.slice(i, i + ROM_MAGIC_LENGTH).join() ===
                     ROM_MAGIC.join()) {
 
                 section_id = (image_data[i + 5] * 256) + image_data[i + 4];
-                config_version = (image_data[i + 7] * 256) + image_data[i + 6];
+                version = (image_data[i + 7] * 256) + image_data[i + 6];
 
                 if (SECTIONS[section_id] === undefined) {
                     console.log("Warning: unknown section " + i);
                 } else {
-                    if (config_version !== 1) {
+                    section = SECTIONS[section_id];
+
+                    if (version < 1  ||  version > MAX_SECTION_VERSION[section]) {
                         throw new Error("Unknown configuration version " +
-                            config_version);
+                            version + " of section " + section);
                     }
 
-                    section = SECTIONS[section_id];
-                    result[section] = i + 8;
+                    if (section === SECTION_CONFIG) {
+                        config_version = version;
+                    }
+
+                    result.offset[section] = i + 8;
+                    result.version[section] = version;
                 }
             }
         }
@@ -423,6 +625,8 @@ var app = (function () {
 
                 set_led_feature(prefix, i, "incandescent",
                     Math.round(led.max_change_per_systick * 100 / 255));
+                set_led_feature(prefix, i, "incandescent_ms",
+                    led.incandescent_ms || 0);
                 set_led_feature(prefix, i, "weak_ground", led.reduction_percent);
                 set_led_feature(prefix, i, "checkbox0", led.weak_light_switch_position0);
                 set_led_feature(prefix, i, "checkbox1", led.weak_light_switch_position1);
@@ -443,6 +647,11 @@ var app = (function () {
 
         set_led_fields(local_leds, "master");
         set_led_fields(slave_leds, "slave");
+        ADDITIONAL_SLAVES.forEach(function (slave, i) {
+            if (additional_slave_leds[i]) {
+                set_led_fields(additional_slave_leds[i], slave.prefix);
+            }
+        });
     };
 
 
@@ -476,12 +685,16 @@ var app = (function () {
         var new_mode = parseInt(el.mode.options[el.mode.selectedIndex].value,
             10
             );
+        var local_rendering;
+        var slave_leds_visible;
 
         switch (new_mode) {
         case MODE.MASTER_WITH_SERVO_READER:
             el.mode_master_servo.style.display = "";
             el.mode_master_uart.style.display = "none";
             el.mode_master_cppm.style.display = "none";
+            el.mode_master_serial_receiver.style.display = "none";
+            el.mode_master_auto.style.display = "none";
             el.mode_slave.style.display = "none";
             el.mode_test.style.display = "none";
             el.config_light_programs.style.display = "";
@@ -501,6 +714,8 @@ var app = (function () {
             el.mode_master_servo.style.display = "none";
             el.mode_master_uart.style.display = "";
             el.mode_master_cppm.style.display = "none";
+            el.mode_master_serial_receiver.style.display = "none";
+            el.mode_master_auto.style.display = "none";
             el.mode_slave.style.display = "none";
             el.mode_test.style.display = "none";
             el.config_basic.style.display = "";
@@ -521,6 +736,8 @@ var app = (function () {
             el.mode_master_servo.style.display = "none";
             el.mode_master_uart.style.display = "none";
             el.mode_master_cppm.style.display = "";
+            el.mode_master_serial_receiver.style.display = "none";
+            el.mode_master_auto.style.display = "none";
             el.mode_slave.style.display = "none";
             el.mode_test.style.display = "none";
             el.config_basic.style.display = "";
@@ -537,19 +754,70 @@ var app = (function () {
             config.mode = new_mode;
             break;
 
+        case MODE.MASTER_WITH_SBUS_READER:
+        case MODE.MASTER_WITH_IBUS_READER:
+            el.mode_master_servo.style.display = "none";
+            el.mode_master_uart.style.display = "none";
+            el.mode_master_cppm.style.display = "none";
+            el.mode_master_serial_receiver.style.display = "";
+            el.mode_master_auto.style.display = "none";
+            el.mode_slave.style.display = "none";
+            el.mode_test.style.display = "none";
+            el.config_basic.style.display = "";
+            el.config_light_programs.style.display = "";
+            el.config_leds.style.display = "";
+            el.config_basic_esc_type.style.display = "";
+            el.config_basic_ch3.style.display = "";
+            el.config_basic_output.style.display = "";
+            el.config_advanced.style.display = "";
+            set_visibility(el.single_output, "none");
+            set_visibility(el.dual_output, "");
+            set_name(el.dual_output_th, "output_th");
+            config.mode = new_mode;
+            break;
+
+        case MODE.MASTER_WITH_AUTO_DETECT:
+            // The detected mode may use TH/Tx as input, so the output
+            // functions are restricted to the OUT/ISP pin as with servo inputs
+            el.mode_master_servo.style.display = "none";
+            el.mode_master_uart.style.display = "none";
+            el.mode_master_cppm.style.display = "none";
+            el.mode_master_serial_receiver.style.display = "none";
+            el.mode_master_auto.style.display = "";
+            el.mode_slave.style.display = "none";
+            el.mode_test.style.display = "none";
+            el.config_light_programs.style.display = "";
+            el.config_leds.style.display = "";
+            el.config_basic.style.display = "";
+            el.config_basic_esc_type.style.display = "";
+            el.config_basic_ch3.style.display = "";
+            el.config_basic_output.style.display = "";
+            el.config_advanced.style.display = "";
+            set_visibility(el.single_output, "");
+            set_visibility(el.dual_output, "none");
+            set_name(el.dual_output_th, "output_out");
+            config.mode = new_mode;
+            break;
+
         case MODE.SLAVE:
+            // With distributed rendering the slave runs its own LED
+            // configuration and light programs
+            local_rendering = el.slave_distributed_rendering.checked;
             el.mode_master_servo.style.display = "none";
             el.mode_master_uart.style.display = "none";
             el.mode_master_cppm.style.display = "none";
+            el.mode_master_serial_receiver.style.display = "none";
+            el.mode_master_auto.style.display = "none";
             el.mode_slave.style.display = "";
             el.mode_test.style.display = "none";
-            el.config_light_programs.style.display = "none";
-            el.config_leds.style.display = "none";
+            el.config_light_programs.style.display =
+                local_rendering ? "" : "none";
+            el.config_leds.style.display = local_rendering ? "" : "none";
             el.config_basic.style.display = "";
             el.config_basic_esc_type.style.display = "none";
             el.config_basic_ch3.style.display = "none";
             el.config_basic_output.style.display = "none";
-            el.config_advanced.style.display = "none";
+            el.config_advanced.style.display = local_rendering ? "" : "none";
             config.mode = new_mode;
             break;
 
@@ -557,6 +825,8 @@ var app = (function () {
             el.mode_master_servo.style.display = "none";
             el.mode_master_uart.style.display = "none";
             el.mode_master_cppm.style.display = "none";
+            el.mode_master_serial_receiver.style.display = "none";
+            el.mode_master_auto.style.display = "none";
             el.mode_slave.style.display = "none";
             el.mode_test.style.display = "";
             el.config_light_programs.style.display = "none";
@@ -570,8 +840,18 @@ var app = (function () {
         ensure_one_is_checked("output_out");
         ensure_one_is_checked("output_th");
 
-        el.leds_slave.style.display =
-            el.slave_output.checked ? "" : "none";
+        // Slaves doing distributed rendering use their own LED configuration
+        slave_leds_visible = new_mode !== MODE.SLAVE  &&
+            el.slave_output.checked  &&  !el.distributed_rendering.checked;
+
+        el.leds_slave.style.display = slave_leds_visible ? "" : "none";
+
+        ADDITIONAL_SLAVES.forEach(function (slave, i) {
+            document.getElementById(slave.div).style.display =
+                (slave_leds_visible  &&
+                    firmware.offset[slave.section] !== undefined  &&
+                    additional_slave_leds[i]) ? "" : "none";
+        });
     };
 
 
@@ -582,6 +862,7 @@ var app = (function () {
             var c;
             var advanced_feature_used;
             var incandescent;
+            var incandescent_ms;
             var weak_ground;
             var any_checkbox_ticked;
             var checkboxes;
@@ -597,6 +878,9 @@ var app = (function () {
                 incandescent = parseInt(document.getElementById(prefix + i +
                     "incandescent").value, 10);
 
+                incandescent_ms = parseInt(document.getElementById(prefix + i +
+                    "incandescent_ms").value, 10);
+
                 weak_ground = parseInt(document.getElementById(prefix + i +
                     "weak_ground").value, 10);
 
@@ -616,6 +900,10 @@ var app = (function () {
                     advanced_feature_used = true;
                 }
 
+                if (incandescent_ms > 0) {
+                    advanced_feature_used = true;
+                }
+
                 if (weak_ground > 0  &&  any_checkbox_ticked) {
                     advanced_feature_used = true;
                 }
@@ -633,13 +921,102 @@ var app = (function () {
 
         set_feature_active("leds_master", "master");
         set_feature_active("leds_slave", "slave");
+        ADDITIONAL_SLAVES.forEach(function (slave) {
+            set_feature_active(slave.div, slave.prefix);
+        });
+    };
+
+
+    // *************************************************************************
+    var build_ch3_gesture_table = function () {
+        el.ch3_gesture = [];
+
+        CH3_GESTURE_FUNCTIONS.forEach(function (f) {
+            var row = el.ch3_gesture_table.insertRow(-1);
+            var select = document.createElement("select");
+
+            CH3_GESTURE_CHOICES.forEach(function (choice) {
+                var option = document.createElement("option");
+                option.value = choice.value;
+                option.textContent = choice.name;
+                select.appendChild(option);
+            });
+
+            row.insertCell(-1).textContent = f.name;
+            row.insertCell(-1).appendChild(select);
+            el.ch3_gesture.push(select);
+        });
+    };
+
+
+    // *************************************************************************
+    var update_ch3_gesture_fields = function () {
+        // Firmware without the CH3 gestures section has fixed click actions
+        if (ch3_gestures === undefined) {
+            el.config_ch3_gestures.style.display = "none";
+            return;
+        }
+        el.config_ch3_gestures.style.display = "";
+
+        el.ch3_long_press_time.value =
+            ch3_gestures.long_press_time * SYSTICK_IN_MS;
+        el.ch3_hold_time.value = ch3_gestures.hold_time * SYSTICK_IN_MS;
+
+        CH3_GESTURE_FUNCTIONS.forEach(function (f, i) {
+            el.ch3_gesture[i].value = "";
+
+            ch3_gestures.gestures.some(function (g) {
+                if (g.action !== f.action) {
+                    return false;
+                }
+                if (f.action === CH3_ACTION_LIGHT_PROGRAM_EVENT  &&
+                        g.parameter !== f.parameter) {
+                    return false;
+                }
+                el.ch3_gesture[i].value = g.type + ":" + g.clicks;
+                return true;
+            });
+        });
+    };
+
+
+    // *************************************************************************
+    var update_ch3_gestures = function () {
+        if (ch3_gestures === undefined) {
+            return;
+        }
+
+        ch3_gestures.long_press_time =
+            Math.round(el.ch3_long_press_time.value / SYSTICK_IN_MS);
+        ch3_gestures.hold_time =
+            Math.round(el.ch3_hold_time.value / SYSTICK_IN_MS);
+
+        // The firmware uses the first matching entry, so functions listed
+        // first win if a gesture is assigned more than once
+        ch3_gestures.gestures = [];
+        CH3_GESTURE_FUNCTIONS.forEach(function (f, i) {
+            var value = el.ch3_gesture[i].value;
+            var parts;
+
+            if (value === "") {
+                return;
+            }
+
+            parts = value.split(":");
+            ch3_gestures.gestures.push({
+                type: parseInt(parts[0], 10),
+                clicks: parseInt(parts[1], 10),
+                action: f.action,
+                parameter: f.parameter
+            });
+        });
     };
 
 
     // *************************************************************************
     var update_ui = function () {
         // Master/Slave
-        el.mode.selectedIndex = config.mode;
+        el.mode.value = config.mode;
 
         // Firmware version
         el.firmware_version.innerHTML = config_version + "." +
@@ -657,6 +1034,14 @@ var app = (function () {
         el.preprocessor_output.checked =
             Boolean(config.preprocessor_output);
         el.slave_output.checked = Boolean(config.slave_output);
+        el.slave_protocol_v2.checked = Boolean(config.slave_protocol_v2);
+        el.preprocessor_protocol_v2.checked =
+            Boolean(config.preprocessor_protocol_v2);
+        el.slave_pass_through.checked = Boolean(config.slave_pass_through);
+        el.distributed_rendering.checked =
+            Boolean(config.distributed_rendering);
+        el.slave_distributed_rendering.checked =
+            Boolean(config.distributed_rendering);
 
         // CH3/AUX type
         el.ch3[0].checked = true;
@@ -668,11 +1053,14 @@ var app = (function () {
 
         // Baudrate
         el.baudrate.selectedIndex = BAUDRATES[config.baudrate];
+        el.slave_baudrate.value = config.slave_baudrate || 0;
 
         // LEDs
         update_led_fields();
 
         // Update advanced settings
+        el.servo_reader_low_latency.checked =
+            Boolean(config.servo_reader_low_latency);
         el.auto_brake_lights_forward_enabled.checked =
             Boolean(config.auto_brake_lights_forward_enabled);
         el.auto_brake_counter_value_forward_min.value =
@@ -726,6 +1114,11 @@ var app = (function () {
         el.servo_pulse_min.value = config.servo_pulse_min;
         el.servo_pulse_max.value = config.servo_pulse_max;
         el.startup_time.value = config.startup_time * SYSTICK_IN_MS;
+        el.render_rate.value = config.render_rate;
+        el.servo_filter.value = config.servo_filter;
+        el.brake_prediction.value = config.brake_prediction[config.esc_mode];
+
+        update_ch3_gesture_fields();
 
 
         el.gamma_value.value = gamma_object.gamma_value;
@@ -743,14 +1136,15 @@ var app = (function () {
     // *************************************************************************
     var parse_firmware_structure = function (intel_hex_data) {
         var image_data;
-        var offset_list;
+        var sections;
 
         image_data = intel_hex.parse(intel_hex_data);
-        offset_list = find_magic_markers(image_data.data);
+        sections = find_magic_markers(image_data.data);
 
         return {
             data: image_data.data,
-            offset: offset_list,
+            offset: sections.offset,
+            version: sections.version
         };
     };
 
@@ -761,6 +1155,8 @@ var app = (function () {
         config = undefined;
         local_leds = undefined;
         slave_leds = undefined;
+        additional_slave_leds = [];
+        ch3_gestures = undefined;
         gamma_object = undefined;
         light_programs = "";
 
@@ -772,8 +1168,15 @@ var app = (function () {
             config = parse_configuration();
             local_leds = parse_leds(SECTION_LOCAL_LEDS);
             slave_leds = parse_leds(SECTION_SLAVE_LEDS);
+            additional_slave_leds = ADDITIONAL_SLAVES.map(function (slave) {
+                if (firmware.offset[slave.section] === undefined) {
+                    return undefined;
+                }
+                return parse_leds(slave.section);
+            });
             light_programs = disassemble_light_programs();
             gamma_object = parse_gamma();
+            ch3_gestures = parse_ch3_gestures();
 
             update_ui();
 
@@ -794,6 +1197,7 @@ var app = (function () {
 
         // If we run multiple times, we need to reset the modules inbetween,
         // especially if there was an error before.
+        symbols.set_number_of_leds(get_number_of_leds());
         symbols.reset();
         emitter.reset();
 
@@ -860,6 +1264,8 @@ var app = (function () {
     var assemble_leds = function (section, led_object) {
         var data = firmware.data;
         var offset = firmware.offset[section];
+        var version = firmware.version[section];
+        var car_light_size = get_car_light_size(section);
         var car_lights_offset = get_uint32(data, offset + 4);
         var i;
 
@@ -887,6 +1293,11 @@ var app = (function () {
 
             set_uint16(data, offset + 2, flags);
 
+            if (version >= 2) {
+                set_uint16(data, offset + 4, led_object.incandescent_ms || 0);
+                offset += 4;
+            }
+
             set_uint8(data, offset + 4, led_object.always_on);
             set_uint8(data, offset + 5, led_object.light_switch_position0);
             set_uint8(data, offset + 6, led_object.light_switch_position1);
@@ -921,7 +1332,8 @@ var app = (function () {
         set_uint8(data, offset, led_object.led_count);
 
         for (i = 0; i < led_object.led_count; i += 1) {
-            assemble_led(data, car_lights_offset + (i * 20), led_object[i]);
+            assemble_led(data, car_lights_offset + (i * car_light_size),
+                led_object[i]);
         }
     };
 
@@ -930,6 +1342,7 @@ var app = (function () {
     var assemble_configuration = function (config) {
         var data = firmware.data;
         var offset = firmware.offset[SECTION_CONFIG];
+        var i;
 
         config.light_switch_positions = light_switch_positions;
 
@@ -948,6 +1361,11 @@ var app = (function () {
         flags |= (config.ch3_is_momentary << 7);
         flags |= (config.auto_brake_lights_forward_enabled << 8);
         flags |= (config.auto_brake_lights_reverse_enabled << 9);
+        flags |= (config.slave_protocol_v2 << 10);
+        flags |= (config.slave_pass_through << 11);
+        flags |= (config.distributed_rendering << 12);
+        flags |= (config.preprocessor_protocol_v2 << 13);
+        flags |= (config.servo_reader_low_latency << 14);
         set_uint32(data, offset + 4, flags);
 
         set_uint16(data, offset + 8,  config.auto_brake_counter_value_forward_min);
@@ -981,6 +1399,54 @@ var app = (function () {
         set_uint16(data, offset + 58, config.servo_pulse_max);
 
         set_uint16(data, offset + 60, config.startup_time);
+
+        if (firmware.version[SECTION_CONFIG] >= 2) {
+            set_uint16(data, offset + 62, config.render_rate);
+        }
+
+        if (firmware.version[SECTION_CONFIG] >= 3) {
+            set_uint32(data, offset + 64, config.slave_baudrate);
+        }
+
+        if (firmware.version[SECTION_CONFIG] >= 4) {
+            set_uint16(data, offset + 68, config.servo_filter);
+        }
+
+        if (firmware.version[SECTION_CONFIG] >= 5) {
+            for (i = 0; i < 4; i += 1) {
+                set_uint8(data, offset + 70 + i, config.brake_prediction[i]);
+            }
+        }
+    };
+
+
+    // *************************************************************************
+    var assemble_ch3_gestures = function (ch3_gestures) {
+        var data = firmware.data;
+        var offset = firmware.offset[SECTION_CH3_GESTURES];
+        var gestures;
+        var i;
+
+        if (offset === undefined  ||  ch3_gestures === undefined) {
+            return;
+        }
+
+        gestures = ch3_gestures.gestures.slice(0, MAX_CH3_GESTURES);
+
+        set_uint16(data, offset, gestures.length);
+        set_uint16(data, offset + 2, ch3_gestures.long_press_time);
+        set_uint16(data, offset + 4, ch3_gestures.hold_time);
+
+        for (i = 0; i < MAX_CH3_GESTURES; i += 1) {
+            if (i < gestures.length) {
+                set_uint8(data, offset + 6 + (4 * i), gestures[i].type);
+                set_uint8(data, offset + 7 + (4 * i), gestures[i].clicks);
+                set_uint8(data, offset + 8 + (4 * i), gestures[i].action);
+                set_uint8(data, offset + 9 + (4 * i), gestures[i].parameter);
+            } else {
+                set_uint32(data, offset + 6 + (4 * i), 0);
+            }
+        }
     };
 
 
@@ -1027,6 +1493,11 @@ var app = (function () {
         data = firmware.data;
         offset = firmware.offset[SECTION_LIGHT_PROGRAMS];
 
+        // The section version is the number of "leds used" words in the
+        // program header, which follows from the number of LEDs
+        set_uint16(data, offset - 2, machine_code.version);
+        firmware.version[SECTION_LIGHT_PROGRAMS] = machine_code.version;
+
         firmware.data = data.slice(0, offset).concat(code);
     };
 
@@ -1037,10 +1508,20 @@ var app = (function () {
 
         assemble_leds(SECTION_LOCAL_LEDS, configuration.local_leds);
         assemble_leds(SECTION_SLAVE_LEDS, configuration.slave_leds);
+        ADDITIONAL_SLAVES.forEach(function (slave, i) {
+            if (firmware.offset[slave.section] !== undefined  &&
+                    configuration.additional_slave_leds  &&
+                    configuration.additional_slave_leds[i]) {
+                assemble_leds(slave.section,
+                    configuration.additional_slave_leds[i]);
+            }
+        });
         assemble_light_programs(configuration.light_programs);
 
         assemble_gamma(configuration.gamma);
 
+        assemble_ch3_gestures(configuration.ch3_gestures);
+
         // This has to be last so we can do light_switch_positions
         assemble_configuration(configuration.config);
     };
@@ -1080,6 +1561,9 @@ var app = (function () {
                 if (window.confirm(msg)) {
                     firmware = parse_firmware_structure(default_firmware_image);
                     config.firmware_version = default_firmware_version;
+                    if (ch3_gestures === undefined) {
+                        ch3_gestures = parse_ch3_gestures();
+                    }
                     update_ui();
                 }
             }
@@ -1140,6 +1624,8 @@ var app = (function () {
                 led.max_change_per_systick = Math.round(
                     get_led_feature(prefix, i, "incandescent") * 255 / 100
                 );
+                led.incandescent_ms =
+                    get_led_feature(prefix, i, "incandescent_ms");
                 led.reduction_percent = get_led_feature(prefix, i, "weak_ground");
                 led.weak_light_switch_position0 = get_led_feature(prefix, i, "checkbox0");
                 led.weak_light_switch_position1 = get_led_feature(prefix, i, "checkbox1");
@@ -1160,6 +1646,11 @@ var app = (function () {
 
         get_led_fields(local_leds, "master");
         get_led_fields(slave_leds, "slave");
+        ADDITIONAL_SLAVES.forEach(function (slave, i) {
+            if (additional_slave_leds[i]) {
+                get_led_fields(additional_slave_leds[i], slave.prefix);
+            }
+        });
     };
 
 
@@ -1230,13 +1721,21 @@ var app = (function () {
         if (config.mode === MODE.SLAVE) {
             // Force all output functions to OFF in slave mode
             config.preprocessor_output = false;
+            config.preprocessor_protocol_v2 = false;
             config.slave_output = false;
             config.steering_wheel_servo_output = false;
             config.gearbox_servo_output = false;
             config.winch_output = false;
+            update_boolean('slave_pass_through');
+            config.distributed_rendering =
+                Boolean(el.slave_distributed_rendering.checked);
         } else {
+            config.slave_pass_through = false;
+            update_boolean('distributed_rendering');
             update_boolean('preprocessor_output');
+            update_boolean('preprocessor_protocol_v2');
             update_boolean('slave_output');
+            update_boolean('slave_protocol_v2');
             update_boolean('steering_wheel_servo_output');
             update_boolean('gearbox_servo_output');
             update_boolean('winch_output');
@@ -1255,6 +1754,7 @@ var app = (function () {
 
         // Baudrate
         update_int("baudrate");
+        update_int("slave_baudrate");
 
 
         // LEDs
@@ -1262,6 +1762,7 @@ var app = (function () {
 
 
         // Update advanced settings
+        update_boolean("servo_reader_low_latency");
         update_boolean("auto_brake_lights_forward_enabled");
         update_time("auto_brake_counter_value_forward_min");
         update_time("auto_brake_counter_value_forward_max");
@@ -1296,9 +1797,17 @@ var app = (function () {
         update_int("servo_pulse_min");
         update_int("servo_pulse_max");
         update_time("startup_time");
+        update_int("render_rate");
+        update_int("servo_filter");
 
+        // The brake prediction is shown for the selected ESC type
+        config.brake_prediction[config.esc_mode] =
+            parseInt(el.brake_prediction.value, 10);
 
-        if (config.mode === MODE.SLAVE) {
+        update_ch3_gestures();
+
+
+        if (config.mode === MODE.SLAVE  &&  !config.distributed_rendering) {
             // Force gamma to 1.0 in slave mode as the gamma correction is
             // already handled in the master
             gamma_object.gamma_value = "1.0";
@@ -1313,8 +1822,10 @@ var app = (function () {
         data.config = config;
         data.local_leds = local_leds;
         data.slave_leds = slave_leds;
+        data.additional_slave_leds = additional_slave_leds;
         data.gamma = gamma_object;
         data.light_programs = light_programs;
+        data.ch3_gestures = ch3_gestures;
 
         return data;
     };
@@ -1362,12 +1873,17 @@ var app = (function () {
                 config = data.config;
                 local_leds = data.local_leds;
                 slave_leds = data.slave_leds;
+                additional_slave_leds = data.additional_slave_leds || [];
                 light_programs = data.light_programs;
                 gamma_object = data.gamma;
 
                 // Use the current firmware when loading a configuration file
                 firmware = parse_firmware_structure(default_firmware_image);
                 config.firmware_version = default_firmware_version;
+
+                // Configuration files without CH3 gestures use the defaults
+                // of the firmware
+                ch3_gestures = data.ch3_gestures || parse_ch3_gestures();
             } catch (err) {
                 window.alert(
                     "Failed to load configuration.\n" +
@@ -1421,6 +1937,7 @@ var app = (function () {
                 var led = {};
 
                 led.max_change_per_systick = 0;
+                led.incandescent_ms = 0;
                 led.reduction_percent = 0;
 
                 led.weak_light_switch_position0 = false;
@@ -1465,6 +1982,12 @@ var app = (function () {
 
         local_leds = clear_leds();
         slave_leds = clear_leds();
+        additional_slave_leds = ADDITIONAL_SLAVES.map(function (slave) {
+            if (firmware.offset[slave.section] === undefined) {
+                return undefined;
+            }
+            return clear_leds();
+        });
         update_ui();
     };
 
@@ -1519,6 +2042,9 @@ var app = (function () {
         el.mode_master_servo = document.getElementById("mode_master_servo");
         el.mode_master_uart = document.getElementById("mode_master_uart");
         el.mode_master_cppm = document.getElementById("mode_master_cppm");
+        el.mode_master_serial_receiver =
+            document.getElementById("mode_master_serial_receiver");
+        el.mode_master_auto = document.getElementById("mode_master_auto");
         el.mode_slave = document.getElementById("mode_slave");
         el.mode_test = document.getElementById("mode_test");
 
@@ -1536,6 +2062,7 @@ var app = (function () {
             document.getElementById("config_basic_baudrate");
 
         el.baudrate = document.getElementById("baudrate");
+        el.slave_baudrate = document.getElementById("slave_baudrate");
         el.esc = document.getElementsByName("esc");
         el.ch3 = document.getElementsByName("ch3");
 
@@ -1546,6 +2073,14 @@ var app = (function () {
             document.getElementsByClassName("dual_output_th");
 
         el.slave_output = document.getElementById("slave_output");
+        el.slave_protocol_v2 = document.getElementById("slave_protocol_v2");
+        el.preprocessor_protocol_v2 =
+            document.getElementById("preprocessor_protocol_v2");
+        el.slave_pass_through = document.getElementById("slave_pass_through");
+        el.distributed_rendering =
+            document.getElementById("distributed_rendering");
+        el.slave_distributed_rendering =
+            document.getElementById("slave_distributed_rendering");
         el.preprocessor_output =
             document.getElementById("preprocessor_output");
         el.steering_wheel_servo_output =
@@ -1567,6 +2102,8 @@ var app = (function () {
 
         el.config_advanced = document.getElementById("config_advanced");
 
+        el.servo_reader_low_latency =
+            document.getElementById("servo_reader_low_latency");
         el.auto_brake_lights_forward_enabled =
             document.getElementById("auto_brake_lights_forward_enabled");
         el.auto_brake_counter_value_forward_min =
@@ -1625,6 +2162,16 @@ var app = (function () {
         el.servo_pulse_max = document.getElementById("servo_pulse_max");
 
         el.startup_time = document.getElementById("startup_time");
+        el.render_rate = document.getElementById("render_rate");
+        el.servo_filter = document.getElementById("servo_filter");
+        el.brake_prediction = document.getElementById("brake_prediction");
+
+        el.config_ch3_gestures = document.getElementById("config_ch3_gestures");
+        el.ch3_gesture_table = document.getElementById("ch3_gesture_table");
+        el.ch3_long_press_time =
+            document.getElementById("ch3_long_press_time");
+        el.ch3_hold_time = document.getElementById("ch3_hold_time");
+        build_ch3_gesture_table();
 
         el.gamma_value = document.getElementById("gamma_value");
 
@@ -1635,8 +2182,15 @@ var app = (function () {
             update_section_visibility, false
             );
 
+        el.slave_distributed_rendering.addEventListener("change",
+            update_section_visibility, false
+            );
+
         set_led_feature_handler("leds_master", "master");
         set_led_feature_handler("leds_slave", "slave");
+        ADDITIONAL_SLAVES.forEach(function (slave) {
+            set_led_feature_handler(slave.div, slave.prefix);
+        });
 
         el.load_firmware.addEventListener("change", load_firmware_from_disk,
             false
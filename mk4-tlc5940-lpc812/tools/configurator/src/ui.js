@@ -122,6 +122,9 @@ var ui = (function () {
 
         init_led_section("leds_master", "master");
         init_led_section("leds_slave", "slave");
+        init_led_section("leds_slave2", "slave2");
+        init_led_section("leds_slave3", "slave3");
+        init_led_section("leds_slave4", "slave4");
     };
 
 
@@ -142,6 +145,9 @@ var ui = (function () {
                 elements = led_rows[led].getElementsByClassName("incandescent");
                 elements[0].id = prefix + led + "incandescent";
 
+                elements = led_rows[led].getElementsByClassName("incandescent_ms");
+                elements[0].id = prefix + led + "incandescent_ms";
+
                 elements = led_rows[led].getElementsByClassName("weak_ground");
                 elements[0].id = prefix + led + "weak_ground";
 
@@ -154,6 +160,9 @@ var ui = (function () {
 
         init_led_feature("leds_master", "master");
         init_led_feature("leds_slave", "slave");
+        init_led_feature("leds_slave2", "slave2");
+        init_led_feature("leds_slave3", "slave3");
+        init_led_feature("leds_slave4", "slave4");
     };
 
 
@@ -196,6 +205,30 @@ var ui = (function () {
 
         init_led_table("leds_master", 0);
         init_led_table("leds_slave", 16);
+        init_led_table("leds_slave2", 32);
+        init_led_table("leds_slave3", 48);
+        init_led_table("leds_slave4", 64);
+    };
+
+
+    // *************************************************************************
+    // Firmware for daisy-chained slaves contains up to three additional slave
+    // LED sections. Their tables are copies of the (still empty) slave table;
+    // main.js only shows those the loaded firmware contains.
+    var init_additional_slave_sections = function () {
+        var slave_section = document.getElementById("leds_slave");
+        var previous = slave_section;
+        var section;
+        var n;
+
+        for (n = 2; n <= 4; n += 1) {
+            section = slave_section.cloneNode(true);
+            section.id = "leds_slave" + n;
+            section.style.display = "none";
+            section.getElementsByTagName("h3")[0].innerHTML = "Slave " + n;
+            previous.parentNode.insertBefore(section, previous.nextSibling);
+            previous = section;
+        }
     };
 
 
@@ -264,6 +297,11 @@ var ui = (function () {
             "results in a fade time of approx 130 ms from off to on, " +
             "which is a realistic simulation for incandescent bulbs in " +
             "vintage cars.\n" +
+            "Alternatively a time constant in milliseconds can be given. " +
+            "The LED then approaches the new brightness like a real bulb: " +
+            "fast at first, slowing down towards the end. After one time " +
+            "constant the LED has covered approx 63% of the change. " +
+            "A time constant overrides the % change per 20 ms setting.\n" +
             "Note that slow fading causes visible steps at lower brightness " +
             "values due to the limited control range of the LED driver.");
 
@@ -371,6 +409,7 @@ var ui = (function () {
 
     // *************************************************************************
     var init = function () {
+        init_additional_slave_sections();
         init_led_tables();
         init_led_editing();
         init_led_features();
@@ -0,0 +1,230 @@
+#!/usr/bin/env python
+'''
+
+Decode the binary event log of the TLC5940/LPC812 based light controller.
+
+The light controller sends diagnostic events as 9 byte frames on its UART:
+
+    0xe5, event id, timestamp (uint16, LE), argument (uint32, LE), checksum
+
+The timestamp is in systicks (20 ms), the checksum is the sum of the 7 bytes
+following 0xe5, modulo 256. Any bytes outside of frames (e.g. ASCII text) are
+printed as they are.
+
+'''
+from __future__ import print_function
+import sys
+import struct
+import argparse
+
+EVENT_LOG_MAGIC_BYTE = 0xe5
+FRAME_LENGTH = 9
+SYSTICK_IN_MS = 20
+SYSTEM_CLOCK = 12000000
+CHANNEL_NAMES = ('ST', 'TH', 'CH3')
+GESTURE_NAMES = ('clicks', 'long press', 'hold')
+MODE_NAMES = ('servo reader', 'UART reader', 'CPPM reader', 'slave',
+    'SBUS reader', 'iBUS reader', 'auto detect')
+
+
+def signed16(value):
+    ''' Convert a 16 bit unsigned value to signed '''
+    return value - 0x10000 if value & 0x8000 else value
+
+
+def decode_channels(arg):
+    ''' EVENT_CHANNELS argument: ST in the upper, TH in the lower 16 bits '''
+    return 'ST: {:d}   TH: {:d}'.format(
+        signed16(arg >> 16), signed16(arg & 0xffff))
+
+
+def decode_preprocessor_statistics(arg):
+    ''' EVENT_PREPROCESSOR_STATISTICS argument, see firmware/uart_reader.c '''
+    return 'dropped={:d} partial={:d} max latency={:d}us'.format(
+        arg >> 24, (arg >> 16) & 0xff, arg & 0xffff)
+
+
+def decode_uart_transmit_statistics(arg):
+    ''' EVENT_UART_TRANSMIT_STATISTICS argument, see firmware/event_log.c '''
+    return 'dropped={:d} high watermark={:d}'.format(arg >> 16, arg & 0xffff)
+
+
+def decode_render_statistics(arg):
+    ''' EVENT_RENDER_STATISTICS argument, see firmware/lights.c '''
+    renders = arg >> 16
+    cycles = arg & 0xffff
+    return 'renders={:d} average cycles={:d} CPU load={:.1f}%'.format(
+        renders, cycles, 100.0 * renders * cycles / SYSTEM_CLOCK)
+
+
+def decode_sct_irq_statistics(arg):
+    ''' EVENT_SCT_IRQ_STATISTICS argument, see firmware/servo_reader.c '''
+    return 'interrupts={:d} average cycles={:d}'.format(
+        arg >> 16, arg & 0xffff)
+
+
+def decode_gesture(arg):
+    ''' EVENT_CH3_GESTURE argument, CH3_GESTURE_TYPE_T in firmware/globals.h '''
+    gesture = arg >> 8
+    name = GESTURE_NAMES[gesture] if gesture < len(GESTURE_NAMES) \
+        else '{:d}'.format(gesture)
+    return 'type={:s} clicks={:d}'.format(name, arg & 0xff)
+
+
+def decode_mode(arg):
+    ''' EVENT_INPUT_MODE_DETECTED argument, MASTER_MODE_T in firmware/globals.h '''
+    return MODE_NAMES[arg] if arg < len(MODE_NAMES) else '{:d}'.format(arg)
+
+
+def decode_servo_quality(arg):
+    ''' EVENT_SERVO_QUALITY argument, see firmware/servo_reader.c '''
+    channel = arg >> 24
+    name = CHANNEL_NAMES[channel] if channel < len(CHANNEL_NAMES) \
+        else 'CH{:d}'.format(channel + 1)
+    return '{:s} jitter={:d}us missing={:d} out of range={:d}'.format(
+        name, (arg >> 16) & 0xff, (arg >> 8) & 0xff, arg & 0xff)
+
+
+# Keep in sync with firmware/event_log.h
+EVENTS = {
+    0x01: ('events lost', lambda arg: '{:d}'.format(arg)),
+    0x02: ('Light controller initialized', None),
+    0x03: ('Stack down to', lambda arg: '0x{:08x}'.format(arg)),
+    0x04: ('Channels', decode_channels),
+    0x10: ('UART overrun', None),
+    0x11: ('UART frame error', None),
+    0x12: ('UART noise', None),
+    0x13: ('UART receive overflow', lambda arg: '{:d} bytes lost'.format(arg)),
+    0x14: ('UART transmit statistics', decode_uart_transmit_statistics),
+    0x20: ('add_click', None),
+    0x21: ('click_timeout', lambda arg: 'clicks={:d}'.format(arg)),
+    0x22: ('CH3 gesture', decode_gesture),
+    0x30: ('light_switch_position', lambda arg: '{:d}'.format(arg)),
+    0x31: ('Render statistics', decode_render_statistics),
+    0x40: ('UNKNOWN PARAMETER TYPE', lambda arg: '{:d}'.format(arg)),
+    0x41: ('UNKNOWN OPCODE', lambda arg: '0x{:02x}'.format(arg)),
+    0x50: ('slave CRC error', lambda arg: 'state frame' if arg == 0x8a
+        else 'sequence={:d}'.format(arg)),
+    0x51: ('slave sequence error', lambda arg: 'sequence={:d}'.format(arg)),
+    0x60: ('preprocessor CRC error',
+        lambda arg: 'sequence={:d}'.format(arg)),
+    0x61: ('preprocessor sequence error',
+        lambda arg: 'sequence={:d}'.format(arg)),
+    0x62: ('preprocessor statistics', decode_preprocessor_statistics),
+    0x70: ('SCT interrupt statistics', decode_sct_irq_statistics),
+    0x71: ('Servo signal quality', decode_servo_quality),
+    0x80: ('Input mode detected', decode_mode),
+    0x90: ('Flash error', lambda arg: 'IAP command={:d} status={:d}'.format(
+        arg >> 8, arg & 0xff)),
+}
+
+
+def parse_commandline():
+    ''' Command line option parsing '''
+    parser = argparse.ArgumentParser(
+        description='''\
+Decode the binary event log of the TLC5940/LPC812 based light controller,
+either live from a serial port or from a file containing a captured byte
+stream.''')
+
+    parser.add_argument("-b", "--baudrate", type=int, default=115200,
+        help='Baudrate to use. Default is 115200.')
+
+    parser.add_argument("-f", "--file", action='store_true',
+        help='Read from a file instead of a serial port.')
+
+    parser.add_argument("source", nargs='?', default="/dev/ttyUSB0",
+        help="Serial port or file name. Default is /dev/ttyUSB0.")
+
+    return parser.parse_args()
+
+
+def format_event(frame):
+    ''' Return a human readable string for a valid frame '''
+    event_id, timestamp, arg = struct.unpack(
+        '<BHI', bytes(bytearray(frame[1:8])))
+
+    try:
+        name, decoder = EVENTS[event_id]
+    except KeyError:
+        name, decoder = 'unknown event 0x{:02x}'.format(event_id), None
+
+    text = '[{:8.2f}s] {:s}'.format(
+        timestamp * SYSTICK_IN_MS / 1000.0, name)
+    if decoder:
+        text += ' ' + decoder(arg)
+    else:
+        if arg:
+            text += ' (0x{:x})'.format(arg)
+    return text
+
+
+class Decoder(object):
+    ''' Separates event frames from other output in a byte stream '''
+
+    def __init__(self, output):
+        self.output = output
+        self.frame = []
+        self.checksum_errors = 0
+
+    def process(self, byte):
+        ''' Process one byte of the stream '''
+        if not self.frame:
+            if byte == EVENT_LOG_MAGIC_BYTE:
+                self.frame = [byte]
+            else:
+                self.output.write(chr(byte))
+                self.output.flush()
+            return
+
+        self.frame.append(byte)
+        if len(self.frame) < FRAME_LENGTH:
+            return
+
+        frame = self.frame
+        self.frame = []
+        if (sum(frame[1:8]) & 0xff) != frame[8]:
+            self.checksum_errors += 1
+            self.output.write('<checksum error>\n')
+            # Re-synchronize on any magic byte within the broken frame
+            for i in range(1, FRAME_LENGTH):
+                if frame[i] == EVENT_LOG_MAGIC_BYTE:
+                    for b in frame[i:]:
+                        self.process(b)
+                    break
+            return
+
+        self.output.write(format_event(frame) + '\n')
+        self.output.flush()
+
+
+def main():
+    ''' Read the byte stream and decode it until EOF or CTRL+C '''
+    args = parse_commandline()
+    decoder = Decoder(sys.stdout)
+
+    if args.file:
+        with open(args.source, 'rb') as f:
+            for byte in bytearray(f.read()):
+                decoder.process(byte)
+        return
+
+    import serial
+    try:
+        uart = serial.Serial(args.source, args.baudrate)
+    except serial.SerialException as error:
+        print("Unable to open port %s: %s" % (args.source, error))
+        sys.exit(1)
+
+    try:
+        while True:
+            for byte in bytearray(uart.read(1)):
+                decoder.process(byte)
+    except KeyboardInterrupt:
+        print("")
+    finally:
+        uart.close()
+
+
+if __name__ == '__main__':
+    main()
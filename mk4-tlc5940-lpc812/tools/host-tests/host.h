@@ -0,0 +1,9 @@
+// Forced include for compiling firmware sources on the host (gcc -include).
+//
+// Replaces the Cortex-M intrinsics of CMSIS that do not exist on the host.
+#define __CORE_CMFUNC_H
+
+#include <string.h>
+
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
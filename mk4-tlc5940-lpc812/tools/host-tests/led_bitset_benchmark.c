@@ -0,0 +1,156 @@
+/******************************************************************************
+
+    Benchmark of the LED bitset in the light program interpreter.
+
+    Before the LED bitset (LED_BITSET_T) the LEDs used by light programs were
+    held in a plain uint32_t. This benchmark runs the code that changed --
+    accumulating the "leds used" words of every program and testing the bit
+    of every LED that a SET or FADE instruction touches -- over the default
+    light programs, once with the plain uint32_t and once with LED_BITSET_T.
+
+    Built for up to 32 LEDs the bitset must produce identical results and
+    must not be slower.
+
+******************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <globals.h>
+#include "../../firmware/config_light_programs.c"
+
+#define ITERATIONS 200000
+#define RUNS 5
+
+static uint8_t setpoint_uint32[MAX_LIGHTS];
+static uint8_t setpoint_bitset[MAX_LIGHTS];
+
+
+// ****************************************************************************
+static int is_led_instruction(uint32_t instruction)
+{
+    uint8_t opcode = instruction >> 24;
+
+    return opcode == OPCODE_SET  ||  opcode == OPCODE_SET_I  ||
+        opcode == OPCODE_FADE  ||  opcode == OPCODE_FADE_I;
+}
+
+
+// ****************************************************************************
+// The LEDs-used handling of execute_program() before the LED bitset
+static __attribute__ ((noinline)) void execute_uint32(
+    const uint32_t *program, uint32_t *leds_used)
+{
+    uint32_t leds_already_used;
+    const uint32_t *pc;
+    int i;
+
+    leds_already_used = *leds_used;
+    *leds_used |= *(program + LEDS_USED_OFFSET);
+
+    for (pc = program + LEDS_USED_OFFSET + 1;
+            (*pc >> 24) != OPCODE_END_OF_PROGRAM; pc++) {
+        if (is_led_instruction(*pc)) {
+            for (i = (*pc >> 8) & 0xff; i <= (int)((*pc >> 16) & 0xff); i++) {
+                if ((leds_already_used & (1 << i)) == 0) {
+                    setpoint_uint32[i] = *pc & 0xff;
+                }
+            }
+        }
+    }
+}
+
+
+// ****************************************************************************
+// The same with LED_BITSET_T, as in light_programs.c
+static __attribute__ ((noinline)) void execute_bitset(
+    const uint32_t *program, LED_BITSET_T *leds_used)
+{
+    LED_BITSET_T leds_already_used;
+    const uint32_t *pc;
+    int i;
+    int w;
+
+    leds_already_used = *leds_used;
+    for (w = 0; w < LED_BITSET_WORDS; w++) {
+        leds_used->word[w] |= *(program + LEDS_USED_OFFSET + w);
+    }
+
+    for (pc = program + LEDS_USED_OFFSET + LED_BITSET_WORDS;
+            (*pc >> 24) != OPCODE_END_OF_PROGRAM; pc++) {
+        if (is_led_instruction(*pc)) {
+            for (i = (*pc >> 8) & 0xff; i <= (int)((*pc >> 16) & 0xff); i++) {
+                if (!LED_BITSET_IS_SET(&leds_already_used, i)) {
+                    setpoint_bitset[i] = *pc & 0xff;
+                }
+            }
+        }
+    }
+}
+
+
+// ****************************************************************************
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+
+// ****************************************************************************
+int main(void)
+{
+    uint64_t best_uint32 = UINT64_MAX;
+    uint64_t best_bitset = UINT64_MAX;
+    uint32_t leds_used_uint32 = 0;
+    LED_BITSET_T leds_used_bitset;
+    uint64_t start;
+    uint64_t elapsed;
+    int run;
+    int n;
+    int i;
+
+    for (run = 0; run < RUNS; run++) {
+        start = now_ns();
+        for (n = 0; n < ITERATIONS; n++) {
+            leds_used_uint32 = 0;
+            for (i = 0; i < light_programs.number_of_programs; i++) {
+                execute_uint32(light_programs.start[i], &leds_used_uint32);
+            }
+        }
+        elapsed = now_ns() - start;
+        if (elapsed < best_uint32) {
+            best_uint32 = elapsed;
+        }
+
+        start = now_ns();
+        for (n = 0; n < ITERATIONS; n++) {
+            memset(&leds_used_bitset, 0, sizeof(leds_used_bitset));
+            for (i = 0; i < light_programs.number_of_programs; i++) {
+                execute_bitset(light_programs.start[i], &leds_used_bitset);
+            }
+        }
+        elapsed = now_ns() - start;
+        if (elapsed < best_bitset) {
+            best_bitset = elapsed;
+        }
+    }
+
+    printf("LED_BITSET_WORDS %d, %d light programs\n",
+        LED_BITSET_WORDS, light_programs.number_of_programs);
+    printf("uint32_t:     %6.1f ns per systick\n",
+        (double)best_uint32 / ITERATIONS);
+    printf("LED_BITSET_T: %6.1f ns per systick (%+.1f%%)\n",
+        (double)best_bitset / ITERATIONS,
+        100.0 * ((double)best_bitset - best_uint32) / best_uint32);
+
+    if (leds_used_bitset.word[0] != leds_used_uint32  ||
+            memcmp(setpoint_uint32, setpoint_bitset, sizeof(setpoint_uint32))) {
+        printf("FAIL: results differ\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,330 @@
+/******************************************************************************
+
+    Benchmark of the per-LED output path of the car lights.
+
+    Before process_light_output() each systick ran three separate passes over
+    the LEDs: process_light() with the weak ground simulation dividing by
+    100, a loop applying the incandescent simulation from light_setpoint to
+    light_actual, and the gamma lookup and quantization while sending to the
+    TLC5940 and the slave. Now the weak ground simulation multiplies with a
+    Q16 multiplier calculated at startup, and a single pass does the fading,
+    gamma correction and quantization into light_output[].
+
+    This benchmark runs both variants for 16 local and 16 slave LEDs through
+    a sequence of systicks with changing light switch positions, braking and
+    blinking. The LEDs use a mix of the weak ground simulation, the linear
+    ramp and the incandescent filter. Both variants must produce identical
+    output.
+
+    The host CPU divides in hardware, so the host timing only shows the
+    saving of the single pass. On the LPC812 every division printed as
+    removed is additionally a call of the division library routine.
+
+******************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../../firmware/lights.c"
+#include "../../firmware/config.c"
+
+#define SYSTICKS 256
+#define ITERATIONS 500
+#define RUNS 20
+
+GLOBAL_FLAGS_T global_flags;
+CHANNEL_T channel[3];
+MASTER_MODE_T operating_mode;
+
+// Every LED is on with tail and brake, every second one dims with the
+// indicators on a weak ground. The fade alternates between none, the linear
+// ramp and the incandescent filter.
+#define BENCHMARK_LED(n) {                                              \
+        .features = {                                                   \
+            .reduction_percent = ((n) & 1) ? 0 : 10 + 3 * (n),          \
+            .indicator_left = 1,                                        \
+            .indicator_right = 1,                                       \
+            .max_change_per_systick = ((n) % 3 == 1) ? 37 : 0,          \
+            .incandescent_ms = ((n) % 3 == 2) ? 140 : 0                 \
+        },                                                              \
+        .light_switch_position = {0, 40, 80, 120, 160, 200, 240, 255, 255}, \
+        .tail_light = 60,                                               \
+        .brake_light = 255,                                             \
+        .reversing_light = (n) * 16,                                    \
+        .indicator_left = ((n) & 2) ? 255 : 0,                          \
+        .indicator_right = ((n) & 4) ? 255 : 0                          \
+    }
+
+#define BENCHMARK_LEDS {                                                \
+        BENCHMARK_LED(0), BENCHMARK_LED(1), BENCHMARK_LED(2),           \
+        BENCHMARK_LED(3), BENCHMARK_LED(4), BENCHMARK_LED(5),           \
+        BENCHMARK_LED(6), BENCHMARK_LED(7), BENCHMARK_LED(8),           \
+        BENCHMARK_LED(9), BENCHMARK_LED(10), BENCHMARK_LED(11),         \
+        BENCHMARK_LED(12), BENCHMARK_LED(13), BENCHMARK_LED(14),        \
+        BENCHMARK_LED(15)                                               \
+    }
+
+const CAR_LIGHT_ARRAY_T local_leds = {
+    .led_count = 16,
+    .car_lights = (const CAR_LIGHT_T [16]) BENCHMARK_LEDS
+};
+
+const CAR_LIGHT_ARRAY_T slave_leds[MAX_SLAVES] = {
+    {
+        .led_count = 16,
+        .car_lights = (const CAR_LIGHT_T [16]) BENCHMARK_LEDS
+    }
+};
+
+// What the TLC5940 and the slave receive, summed up over all systicks
+static uint32_t sent_division;
+static uint32_t sent_kernel;
+
+
+// ****************************************************************************
+// Stubs of the firmware functions that lights.c calls
+void log_event(EVENT_ID_T id, uint32_t arg) {}
+bool diagnostics_enabled(void) { return false; }
+uint16_t get_render_rate(void) { return __SYSTICK_RATE; }
+void init_light_programs(void) {}
+void process_light_program_events(void) {}
+void process_light_programs(LED_BITSET_T *leds_used)
+{
+    memset(leds_used, 0, sizeof(*leds_used));
+}
+void uart0_send_char(const char c) {}
+bool uart0_read_is_byte_pending(void) { return false; }
+uint8_t uart0_read_byte(void) { return 0; }
+uint8_t crc8(const uint8_t *data, int length) { return 0; }
+
+
+// ****************************************************************************
+// process_light() with the weak ground simulation dividing by 100
+static __attribute__ ((noinline)) void process_light_division(
+    const CAR_LIGHT_T *light, int i)
+{
+    LED_T result = 0;
+
+    max_change_per_systick[i] = light->features.max_change_per_systick;
+    incandescent_alpha[i] = configured_incandescent_alpha[i];
+
+    set_car_light(&result, light, ALWAYS_ON);
+
+    mix_car_light(&result, light, LIGHT_SWITCH_POSITION + light_switch_position);
+
+    if (global_flags.reversing) {
+        mix_car_light(&result, light, REVERSING_LIGHT);
+    }
+
+    if (!is_value_zero(light, TAIL_LIGHT) &&
+        !is_value_zero(light, BRAKE_LIGHT) &&
+        (   !is_value_zero(light, INDICATOR_LEFT) ||
+            !is_value_zero(light, INDICATOR_RIGHT))) {
+        combined_tail_brake_indicators(&result, light);
+    }
+    else {
+        combined_tail_brake(&result, light);
+
+        if (global_flags.blink_flag) {
+            if (global_flags.blink_hazard ||
+                global_flags.blink_indicator_left) {
+                mix_car_light(&result, light, INDICATOR_LEFT);
+            }
+            if (global_flags.blink_hazard ||
+                global_flags.blink_indicator_right) {
+                mix_car_light(&result, light, INDICATOR_RIGHT);
+            }
+        }
+    }
+
+    if (light->features.reduction_percent != 0  &&
+            is_light_affected(&light->features)) {
+        result = (uint16_t)result *
+            (100 - light->features.reduction_percent) / 100;
+    }
+    light_setpoint[i] = result;
+}
+
+
+// ****************************************************************************
+// One systick of the output path before the single-pass kernel
+static __attribute__ ((noinline)) void systick_division(void)
+{
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        process_light_division(&local_leds.car_lights[i], i);
+    }
+    for (i = 0; i < 16; i++) {
+        process_light_division(&slave_leds[0].car_lights[i], 16 + i);
+    }
+
+    for (i = 0; i < MAX_LIGHTS ; i++) {
+        if (incandescent_alpha[i] > 0) {
+            light_actual[i] = calculate_filtered_value(
+                &light_filtered[i], light_setpoint[i], incandescent_alpha[i]);
+            continue;
+        }
+
+        if (max_change_per_systick[i] > 0) {
+            light_actual[i] = calculate_step_value(
+                light_actual[i], light_setpoint[i], max_change_per_systick[i]);
+        }
+        else {
+            light_actual[i] = light_setpoint[i];
+        }
+        light_filtered[i] = light_actual[i] << 8;
+    }
+
+    // Sending to the TLC5940 and the slave
+    for (i = 0; i < MAX_LIGHTS; i++) {
+        sent_division += gamma_table.gamma_table[light_actual[i]] >> 2;
+    }
+}
+
+
+// ****************************************************************************
+// One systick of the output path as in process_car_lights()
+static __attribute__ ((noinline)) void systick_kernel(void)
+{
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        process_light(&local_leds.car_lights[i], i);
+    }
+    for (i = 0; i < 16; i++) {
+        process_light(&slave_leds[0].car_lights[i], 16 + i);
+    }
+
+    process_light_output();
+
+    // Sending to the TLC5940 and the slave
+    for (i = 0; i < MAX_LIGHTS; i++) {
+        sent_kernel += light_output[i];
+    }
+}
+
+
+// ****************************************************************************
+// Number of LEDs that the weak ground simulation dims in the current systick,
+// i.e. the number of divisions before the Q16 multipliers
+static uint32_t count_weak_ground_leds(void)
+{
+    uint32_t count = 0;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        if (local_leds.car_lights[i].features.reduction_percent  &&
+                is_light_affected(&local_leds.car_lights[i].features)) {
+            ++count;
+        }
+        if (slave_leds[0].car_lights[i].features.reduction_percent  &&
+                is_light_affected(&slave_leds[0].car_lights[i].features)) {
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+
+// ****************************************************************************
+// Run all systicks of the benchmark from a dark start. If divisions is not
+// NULL it returns the number of divisions the weak ground simulation needed
+// before the Q16 multipliers.
+static void run_systicks(void (*systick)(void), uint32_t *divisions)
+{
+    int t;
+
+    memset(light_setpoint, 0, sizeof(light_setpoint));
+    memset(light_actual, 0, sizeof(light_actual));
+    memset(light_filtered, 0, sizeof(light_filtered));
+
+    for (t = 0; t < SYSTICKS; t++) {
+        light_switch_position = (t >> 5) % LIGHT_SWITCH_POSITIONS;
+        global_flags.braking = (t >> 3) & 1;
+        global_flags.reversing = (t >> 6) & 1;
+        global_flags.blink_flag = (t >> 2) & 1;
+        global_flags.blink_indicator_left = (t >> 4) & 1;
+        global_flags.blink_hazard = (t >> 7) & 1;
+        systick();
+
+        if (divisions) {
+            *divisions += count_weak_ground_leds();
+        }
+    }
+}
+
+
+// ****************************************************************************
+static uint64_t now_ns(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+
+// ****************************************************************************
+static uint64_t measure(void (*systick)(void))
+{
+    uint64_t start;
+    int n;
+
+    start = now_ns();
+    for (n = 0; n < ITERATIONS; n++) {
+        run_systicks(systick, NULL);
+    }
+    return now_ns() - start;
+}
+
+
+// ****************************************************************************
+int main(void)
+{
+    uint8_t actual_division[MAX_LIGHTS];
+    uint32_t divisions = 0;
+    uint64_t best_division = UINT64_MAX;
+    uint64_t best_kernel = UINT64_MAX;
+    uint64_t elapsed;
+    int run;
+
+    render_period_ms = 1000 / __SYSTICK_RATE;
+    render_ticks_per_systick = 1;
+    init_car_light_coefficients(&local_leds, 0);
+    init_car_light_coefficients(&slave_leds[0], 16);
+
+    // Check that both variants produce the same output
+    run_systicks(systick_division, &divisions);
+    memcpy(actual_division, light_actual, sizeof(actual_division));
+    run_systicks(systick_kernel, NULL);
+    if (sent_division != sent_kernel  ||
+            memcmp(actual_division, light_actual, sizeof(actual_division))) {
+        printf("FAIL: results differ\n");
+        return 1;
+    }
+
+    // Alternate the variants so that both see the same load of the host
+    for (run = 0; run < RUNS; run++) {
+        elapsed = measure(systick_division);
+        if (elapsed < best_division) {
+            best_division = elapsed;
+        }
+        elapsed = measure(systick_kernel);
+        if (elapsed < best_kernel) {
+            best_kernel = elapsed;
+        }
+    }
+
+    printf("%d local and %d slave LEDs, %.1f divisions per systick removed\n",
+        local_leds.led_count, slave_leds[0].led_count,
+        (double)divisions / SYSTICKS);
+    printf("Division, 3 passes: %6.1f ns per systick\n",
+        (double)best_division / ((uint64_t)ITERATIONS * SYSTICKS));
+    printf("Single-pass kernel: %6.1f ns per systick (%+.1f%%)\n",
+        (double)best_kernel / ((uint64_t)ITERATIONS * SYSTICKS),
+        100.0 * ((double)best_kernel - best_division) / best_division);
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+/******************************************************************************
+
+    Light programs on firmware built for four slaves (80 LEDs).
+
+    The "leds used" bitset of the light program header has three words in
+    this build. Checks that
+    - the default light programs (section version 1, a single word) run,
+    - programs assembled for 80 LEDs (section version 3) run and reach the
+      LEDs of the last slave,
+    - programs assembled for more LEDs than the firmware has are rejected.
+
+******************************************************************************/
+#define MAX_SLAVES 4
+
+#include <stdio.h>
+#include <stdint.h>
+
+// light_programs.c reads the light program section through a pointer to
+// the programs under test, which the test owns and loads
+#define light_programs (*light_programs_under_test)
+#include "../../firmware/light_programs.c"
+#undef light_programs
+
+static LIGHT_PROGRAMS_T test_programs;
+const LIGHT_PROGRAMS_T *light_programs_under_test = &test_programs;
+
+const LIGHT_CONTROLLER_CONFIG_T config;
+GLOBAL_FLAGS_T global_flags;
+CHANNEL_T channel[3];
+EXTRA_CHANNEL_T extra_channel[EXTRA_CHANNELS];
+
+LED_T light_setpoint[MAX_LIGHTS];
+LED_T light_actual[MAX_LIGHTS];
+uint8_t max_change_per_systick[MAX_LIGHTS];
+uint16_t incandescent_alpha[MAX_LIGHTS];
+uint8_t light_switch_position;
+
+// The default light programs, renamed so that they can be loaded into
+// test_programs
+#define light_programs default_light_programs
+#include "../../firmware/config_light_programs.c"
+#undef light_programs
+
+static int failures;
+
+
+// ****************************************************************************
+void log_event(EVENT_ID_T id, uint32_t arg)
+{
+    (void) id;
+    (void) arg;
+}
+
+
+// ****************************************************************************
+uint16_t random_min_max(uint16_t min, uint16_t max)
+{
+    (void) max;
+    return min;
+}
+
+
+// ****************************************************************************
+static void check(int condition, const char *message)
+{
+    if (!condition) {
+        printf("FAIL: %s\n", message);
+        ++failures;
+    }
+}
+
+
+// ****************************************************************************
+// Load a program section with the given version and a single program. The
+// program sets LED 'led' to 100%.
+static void load_single_program(int version, int led)
+{
+    LIGHT_PROGRAMS_T *p = &test_programs;
+    uint32_t *code = p->programs;
+    int w;
+
+    memset(p, 0, sizeof(*p));
+    p->magic.magic_value = ROM_MAGIC;
+    p->magic.type = LIGHT_PROGRAMS;
+    p->magic.version = version;
+    p->number_of_programs = 1;
+    p->start[0] = code;
+
+    *code++ = 0;                                    // Priority run state
+    *code++ = RUN_ALWAYS;                           // Run state
+    for (w = 0; w < version; w++) {                 // LEDs used
+        *code++ = (w == (led >> 5)) ? (1u << (led & 31)) : 0;
+    }
+    *code++ = (OPCODE_SET_I << 24) | START_LED(led) | STOP_LED(led) | 100;
+    *code++ = OPCODE_END_OF_PROGRAM << 24;
+    *code++ = OPCODE_END_OF_PROGRAMS << 24;
+}
+
+
+// ****************************************************************************
+int main(void)
+{
+    LED_BITSET_T leds_used;
+    int i;
+
+    // The default light programs: LED 2 and 3 are on while initializing
+    memcpy(&test_programs, &default_light_programs, sizeof(test_programs));
+    for (i = 0; i < default_light_programs.number_of_programs; i++) {
+        test_programs.start[i] = test_programs.programs +
+            (default_light_programs.start[i] - default_light_programs.programs);
+    }
+    global_flags.initializing = 1;
+    init_light_programs();
+    process_light_programs(&leds_used);
+    check(number_of_programs == default_light_programs.number_of_programs,
+        "version 1 light programs are not run");
+    check(light_setpoint[2] == 255  &&  light_setpoint[3] == 255,
+        "version 1 light program did not set LED 2 and 3");
+    check(leds_used.word[0] == 0xffffffff  &&  leds_used.word[1] == 0  &&
+        leds_used.word[2] == 0, "version 1 light program LEDs used");
+    global_flags.initializing = 0;
+
+    // Light programs assembled for 80 LEDs
+    load_single_program(3, 70);
+    init_light_programs();
+    process_light_programs(&leds_used);
+    check(number_of_programs == 1, "version 3 light programs are not run");
+    check(light_setpoint[70] == 255, "version 3 light program did not set LED 70");
+    check(leds_used.word[0] == 0  &&  leds_used.word[1] == 0  &&
+        leds_used.word[2] == (1 << 6), "version 3 light program LEDs used");
+
+    // Light programs assembled for more than 96 LEDs
+    load_single_program(4, 2);
+    init_light_programs();
+    check(number_of_programs == 0, "version 4 light programs are not rejected");
+
+    printf("LED_BITSET_WORDS %d: %s\n", LED_BITSET_WORDS,
+        failures ? "FAIL" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,253 @@
+/******************************************************************************
+
+    Bit-exact test of the division-free normalization.
+
+    normalize_channel() in servo_reader.c and calculate_servo_pulse() in
+    servo_output.c multiply by fixed-point reciprocals of the endpoint spans
+    instead of dividing, as the LPC812 has no hardware divider. This test
+    compares them against the division code they replaced:
+
+    - normalize_channel() for every pulse from 600 to 2500 us, every centre
+      between SERVO_PULSE_CLAMP_LOW and SERVO_PULSE_CLAMP_HIGH, and initial
+      endpoint spans from 1 us to the full range. Pulses beyond the endpoints
+      exercise endpoint learning and the recalculation of the reciprocals.
+      Both normal and reversed channels are tested.
+
+    - calculate_servo_pulse() for every servo output span from -1900 to
+      1900 us (reversed and normal servos) on both sides, and every steering
+      value from -100 to 100.
+
+******************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+
+#include "../../firmware/servo_reader.c"
+#include "../../firmware/servo_output.c"
+
+const LIGHT_CONTROLLER_CONFIG_T config = {
+    .servo_pulse_min = 600,
+    .servo_pulse_max = 2500,
+};
+GLOBAL_FLAGS_T global_flags;
+CHANNEL_T channel[3];
+EXTRA_CHANNEL_T extra_channel[EXTRA_CHANNELS];
+MASTER_MODE_T operating_mode;
+
+static const uint16_t spans[] = {
+    1, 2, 3, 5, 7, 10, 50, 99, 100, 101, 150, 199, 200, 201, 250, 299, 300,
+    333, 350, 399, 400, 401, 450, 499, 500, 501, 550, 600, 650, 700, 750,
+    800, 1000, 1500
+};
+
+static unsigned long failures;
+
+
+// ****************************************************************************
+void log_event(EVENT_ID_T id, uint32_t arg)
+{
+}
+
+
+// ****************************************************************************
+// normalize_channel() before the reciprocals were introduced
+static void normalize_channel_division(CHANNEL_T *c)
+{
+    if (c->raw_data < config.servo_pulse_min  ||  c->raw_data > config.servo_pulse_max) {
+        c->normalized = 0;
+        c->normalized_fine = 0;
+        c->absolute = 0;
+        return;
+    }
+
+    if (c->raw_data < SERVO_PULSE_CLAMP_LOW) {
+        c->raw_data = SERVO_PULSE_CLAMP_LOW;
+    }
+
+    if (c->raw_data > SERVO_PULSE_CLAMP_HIGH) {
+        c->raw_data = SERVO_PULSE_CLAMP_HIGH;
+    }
+
+    if (c->raw_data == c->endpoint.centre) {
+        c->normalized = 0;
+        c->normalized_fine = 0;
+    }
+    else if (c->raw_data < c->endpoint.centre) {
+        if (c->raw_data < c->endpoint.left) {
+            c->endpoint.left = c->raw_data;
+        }
+        c->normalized = (c->endpoint.centre - c->raw_data) * 101 /
+            (c->endpoint.centre - c->endpoint.left);
+        if (c->normalized > 100) {
+            c->normalized = 100;
+        }
+        c->normalized_fine = (c->endpoint.centre - c->raw_data) * 501 /
+            (c->endpoint.centre - c->endpoint.left);
+        if (c->normalized_fine > 500) {
+            c->normalized_fine = 500;
+        }
+        if (!c->reversed) {
+            c->normalized = -c->normalized;
+            c->normalized_fine = -c->normalized_fine;
+        }
+    }
+    else {
+        if (c->raw_data > c->endpoint.right) {
+            c->endpoint.right = c->raw_data;
+        }
+        c->normalized = (c->raw_data - c->endpoint.centre) * 101 /
+            (c->endpoint.right - c->endpoint.centre);
+        if (c->normalized > 100) {
+            c->normalized = 100;
+        }
+        c->normalized_fine = (c->raw_data - c->endpoint.centre) * 501 /
+            (c->endpoint.right - c->endpoint.centre);
+        if (c->normalized_fine > 500) {
+            c->normalized_fine = 500;
+        }
+        if (c->reversed) {
+            c->normalized = -c->normalized;
+            c->normalized_fine = -c->normalized_fine;
+        }
+    }
+
+    if (c->normalized < 0) {
+        c->absolute = -c->normalized;
+    }
+    else {
+        c->absolute = c->normalized;
+    }
+}
+
+
+// ****************************************************************************
+// calculate_servo_pulse() before the pre-scaled spans were introduced
+static uint16_t calculate_servo_pulse_division(void)
+{
+    if (channel[ST].normalized < 0) {
+        return servo_output_endpoint.centre -
+            (((servo_output_endpoint.centre - servo_output_endpoint.left) *
+                channel[ST].absolute) / 100);
+    }
+    else {
+        return servo_output_endpoint.centre +
+            (((servo_output_endpoint.right - servo_output_endpoint.centre) *
+                channel[ST].absolute) / 100);
+    }
+}
+
+
+// ****************************************************************************
+static void test_normalize_channel(void)
+{
+    CHANNEL_T initial;
+    CHANNEL_T expected;
+    CHANNEL_T actual;
+    unsigned long count = 0;
+    unsigned int s;
+    uint16_t centre;
+    uint16_t pulse;
+    int reversed;
+
+    for (reversed = 0; reversed <= 1; reversed++) {
+        for (centre = SERVO_PULSE_CLAMP_LOW; centre <= SERVO_PULSE_CLAMP_HIGH; centre++) {
+            for (s = 0; s < sizeof(spans) / sizeof(spans[0]); s++) {
+                memset(&initial, 0, sizeof(initial));
+                initial.reversed = reversed;
+                initial.endpoint.centre = centre;
+                initial.endpoint.left = centre - spans[s];
+                initial.endpoint.right = centre + spans[s];
+                if (initial.endpoint.left < SERVO_PULSE_CLAMP_LOW) {
+                    initial.endpoint.left = SERVO_PULSE_CLAMP_LOW;
+                }
+                if (initial.endpoint.right > SERVO_PULSE_CLAMP_HIGH) {
+                    initial.endpoint.right = SERVO_PULSE_CLAMP_HIGH;
+                }
+                // Only a centre on the clamp limit has a zero span; the
+                // division code can not handle it either.
+                if (initial.endpoint.left == centre  ||
+                        initial.endpoint.right == centre) {
+                    continue;
+                }
+                update_reciprocals(&initial);
+
+                for (pulse = 600; pulse <= 2500; pulse++) {
+                    expected = initial;
+                    expected.raw_data = pulse;
+                    actual = expected;
+
+                    normalize_channel_division(&expected);
+                    normalize_channel(&actual);
+                    ++count;
+
+                    if (actual.normalized != expected.normalized  ||
+                            actual.normalized_fine != expected.normalized_fine  ||
+                            actual.absolute != expected.absolute  ||
+                            actual.endpoint.left != expected.endpoint.left  ||
+                            actual.endpoint.right != expected.endpoint.right) {
+                        if (failures < 10) {
+                            printf("FAIL: normalize_channel %u/%u/%u %s, "
+                                "pulse %u: %d %d, expected %d %d\n",
+                                initial.endpoint.left, centre,
+                                initial.endpoint.right,
+                                reversed ? "reversed" : "normal", pulse,
+                                actual.normalized, actual.normalized_fine,
+                                expected.normalized, expected.normalized_fine);
+                        }
+                        ++failures;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("normalize_channel: %lu cases\n", count);
+}
+
+
+// ****************************************************************************
+static void test_servo_output(void)
+{
+    unsigned long count = 0;
+    uint16_t expected;
+    int span;
+    int steering;
+
+    servo_output_endpoint.centre = 2000;
+    for (span = -1900; span <= 1900; span++) {
+        // Both sides with the same span; the left side is normally negative
+        servo_output_endpoint.left = servo_output_endpoint.centre + span;
+        servo_output_endpoint.right = servo_output_endpoint.centre + span;
+        update_servo_output_scale();
+
+        for (steering = -100; steering <= 100; steering++) {
+            channel[ST].normalized = steering;
+            channel[ST].absolute = (steering < 0) ? -steering : steering;
+
+            expected = calculate_servo_pulse_division();
+            calculate_servo_pulse();
+            ++count;
+
+            if (servo_pulse != expected) {
+                if (failures < 10) {
+                    printf("FAIL: calculate_servo_pulse span %d, steering %d: "
+                        "%u, expected %u\n", span, steering, servo_pulse,
+                        expected);
+                }
+                ++failures;
+            }
+        }
+    }
+
+    printf("calculate_servo_pulse: %lu cases\n", count);
+}
+
+
+// ****************************************************************************
+int main(void)
+{
+    test_normalize_channel();
+    test_servo_output();
+
+    printf("%s\n", failures ? "FAIL" : "OK");
+    return failures ? 1 : 0;
+}
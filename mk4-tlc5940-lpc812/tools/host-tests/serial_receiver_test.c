@@ -0,0 +1,289 @@
+/******************************************************************************
+
+    Test of the SBUS and iBUS parsers in serial_receiver.c.
+
+    The frames below were recorded from encode_sbus() and encode_ibus() of
+    tools/preprocessor-simulator.py:
+
+        A: 1000, 1500, 2000 us
+        B: ST -50 %, TH 30 %, CH3 100 % (1250, 1650, 2000 us)
+
+    Byte streams built from them, with leading junk, corrupted frames and
+    SBUS frames with the failsafe or frame lost flag, are fed through
+    read_serial_receiver(), all at once and byte by byte. The test checks
+    the pulses that are published, and that a frame is only published if it
+    directly follows a valid frame.
+
+******************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+
+#include "../../firmware/serial_receiver.c"
+
+#define MAX_STREAM_LENGTH 256
+#define MAX_PUBLISHED 16
+
+GLOBAL_FLAGS_T global_flags;
+MASTER_MODE_T operating_mode;
+
+static const uint8_t sbus_a[SBUS_FRAME_LENGTH] = {
+    0x0f, 0xc0, 0x00, 0x1f, 0xc0, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00
+};
+
+static const uint8_t sbus_b[SBUS_FRAME_LENGTH] = {
+    0x0f, 0x50, 0x82, 0x26, 0xc0, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00
+};
+
+// 1500 us on all channels with the failsafe flag set
+static const uint8_t sbus_failsafe[SBUS_FRAME_LENGTH] = {
+    0x0f, 0xe0, 0x03, 0x1f, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08,
+    0x00
+};
+
+static const uint8_t ibus_a[IBUS_FRAME_LENGTH] = {
+    0x20, 0x40, 0xe8, 0x03, 0xdc, 0x05, 0xd0, 0x07, 0xdc, 0x05, 0xdc, 0x05,
+    0xdc, 0x05, 0xdc, 0x05, 0xdc, 0x05, 0xdc, 0x05, 0xdc, 0x05, 0xdc, 0x05,
+    0xdc, 0x05, 0xdc, 0x05, 0xdc, 0x05, 0x51, 0xf3
+};
+
+static const uint8_t ibus_b[IBUS_FRAME_LENGTH] = {
+    0x20, 0x40, 0xe2, 0x04, 0x72, 0x06, 0xd0, 0x07, 0xdc, 0x05, 0xdc, 0x05,
+    0xdc, 0x05, 0xdc, 0x05, 0xdc, 0x05, 0xdc, 0x05, 0xdc, 0x05, 0xdc, 0x05,
+    0xdc, 0x05, 0xdc, 0x05, 0xdc, 0x05, 0xbf, 0xf3
+};
+
+static const uint16_t pulses_a[3] = {1000, 1500, 2000};
+static const uint16_t pulses_b[3] = {1250, 1650, 2000};
+
+// The byte stream read by read_serial_receiver()
+static uint8_t stream[MAX_STREAM_LENGTH];
+static int stream_length;
+static int stream_index;
+static int stream_available;
+
+// The pulses published by read_serial_receiver()
+static uint16_t published[MAX_PUBLISHED][3];
+static int published_count;
+
+static int failures;
+
+
+// ****************************************************************************
+bool uart0_read_is_byte_pending(void)
+{
+    return stream_index < stream_available;
+}
+
+
+// ****************************************************************************
+uint8_t uart0_read_byte(void)
+{
+    return stream[stream_index++];
+}
+
+
+// ****************************************************************************
+void publish_servo_pulses(const uint16_t pulse[3])
+{
+    if (published_count < MAX_PUBLISHED) {
+        memcpy(published[published_count], pulse, sizeof(published[0]));
+    }
+    ++published_count;
+}
+
+
+// ****************************************************************************
+static void start_stream(MASTER_MODE_T mode)
+{
+    operating_mode = mode;
+    stream_length = 0;
+}
+
+
+// ****************************************************************************
+static void append(const uint8_t *data, int length)
+{
+    memcpy(&stream[stream_length], data, length);
+    stream_length += length;
+}
+
+
+// ****************************************************************************
+// Append a copy of the frame with one byte changed
+static void append_modified(const uint8_t *data, int length, int index,
+    uint8_t value)
+{
+    append(data, length);
+    stream[stream_length - length + index] = value;
+}
+
+
+// ****************************************************************************
+// Feed the stream to a freshly started parser, either all at once or byte by
+// byte, and compare the published pulses with the expected ones
+static void check_stream(const char *name, int bytes_per_call,
+    const uint16_t * const expected[], int expected_count)
+{
+    int i;
+
+    received = 0;
+    synchronized = false;
+    published_count = 0;
+    stream_index = 0;
+    stream_available = 0;
+
+    while (stream_available < stream_length) {
+        stream_available += bytes_per_call;
+        if (stream_available > stream_length) {
+            stream_available = stream_length;
+        }
+        read_serial_receiver();
+    }
+
+    if (published_count != expected_count) {
+        printf("FAIL: %s (%d bytes per call): %d frames published, "
+            "expected %d\n", name, bytes_per_call, published_count,
+            expected_count);
+        ++failures;
+    }
+    else {
+        for (i = 0; i < expected_count; i++) {
+            if (memcmp(published[i], expected[i], sizeof(published[0]))) {
+                printf("FAIL: %s (%d bytes per call): frame %d is "
+                    "%u %u %u, expected %u %u %u\n", name, bytes_per_call, i,
+                    published[i][0], published[i][1], published[i][2],
+                    expected[i][0], expected[i][1], expected[i][2]);
+                ++failures;
+            }
+        }
+    }
+}
+
+
+// ****************************************************************************
+static void check(const char *name, const uint16_t * const expected[],
+    int expected_count)
+{
+    check_stream(name, MAX_STREAM_LENGTH, expected, expected_count);
+    check_stream(name, 1, expected, expected_count);
+}
+
+
+// ****************************************************************************
+static void test_sbus(void)
+{
+    static const uint8_t junk[] = {0x55, 0xaa, 0x00, 0xff};
+    static const uint8_t junk_with_header[] = {0x55, 0x0f, 0x12, 0x00, 0xff};
+
+    // The first valid frame after junk only synchronizes
+    {
+        static const uint16_t * const expected[] = {pulses_b};
+
+        start_stream(MASTER_WITH_SBUS_READER);
+        append(junk, sizeof(junk));
+        append(sbus_a, sizeof(sbus_a));
+        append(sbus_b, sizeof(sbus_b));
+        check("SBUS after junk", expected, 1);
+    }
+
+    // A header byte in the junk makes a frame that happens to end in a valid
+    // footer within A. It must not be published, nor may A or the following
+    // B, as none of them directly follows a valid frame.
+    {
+        static const uint16_t * const expected[] = {pulses_a};
+
+        start_stream(MASTER_WITH_SBUS_READER);
+        append(junk_with_header, sizeof(junk_with_header));
+        append(sbus_a, sizeof(sbus_a));
+        append(sbus_b, sizeof(sbus_b));
+        append(sbus_a, sizeof(sbus_a));
+        check("SBUS after junk with a header byte", expected, 1);
+    }
+
+    // A corrupted footer loses synchronization
+    {
+        static const uint16_t * const expected[] = {
+            pulses_b, pulses_a, pulses_b};
+
+        start_stream(MASTER_WITH_SBUS_READER);
+        append(sbus_a, sizeof(sbus_a));
+        append(sbus_b, sizeof(sbus_b));
+        append_modified(sbus_a, sizeof(sbus_a), SBUS_FRAME_LENGTH - 1, 0x55);
+        append(sbus_b, sizeof(sbus_b));
+        append(sbus_a, sizeof(sbus_a));
+        append(sbus_b, sizeof(sbus_b));
+        check("SBUS with a corrupted frame", expected, 3);
+    }
+
+    // SBUS2 footers are valid too
+    {
+        static const uint16_t * const expected[] = {pulses_b};
+
+        start_stream(MASTER_WITH_SBUS_READER);
+        append_modified(sbus_a, sizeof(sbus_a), SBUS_FRAME_LENGTH - 1, 0x14);
+        append_modified(sbus_b, sizeof(sbus_b), SBUS_FRAME_LENGTH - 1, 0x34);
+        check("SBUS2 footer", expected, 1);
+    }
+
+    // Failsafe and frame lost frames are not published, but keep the
+    // synchronization
+    {
+        static const uint16_t * const expected[] = {pulses_b, pulses_a};
+
+        start_stream(MASTER_WITH_SBUS_READER);
+        append(sbus_a, sizeof(sbus_a));
+        append(sbus_b, sizeof(sbus_b));
+        append(sbus_failsafe, sizeof(sbus_failsafe));
+        append_modified(sbus_b, sizeof(sbus_b), 23, SBUS_FLAG_FRAME_LOST);
+        append(sbus_a, sizeof(sbus_a));
+        check("SBUS failsafe and frame lost", expected, 2);
+    }
+}
+
+
+// ****************************************************************************
+static void test_ibus(void)
+{
+    static const uint8_t junk[] = {0x55, 0x20, 0x00, 0x20};
+
+    // The first valid frame after junk only synchronizes
+    {
+        static const uint16_t * const expected[] = {pulses_b, pulses_a};
+
+        start_stream(MASTER_WITH_IBUS_READER);
+        append(junk, sizeof(junk));
+        append(ibus_a, sizeof(ibus_a));
+        append(ibus_b, sizeof(ibus_b));
+        append(ibus_a, sizeof(ibus_a));
+        check("iBUS after junk", expected, 2);
+    }
+
+    // A corrupted channel fails the checksum and loses synchronization
+    {
+        static const uint16_t * const expected[] = {pulses_b, pulses_b};
+
+        start_stream(MASTER_WITH_IBUS_READER);
+        append(ibus_a, sizeof(ibus_a));
+        append(ibus_b, sizeof(ibus_b));
+        append_modified(ibus_a, sizeof(ibus_a), 2, 0xe9);
+        append(ibus_a, sizeof(ibus_a));
+        append(ibus_b, sizeof(ibus_b));
+        check("iBUS with a corrupted frame", expected, 2);
+    }
+}
+
+
+// ****************************************************************************
+int main(void)
+{
+    test_sbus();
+    test_ibus();
+
+    printf("%s\n", failures ? "FAIL" : "OK");
+    return failures ? 1 : 0;
+}
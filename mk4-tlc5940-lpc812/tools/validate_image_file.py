@@ -17,7 +17,7 @@ from intelhex import IntelHex, HexRecordError
 ROM_MAGIC = 0x6372424c          # LBrc (LANE Boys RC) in little endian
 
 SECTIONS = {0x01: "Configuration", 0x02: "Gamma table", 0x30: "Light programs",
-    0x10: "Local LEDs", 0x20: "Slave LEDs"}
+    0x10: "Local LEDs", 0x20: "Slave LEDs", 0x40: "CH3 gestures"}
 
 MAX_FILE_SIZE = 16 * 1024       # 16 kBytes FLASH size of the LCP812
 
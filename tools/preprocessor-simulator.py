@@ -5,6 +5,16 @@ preprocessor-simulator.py
 Simulate a receiver with built-in preprocessor. This allow testing of the
 light controller functionality without hooking up a RC system.
 
+With --protocol preprocessor-v2 the v2 preprocessor frames of the
+TLC5940/LPC812 based light controller (full resolution, sequence number and
+CRC-8) are sent.
+
+With --protocol sbus or --protocol ibus the channels are sent as SBUS or
+iBUS frames instead, for testing the serial receiver modes of the
+TLC5940/LPC812 based light controller. SBUS is an inverted signal, so an
+inverter (or a USB-serial adapter configured for inverted RxD/TxD) is needed
+between the tool and the light controller.
+
 A web browser is used for the user interface
 
 Author:         Werner Lane
@@ -32,8 +42,105 @@ except ImportError:
 
 
 SLAVE_MAGIC_BYTE = 0x87
+PREPROCESSOR_MAGIC_BYTE_V2 = 0x86
 HTML_FILE = "preprocessor-simulator.html"
 
+SBUS_HEADER = 0x0f
+SBUS_FLAG_FAILSAFE = 0x08
+IBUS_HEADER = [0x20, 0x40]
+
+# Serial settings and frame interval in seconds per protocol
+PROTOCOLS = {
+    'preprocessor': (None, serial.PARITY_NONE, serial.STOPBITS_ONE, 0.02),
+    'preprocessor-v2': (None, serial.PARITY_NONE, serial.STOPBITS_ONE, 0.02),
+    'sbus': (100000, serial.PARITY_EVEN, serial.STOPBITS_TWO, 0.014),
+    'ibus': (115200, serial.PARITY_NONE, serial.STOPBITS_ONE, 0.007),
+}
+
+
+def crc8(data):
+    ''' CRC-8, polynomial 0x07, initial value 0 '''
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            if crc & 0x80:
+                crc = ((crc << 1) ^ 0x07) & 0xff
+            else:
+                crc = (crc << 1) & 0xff
+    return crc
+
+
+def to_us(value):
+    ''' Convert a channel value of -100..100 to a pulse width in us '''
+    return 1500 + (value * 5)
+
+
+def encode_sbus(pulses, failsafe):
+    ''' Return a SBUS frame with the pulse widths on channels 1..n '''
+    bits = 0
+    for index, pulse in enumerate(pulses):
+        value = max(0, min(2047, ((pulse - 880) * 8 + 4) // 5))
+        bits |= value << (11 * index)
+
+    data = [SBUS_HEADER]
+    for _ in range(22):
+        data.append(bits & 0xff)
+        bits >>= 8
+    data.append(SBUS_FLAG_FAILSAFE if failsafe else 0)
+    data.append(0x00)
+    return bytearray(data)
+
+
+def encode_ibus(pulses):
+    ''' Return an iBUS frame with the pulse widths on channels 1..n '''
+    pulses = pulses + [1500] * (14 - len(pulses))
+
+    data = list(IBUS_HEADER)
+    for pulse in pulses:
+        data += [pulse & 0xff, pulse >> 8]
+    checksum = 0xffff - sum(data)
+    data += [checksum & 0xff, checksum >> 8]
+    return bytearray(data)
+
+
+def encode_preprocessor(receiver):
+    ''' Return a preprocessor frame for the given receiver state '''
+    steering = receiver['ST']
+    if steering < 0:
+        steering = 256 + steering
+
+    throttle = receiver['TH']
+    if throttle < 0:
+        throttle = 256 + throttle
+
+    last_byte = 0
+    if receiver['CH3']:
+        last_byte += 0x01
+    if receiver['STARTUP_MODE']:
+        last_byte += 0x10
+
+    return bytearray([SLAVE_MAGIC_BYTE, steering, throttle, last_byte])
+
+
+def encode_preprocessor_v2(receiver, sequence):
+    ''' Return a v2 preprocessor frame for the given receiver state '''
+    flags = 0
+    if receiver['CH3']:
+        flags += 0x01
+    if receiver['STARTUP_MODE']:
+        flags += 0x10
+
+    payload = [sequence & 0x3f, flags]
+    for value in (receiver['ST'] * 5, receiver['TH'] * 5,
+            500 if receiver['CH3'] else -500):
+        value += 512
+        payload += [value & 0x7f, (value >> 7) & 0x07]
+
+    crc = crc8(payload)
+    return bytearray([PREPROCESSOR_MAGIC_BYTE_V2] + payload +
+        [crc >> 4, crc & 0x0f])
+
 
 class QuietBaseHTTPRequestHandler(BaseHTTPRequestHandler):
     def log_request(self, code, message=None):
@@ -49,6 +156,11 @@ def parse_commandline():
     parser.add_argument("-b", "--baudrate", type=int, default=38400,
         help='Baudrate to use. Default is 38400.')
 
+    parser.add_argument("--protocol", choices=sorted(PROTOCOLS.keys()),
+        default='preprocessor',
+        help='Protocol to send. Default is preprocessor. The baudrate of '
+            'sbus and ibus is fixed.')
+
     parser.add_argument("-p", "--port", type=int, default=1234,
         help='HTTP port for the web UI. Default is localhost:1234.')
 
@@ -108,14 +220,21 @@ class PreprocessorApp(object):
         self.write_thread = None
         self.done = False
 
+        baudrate, parity, stopbits, self.interval = \
+            PROTOCOLS[self.args.protocol]
+        if baudrate is None:
+            baudrate = self.args.baudrate
+
         try:
-            self.uart = serial.Serial(self.args.tty, self.args.baudrate)
+            self.uart = serial.Serial(self.args.tty, baudrate,
+                parity=parity, stopbits=stopbits)
         except serial.SerialException as error:
             print("Unable to open port %s: %s" % (self.args.tty, error))
             sys.exit(1)
 
-        print("Simulating on {uart} at {baudrate} baud.".format(
-            uart=self.uart.port, baudrate=self.uart.baudrate))
+        print("Simulating {protocol} on {uart} at {baudrate} baud.".format(
+            protocol=self.args.protocol, uart=self.uart.port,
+            baudrate=self.uart.baudrate))
 
     def api(self, query):
         ''' Web api handler '''
@@ -152,27 +271,29 @@ class PreprocessorApp(object):
 
         def writer(app):
             ''' Background thread performing the UART transmission '''
+            sequence = 0
             while not app.done:
-                steering = app.receiver['ST']
-                if steering < 0:
-                    steering = 256 + steering
-
-                throttle = app.receiver['TH']
-                if throttle < 0:
-                    throttle = 256 + throttle
-
-                last_byte = 0
-                if app.receiver['CH3']:
-                    last_byte += 0x01
-                if app.receiver['STARTUP_MODE']:
-                    last_byte += 0x10
-
-                data = bytearray(
-                    [SLAVE_MAGIC_BYTE, steering, throttle, last_byte])
+                if app.args.protocol == 'preprocessor':
+                    data = encode_preprocessor(app.receiver)
+                elif app.args.protocol == 'preprocessor-v2':
+                    data = encode_preprocessor_v2(app.receiver, sequence)
+                    sequence += 1
+                else:
+                    pulses = [to_us(app.receiver['ST']),
+                        to_us(app.receiver['TH']),
+                        2000 if app.receiver['CH3'] else 1000]
+                    if app.args.protocol == 'sbus':
+                        # Startup mode is sent as failsafe, which the light
+                        # controller treats like a missing signal
+                        data = encode_sbus(pulses,
+                            app.receiver['STARTUP_MODE'])
+                    else:
+                        data = encode_ibus(pulses)
+
                 app.uart.write(data)
                 app.uart.flush()
 
-                time.sleep(0.02)
+                time.sleep(app.interval)
 
         server = HTTPServer(('', self.args.port), CustomHTTPRequestHandler)
         server.preprocessor = self
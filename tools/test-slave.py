@@ -5,6 +5,12 @@ This utility sends various light patterns to a "slave" that is based on the
 TLC5940 and PIC16F1825.
 Its behaviour is similar to the test-tlc5940-16f1825.hex program.
 
+With --v2 the light data is sent using the v2 slave protocol of the
+TLC5940/LPC812 based light controller (delta frames with sequence number,
+CRC-8 and periodic keyframes), so the tool can stand in for a master.
+With --address N the v2 frames are addressed to slave N of a daisy-chain
+(0 is the slave connected directly to the tool).
+
 Author:         Werner Lane
 E-mail:         laneboysrc@gmail.com
 '''
@@ -13,12 +19,16 @@ from __future__ import print_function
 
 import sys
 import time
+import argparse
 import serial
 
 BAUDRATE = 115200
 
 SLAVE_MAGIC_BYTE = 0x87
+SLAVE_MAGIC_BYTE_V2 = 0x88
+SLAVE_MAGIC_BYTE_ADDRESSED = 0x89
 NUMBER_OF_LEDS = 16
+KEYFRAME_INTERVAL = 25
 
 VAL_STEP1 = 63
 VAL_STEP2 = 31
@@ -34,19 +44,80 @@ def delay(timeout_in_s):
     time.sleep(timeout_in_s)
 
 
+def crc8(data):
+    ''' CRC-8, polynomial 0x07, initial value 0 '''
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            if crc & 0x80:
+                crc = ((crc << 1) ^ 0x07) & 0xff
+            else:
+                crc = (crc << 1) & 0xff
+    return crc
+
+
+class SlaveProtocolV2(object):
+    ''' Encoder for the v2 slave protocol '''
+
+    def __init__(self):
+        self.sequence = 0
+        self.frames_until_keyframe = 0
+        self.sent = [0] * NUMBER_OF_LEDS
+
+    def encode(self, light_data):
+        ''' Return the v2 frame for light_data '''
+        keyframe = self.frames_until_keyframe == 0
+
+        changed = 0
+        values = []
+        for index, value in enumerate(light_data):
+            if keyframe or value != self.sent[index]:
+                changed |= 1 << index
+                self.sent[index] = value
+                values.append(value)
+
+        payload = [(0x40 if keyframe else 0) | self.sequence,
+            changed & 0x7f, (changed >> 7) & 0x7f, (changed >> 14) & 0x03]
+        payload += values
+        crc = crc8(payload)
+
+        self.sequence = (self.sequence + 1) & 0x3f
+        if keyframe:
+            self.frames_until_keyframe = KEYFRAME_INTERVAL
+        self.frames_until_keyframe -= 1
+
+        return bytearray([SLAVE_MAGIC_BYTE_V2] + payload +
+            [crc >> 4, crc & 0x0f])
+
+
 class Testapp(object):
     ''' Send the test patterns to the TLC5940 based slave '''
 
     def __init__(self):
-        try:
-            port = sys.argv[1]
-        except IndexError:
-            port = '/dev/ttyUSB0'
+        parser = argparse.ArgumentParser(
+            description="Send test patterns to a light controller slave.")
+        parser.add_argument("-b", "--baudrate", type=int, default=BAUDRATE,
+            help="Baudrate to use. Default is {:d}.".format(BAUDRATE))
+        parser.add_argument("--v2", action='store_true',
+            help="Use the v2 slave protocol (delta frames with CRC).")
+        parser.add_argument("--address", type=int,
+            help="Send v2 frames addressed to the given slave in a "
+                "daisy-chain. Implies --v2.")
+        parser.add_argument("port", nargs='?', default='/dev/ttyUSB0',
+            help="Serial port to use. Default is /dev/ttyUSB0.")
+        args = parser.parse_args()
+
+        self.address = args.address
+        if self.address is not None and not 0 <= self.address < 0x80:
+            parser.error("address must be between 0 and 127")
+        use_v2 = args.v2 or self.address is not None
+        self.protocol_v2 = SlaveProtocolV2() if use_v2 else None
 
         try:
-            self.uart = serial.Serial(port, BAUDRATE)
+            self.uart = serial.Serial(args.port, args.baudrate)
         except serial.SerialException as error:
-            print("Unable to open port %s: %s" % (port, error))
+            print("Unable to open port %s: %s" % (args.port, error))
             sys.exit(0)
 
         print("Sending SLAVE data on {uart} at {baudrate} baud.".format(
@@ -55,7 +126,13 @@ class Testapp(object):
 
     def send_to_slave(self, light_data):
         ''' Send light_data to the slave via the slave UART protocol '''
-        data = bytearray([SLAVE_MAGIC_BYTE]) + bytearray(light_data)
+        if self.protocol_v2:
+            data = self.protocol_v2.encode(light_data)
+            if self.address is not None:
+                data = bytearray([SLAVE_MAGIC_BYTE_ADDRESSED,
+                    self.address]) + data[1:]
+        else:
+            data = bytearray([SLAVE_MAGIC_BYTE]) + bytearray(light_data)
         self.uart.write(data)
         self.uart.flush()
 